@@ -231,6 +231,23 @@ public:
     // current at the time of the last call to detachFromContext.
     status_t attachToContext(uint32_t tex);
 
+    // EglImageDeleter lets the owner of the GL context take over the
+    // destruction of the EGLImages this GLConsumer releases, e.g. to batch
+    // them on its own thread rather than destroying them on whichever thread
+    // drops the last reference. deleteImage() must eventually call
+    // eglDestroyImageKHR(dpy, image) followed by eglTerminate(dpy).
+    class EglImageDeleter : public virtual RefBase {
+    public:
+        virtual void deleteImage(EGLDisplay dpy, EGLImageKHR image) = 0;
+    protected:
+        virtual ~EglImageDeleter() { }
+    };
+
+    // setEglImageDeleter sets the EglImageDeleter used for the EGLImages
+    // created from buffers acquired after this call. By default EGLImages
+    // are destroyed immediately.
+    void setEglImageDeleter(const sp<EglImageDeleter>& deleter);
+
 protected:
 
     // abandonLocked overrides the ConsumerBase method to clear
@@ -286,7 +303,8 @@ private:
     // also only creating new EGLImages from buffers when required.
     class EglImage : public LightRefBase<EglImage>  {
     public:
-        EglImage(sp<GraphicBuffer> graphicBuffer);
+        EglImage(sp<GraphicBuffer> graphicBuffer,
+                const sp<EglImageDeleter>& deleter);
 
         // createIfNeeded creates an EGLImage if required (we haven't created
         // one yet, or the EGLDisplay or crop-rect has changed).
@@ -328,6 +346,9 @@ private:
         // mCropRect is the crop rectangle passed to EGL when mEglImage
         // was created.
         Rect mCropRect;
+
+        // mDeleter, if set, destroys mEglImage when this object goes away.
+        sp<EglImageDeleter> mDeleter;
     };
 
     // freeBufferLocked frees up the given buffer slot. If the slot has been
@@ -486,6 +507,10 @@ private:
     // mode and releaseTexImage() has been called
     static sp<GraphicBuffer> sReleasedTexImageBuffer;
     sp<EglImage> mReleasedTexImage;
+
+    // mEglImageDeleter is handed to every new EglImage. See
+    // setEglImageDeleter().
+    sp<EglImageDeleter> mEglImageDeleter;
 };
 
 // ----------------------------------------------------------------------------
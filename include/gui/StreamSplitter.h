@@ -20,6 +20,8 @@
 #include <gui/IConsumerListener.h>
 #include <gui/IProducerListener.h>
 
+#include <ui/FenceSet.h>
+
 #include <utils/Condition.h>
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
@@ -131,7 +133,9 @@ private:
         BufferTracker(const sp<GraphicBuffer>& buffer);
 
         const sp<GraphicBuffer>& getBuffer() const { return mBuffer; }
-        const sp<Fence>& getMergedFence() const { return mMergedFence; }
+        // Returns a fence that signals once all of the fences passed to
+        // mergeFence have; they are merged together only when asked for
+        sp<Fence> getMergedFence() const;
 
         void mergeFence(const sp<Fence>& with);
 
@@ -149,7 +153,7 @@ private:
         BufferTracker& operator=(const BufferTracker& other);
 
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
-        sp<Fence> mMergedFence;
+        FenceSet mFences;
         size_t mReleaseCount;
     };
 
@@ -50,12 +50,28 @@ struct InputMessage {
         TYPE_FINISHED = 3,
     };
 
+    enum {
+        // Each pointer of a motion body is a PointerProperties and a PointerCoords.
+        VERSION_FIXED_POINTERS = 0,
+        // Each pointer of a motion body is its PointerProperties, the bits of its
+        // PointerCoords and then only the values of the axes that are present, packed
+        // one after the other.  InputChannel::receiveMessage() expands these back to
+        // VERSION_FIXED_POINTERS, so consumers only ever see that layout.
+        VERSION_COMPACT_POINTERS = 1,
+
+        // The version of a finished message tells the publisher that its consumer decodes
+        // VERSION_COMPACT_POINTERS.  Consumers from before the version field left it
+        // uninitialized, so this is a value that garbage is unlikely to match rather than
+        // VERSION_COMPACT_POINTERS itself.
+        VERSION_FINISHED_DECODES_COMPACT_POINTERS = 0x43505431,
+    };
+
     struct Header {
         uint32_t type;
-        // We don't need this field in order to align the body below but we
-        // leave it here because InputMessage::size() and other functions
-        // compute the size of this structure as sizeof(Header) + sizeof(Body).
-        uint32_t padding;
+        // The encoding of the body, one of the VERSION_* constants.  Only motion
+        // bodies have more than one encoding; finished bodies carry
+        // VERSION_FINISHED_DECODES_COMPACT_POINTERS instead.
+        uint32_t version;
     } header;
 
     // Body *must* be 8 byte aligned.
@@ -124,6 +140,10 @@ struct InputMessage {
 
     bool isValid(size_t actualSize) const;
     size_t size() const;
+
+    /* Converts a motion message with VERSION_COMPACT_POINTERS to VERSION_FIXED_POINTERS
+     * in place.  The message must be valid. */
+    void expandPointers();
 };
 
 /*
@@ -139,18 +159,49 @@ protected:
     virtual ~InputChannel();
 
 public:
+    enum Transport {
+        // Messages are sent over a unix domain socket.
+        TRANSPORT_SOCKET,
+        // Messages are copied through a pair of rings in shared memory and the receiver is
+        // woken through an eventfd, so a message costs no kernel copy and the sender only
+        // makes a system call when the receiver may be asleep.  A socket pair is still
+        // kept to tell when the other end goes away.
+        //
+        // Such a channel is made of several file descriptors, so it must be written to
+        // a Parcel with getFds() and read back with createFromFds() rather than through
+        // getFd().
+        TRANSPORT_SHARED_MEMORY,
+    };
+
     InputChannel(const String8& name, int fd);
 
-    /* Creates a pair of input channels.
+    /* Creates an input channel from the file descriptors that getFds() returned for one
+     * end of a channel, typically after they were passed to this process in a Parcel.
+     * Takes ownership of the file descriptors.
+     *
+     * Returns NULL, having closed them, if they don't make up a channel end.
+     */
+    static sp<InputChannel> createFromFds(const String8& name, const Vector<int>& fds);
+
+    /* Creates a pair of input channels using the given transport.
      *
      * Returns OK on success.
      */
     static status_t openInputChannelPair(const String8& name,
-            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
+            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel,
+            Transport transport = TRANSPORT_SOCKET);
 
     inline String8 getName() const { return mName; }
+
+    /* Returns the file descriptor to poll for incoming messages.  For a shared memory
+     * channel this is an epoll descriptor that is readable when a message may be
+     * waiting or when the other end has been closed. */
     inline int getFd() const { return mFd; }
 
+    inline Transport getTransport() const {
+        return mSharedMemory != NULL ? TRANSPORT_SHARED_MEMORY : TRANSPORT_SOCKET;
+    }
+
     /* Sends a message to the other endpoint.
      *
      * If the channel is full then the message is guaranteed not to have been sent at all.
@@ -164,6 +215,18 @@ public:
      */
     status_t sendMessage(const InputMessage* msg);
 
+    /* Sends several messages to the other endpoint, in order, using as few system calls
+     * as possible.  Each message is still delivered as a separate packet.
+     *
+     * Stops at the first message that cannot be sent.  The number of messages that were
+     * sent is returned in outSent either way.
+     *
+     * Returns OK if all of the messages were sent.
+     * Otherwise returns the error that sendMessage() would have returned for the first
+     * message that was not sent.
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count, size_t* outSent);
+
     /* Receives a message sent by the other endpoint.
      *
      * If there is no message present, try again after poll() indicates that the fd
@@ -176,12 +239,31 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
-    /* Returns a new object that has a duplicate of this channel's fd. */
+    /* Returns a new object that has a duplicate of this channel's fd.  The copy of a
+     * shared memory channel shares its mapping, so it can only be used in this process;
+     * use getFds() to hand a channel to another process. */
     sp<InputChannel> dup() const;
 
+    /* Returns the file descriptors that make up this end of the channel, for writing it to
+     * a Parcel: the fd alone for TRANSPORT_SOCKET, and for TRANSPORT_SHARED_MEMORY the
+     * socket, the two rings and the two eventfds.  The channel keeps ownership of them.
+     *
+     * A shared memory end whose file descriptors were taken no longer tells the other end
+     * that it is gone when it is destroyed, since a copy of it may live on in another
+     * process; the other end finds out when the last copy of the socket is closed. */
+    Vector<int> getFds() const;
+
 private:
+    class SharedMemory;
+
+    static status_t openSharedMemoryChannelPair(const String8& name,
+            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
+    static status_t openSharedMemoryChannel(const String8& name, const int* fds,
+            bool exported, sp<InputChannel>& outChannel);
+
     String8 mName;
     int mFd;
+    sp<SharedMemory> mSharedMemory; // NULL unless the transport is TRANSPORT_SHARED_MEMORY
 };
 
 /*
@@ -250,6 +332,8 @@ public:
      * If a signal was received, returns the message sequence number,
      * and whether the consumer handled the message.
      *
+     * The first finished signal also tells whether the consumer decodes compact pointers.
+     *
      * The returned sequence number is never 0 unless the operation failed.
      *
      * Returns OK on success.
@@ -259,8 +343,81 @@ public:
      */
     status_t receiveFinishedSignal(uint32_t* outSeq, bool* outHandled);
 
+    /* Fills in a message for a key event without sending it, so that several events can be
+     * published together with publishMessages().
+     *
+     * Returns OK on success.
+     * Returns BAD_VALUE if seq is 0.
+     */
+    status_t buildKeyMessage(InputMessage* outMsg,
+            uint32_t seq,
+            int32_t deviceId,
+            int32_t source,
+            int32_t action,
+            int32_t flags,
+            int32_t keyCode,
+            int32_t scanCode,
+            int32_t metaState,
+            int32_t repeatCount,
+            nsecs_t downTime,
+            nsecs_t eventTime) const;
+
+    /* Fills in a message for a motion event without sending it, so that several events can
+     * be published together with publishMessages().
+     *
+     * Returns OK on success.
+     * Returns BAD_VALUE if seq is 0 or if pointerCount is less than 1 or greater than MAX_POINTERS.
+     */
+    status_t buildMotionMessage(InputMessage* outMsg,
+            uint32_t seq,
+            int32_t deviceId,
+            int32_t source,
+            int32_t action,
+            int32_t flags,
+            int32_t edgeFlags,
+            int32_t metaState,
+            int32_t buttonState,
+            float xOffset,
+            float yOffset,
+            float xPrecision,
+            float yPrecision,
+            nsecs_t downTime,
+            nsecs_t eventTime,
+            uint32_t pointerCount,
+            const PointerProperties* pointerProperties,
+            const PointerCoords* pointerCoords) const;
+
+    /* Publishes messages filled in by buildKeyMessage() or buildMotionMessage(), in order.
+     * This takes a single system call when the channel has room for all of them.
+     *
+     * The number of messages that were published is returned in outPublished.
+     *
+     * Returns OK if all of the messages were published.
+     * Returns WOULD_BLOCK if the channel filled up before all of them were published.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t publishMessages(const InputMessage* msgs, size_t count, size_t* outPublished);
+
+    /* Sets whether motion events may be published with VERSION_COMPACT_POINTERS.  This is
+     * the default unless the ro.input.nocompactmotion property is set to 1.  Even then,
+     * motion events use VERSION_FIXED_POINTERS until a finished signal from the consumer
+     * has shown that it decodes compact pointers; a consumer that doesn't keeps getting
+     * the fixed layout.
+     */
+    inline void setCompactPointersEnabled(bool enabled) { mCompactPointers = enabled; }
+
+    /* Returns true if motion events are currently published with VERSION_COMPACT_POINTERS. */
+    inline bool isPublishingCompactPointers() const {
+        return mCompactPointers && mConsumerDecodesCompactPointers;
+    }
+
 private:
     sp<InputChannel> mChannel;
+    bool mCompactPointers;
+    bool mConsumerDecodesCompactPointers;
+
+    static bool isCompactPointersEnabled();
 };
 
 /*
@@ -82,6 +82,15 @@ public:
     static sp<Fence> merge(const String8& name, const sp<Fence>& f1,
             const sp<Fence>& f2);
 
+    // mergeMany combines count Fence objects into one that becomes signaled
+    // when all of them are signaled. Invalid fences are skipped. If only one
+    // valid fence is left it is returned as is, and if none is NO_FENCE is
+    // returned. Unlike a chain of merge() calls, no Fence object is created
+    // for the intermediate merges and each intermediate fd is closed as soon
+    // as the next one is created.
+    static sp<Fence> mergeMany(const String8& name, const sp<Fence>* fences,
+            size_t count);
+
     // Return a duplicate of the fence file descriptor. The caller is
     // responsible for closing the returned file descriptor. On error, -1 will
     // be returned and errno will indicate the problem.
@@ -100,6 +109,9 @@ public:
     status_t unflatten(void const*& buffer, size_t& size, int const*& fds, size_t& count);
 
 private:
+    // FenceSet polls the fence file descriptors directly
+    friend class FenceSet;
+
     // Only allow instantiation using ref counting.
     friend class LightRefBase<Fence>;
     ~Fence();
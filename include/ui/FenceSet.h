@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FENCE_SET_H
+#define ANDROID_FENCE_SET_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ui/Fence.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// ===========================================================================
+// FenceSet
+// ===========================================================================
+
+// A FenceSet holds a number of fences that are waited for, merged or queried
+// together. Waits poll all of the fences' file descriptors at once instead
+// of waiting for them one at a time.
+class FenceSet
+{
+public:
+    FenceSet();
+    ~FenceSet();
+
+    // Add a fence to the set. Invalid fences (e.g. NO_FENCE) may be added,
+    // like everywhere else they are treated as already signaled.
+    void add(const sp<Fence>& fence);
+    void clear();
+
+    size_t size() const { return mFences.size(); }
+    bool isEmpty() const { return mFences.isEmpty(); }
+    const sp<Fence>& operator [] (size_t index) const { return mFences[index]; }
+
+    // merge returns a single fence that becomes signaled when all of the
+    // fences in the set are, see Fence::mergeMany.
+    sp<Fence> merge(const String8& name) const;
+
+    // waitAny waits for up to timeout milliseconds for any fence of the set
+    // to signal and returns its index. If the timeout expires first -ETIME
+    // is returned, and if a fence is in an error state -EINVAL is. An empty
+    // set also returns -ETIME. Fence::TIMEOUT_NEVER may be used to wait
+    // indefinitely.
+    ssize_t waitAny(int timeout) const;
+
+    // waitAll waits for up to timeout milliseconds for all of the fences to
+    // signal and returns NO_ERROR if they did, or the same errors as
+    // waitAny.
+    status_t waitAll(int timeout) const;
+
+    // getSignalTimes returns the times at which the first and the last fence
+    // of the set signaled. If a fence isn't signaled yet, latest is
+    // INT64_MAX, and so is earliest if none is. Invalid fences are ignored;
+    // if there are only invalid fences both times are -1.
+    status_t getSignalTimes(nsecs_t* earliest, nsecs_t* latest) const;
+
+    // getSignalTime returns the time at which the whole set became signaled,
+    // like Fence::getSignalTime does for a merged fence.
+    nsecs_t getSignalTime() const;
+
+private:
+    struct PollList;
+    void fillPollList(PollList* list) const;
+
+    Vector< sp<Fence> > mFences;
+};
+
+}; // namespace android
+
+#endif // ANDROID_FENCE_SET_H
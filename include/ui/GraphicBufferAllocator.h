@@ -19,9 +19,11 @@
 #define ANDROID_BUFFER_ALLOCATOR_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 #include <cutils/native_handle.h>
 
+#include <utils/BasicHashtable.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
 #include <utils/threads.h>
@@ -70,21 +72,51 @@ public:
 
     status_t free(buffer_handle_t handle);
 
+    // Buffers are accounted to this process when they are allocated. An
+    // allocator serving other processes (e.g. GraphicBufferAlloc handling a
+    // binder call) hands each buffer over to the process it was made for.
+    status_t setOwner(buffer_handle_t handle, pid_t pid);
+
     void dump(String8& res) const;
     static void dumpToSystemLog();
 
 private:
     struct alloc_rec_t {
+        buffer_handle_t handle;
         uint32_t w;
         uint32_t h;
         uint32_t s;
         PixelFormat format;
         uint32_t usage;
         size_t size;
+        pid_t pid;      // process the buffer was allocated for
+        inline const buffer_handle_t& getKey() const { return handle; }
     };
-    
+
+    // memory accounted to a format, a usage or a process
+    struct alloc_stat_t {
+        size_t count;
+        size_t size;
+    };
+
+    static int compareHandles(const alloc_rec_t* lhs, const alloc_rec_t* rhs);
+
+    template <typename KEY>
+    static void addStat(KeyedVector<KEY, alloc_stat_t>& stats,
+            const KEY& key, size_t size);
+    template <typename KEY>
+    static void removeStat(KeyedVector<KEY, alloc_stat_t>& stats,
+            const KEY& key, size_t size);
+
     static Mutex sLock;
-    static KeyedVector<buffer_handle_t, alloc_rec_t> sAllocList;
+    static BasicHashtable<buffer_handle_t, alloc_rec_t> sAllocList;
+    static KeyedVector<PixelFormat, alloc_stat_t> sFormatStats;
+    static KeyedVector<uint32_t, alloc_stat_t> sUsageStats;
+    static KeyedVector<pid_t, alloc_stat_t> sPidStats;
+    static size_t sTotalSize;
+    // high-water mark of sTotalSize, and the number of buffers then
+    static size_t sPeakSize;
+    static size_t sPeakCount;
     
     friend class Singleton<GraphicBufferAllocator>;
     GraphicBufferAllocator();
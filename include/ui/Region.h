@@ -59,6 +59,12 @@ public:
             void        clear();
             void        set(const Rect& r);
             void        set(uint32_t w, uint32_t h);
+
+            // sets the region to the union of count rects given in any
+            // order, which must not overlap (they may touch, and may be
+            // empty). They are sorted into bands directly, without the
+            // boolean operations or'ing them one at a time would take.
+            void        setDisjointRects(Rect const* rects, size_t count);
         
             Region&     orSelf(const Rect& rhs);
             Region&     xorSelf(const Rect& rhs);
@@ -83,6 +89,17 @@ public:
     const   Region      intersect(const Region& rhs) const;
     const   Region      subtract(const Region& rhs) const;
 
+            // boolean operators, the result is stored into dst, reusing
+            // its storage. dst may be this region or rhs.
+            void        merge(const Rect& rhs, Region* dst) const;
+            void        mergeExclusive(const Rect& rhs, Region* dst) const;
+            void        intersect(const Rect& rhs, Region* dst) const;
+            void        subtract(const Rect& rhs, Region* dst) const;
+            void        merge(const Region& rhs, Region* dst) const;
+            void        mergeExclusive(const Region& rhs, Region* dst) const;
+            void        intersect(const Region& rhs, Region* dst) const;
+            void        subtract(const Region& rhs, Region* dst) const;
+
             // these translate rhs first
             Region&     translateSelf(int dx, int dy);
             Region&     orSelf(const Region& rhs, int dx, int dy);
@@ -149,6 +166,7 @@ public:
 private:
     class rasterizer;
     friend class rasterizer;
+    struct Scratch;
     
     Region& operationSelf(const Rect& r, int op);
     Region& operationSelf(const Region& r, int op);
@@ -156,6 +174,11 @@ private:
     const Region operation(const Rect& rhs, int op) const;
     const Region operation(const Region& rhs, int op) const;
     const Region operation(const Region& rhs, int dx, int dy, int op) const;
+    void operation(const Rect& rhs, int op, Region* dst) const;
+    void operation(const Region& rhs, int dx, int dy, int op,
+            Region* dst) const;
+
+    static Scratch& getScratch();
 
     static void boolean_operation(int op, Region& dst,
             const Region& lhs, const Region& rhs, int dx, int dy);
@@ -167,17 +190,75 @@ private:
     static void boolean_operation(int op, Region& dst,
             const Region& lhs, const Rect& rhs);
 
+    // dst = (src translated by dx, dy) & clip
+    static void clip_operation(Region& dst, const Region& src,
+            int dx, int dy, const Rect& clip);
+
     static void translate(Region& reg, int dx, int dy);
     static void translate(Region& dst, const Region& reg, int dx, int dy);
 
     static bool validate(const Region& reg,
             const char* name, bool silent = false);
     
+    // RectStorage holds an array of Rects. Up to INLINE_RECTS of them are
+    // stored in the object itself (which covers single-rect regions and
+    // regions of up to INLINE_RECTS-1 rects plus their bounds), larger
+    // arrays spill into a copy-on-write Vector.
+    //
+    // Once allocated, the Vector is kept when the storage is cleared or
+    // shrinks back inline, so that a Region which is recomputed over and
+    // over reuses its memory. It is only let go of when it is shared with
+    // another Region, since writing to it would copy it anyway.
+    class RectStorage {
+    public:
+        enum { INLINE_RECTS = 4 };
+
+        inline RectStorage() : mCount(0) { }
+        RectStorage(const RectStorage& rhs);
+        RectStorage& operator = (const RectStorage& rhs);
+
+        inline size_t size() const { return mCount; }
+        inline bool isInline() const { return mCount <= INLINE_RECTS; }
+        inline Rect const* array() const {
+            return isInline() ? mInline : mHeap.array();
+        }
+        inline const Rect& operator [] (size_t index) const {
+            return array()[index];
+        }
+        inline const Rect& itemAt(size_t index) const { return array()[index]; }
+        inline const Rect& top() const { return array()[mCount - 1]; }
+
+        Rect*       editArray();
+        void        clear();
+        void        add(const Rect& rect);
+        void        appendArray(Rect const* rects, size_t count);
+        void        insertAt(const Rect& rect, size_t index);
+        void        setTo(Rect const* rects, size_t count);
+        void        swap(RectStorage& rhs);
+        // keeps the first count rects, or adds uninitialized ones
+        void        resize(size_t count);
+
+        // returns a SharedBuffer holding a copy of (or, once spilled, a
+        // reference to) the array. the caller must release() it.
+        SharedBuffer const* getSharedBuffer() const;
+
+    private:
+        // returns the heap array, grown to hold at least count rects
+        Rect*       editHeap(size_t count);
+        bool        isHeapShared() const;
+
+        size_t mCount;
+        Rect mInline[INLINE_RECTS];
+        // only the first mCount rects are meaningful, and only when the
+        // storage isn't inline
+        Vector<Rect> mHeap;
+    };
+
     // mStorage is a (manually) sorted array of Rects describing the region
     // with an extra Rect as the last element which is set to the
     // bounds of the region. However, if the region is
     // a simple Rect then mStorage contains only that rect.
-    Vector<Rect> mStorage;
+    RectStorage mStorage;
 };
 
 
@@ -30,6 +30,14 @@
 #include <utils/Debug.h>
 #include <utils/String8.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UI_TMAT_SIMD 1
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define UI_TMAT_SIMD 1
+#endif
+
 #define PURE __attribute__((pure))
 
 namespace android {
@@ -157,6 +165,56 @@ typename MATRIX::col_type PURE diag(const MATRIX& m) {
     return result;
 }
 
+#ifdef UI_TMAT_SIMD
+/*
+ * The 4-wide float operations the float specializations of ui/mat4.h are
+ * written with. Loads and stores are unaligned, tvec4<float> is only
+ * aligned on a float.
+ */
+namespace simd {
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+typedef float32x4_t float4;
+inline float4 load(const float* p)          { return vld1q_f32(p); }
+inline void   store(float* p, float4 v)     { vst1q_f32(p, v); }
+inline float4 splat(float v)                { return vdupq_n_f32(v); }
+inline float4 add(float4 a, float4 b)       { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b)       { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b)       { return vmulq_f32(a, b); }
+
+// transposes the 4x4 matrix at src into dst, which may be src
+inline void transpose(float* dst, const float* src) {
+    // a de-interleaving load of the columns gives the rows
+    float32x4x4_t m = vld4q_f32(src);
+    vst1q_f32(dst,      m.val[0]);
+    vst1q_f32(dst + 4,  m.val[1]);
+    vst1q_f32(dst + 8,  m.val[2]);
+    vst1q_f32(dst + 12, m.val[3]);
+}
+#else
+typedef __m128 float4;
+inline float4 load(const float* p)          { return _mm_loadu_ps(p); }
+inline void   store(float* p, float4 v)     { _mm_storeu_ps(p, v); }
+inline float4 splat(float v)                { return _mm_set1_ps(v); }
+inline float4 add(float4 a, float4 b)       { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b)       { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b)       { return _mm_mul_ps(a, b); }
+
+// transposes the 4x4 matrix at src into dst, which may be src
+inline void transpose(float* dst, const float* src) {
+    float4 c0 = _mm_loadu_ps(src);
+    float4 c1 = _mm_loadu_ps(src + 4);
+    float4 c2 = _mm_loadu_ps(src + 8);
+    float4 c3 = _mm_loadu_ps(src + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(dst,      c0);
+    _mm_storeu_ps(dst + 4,  c1);
+    _mm_storeu_ps(dst + 8,  c2);
+    _mm_storeu_ps(dst + 12, c3);
+}
+#endif
+}; // namespace simd
+#endif // UI_TMAT_SIMD
+
 template <typename MATRIX>
 String8 asString(const MATRIX& m) {
     String8 s;
@@ -383,6 +383,121 @@ typename tmat44<T>::col_type PURE diag(const tmat44<T>& m) {
     return matrix::diag(m);
 }
 
+// ----------------------------------------------------------------------------------------
+// SIMD specializations for float
+// ----------------------------------------------------------------------------------------
+
+/*
+ * These perform the same operations in the same order as the generic versions
+ * above, four lanes at a time, so that their results are the same.
+ */
+
+#ifdef UI_TMAT_SIMD
+
+// matrix * vector: the columns of the matrix weighted by the vector
+template <>
+inline tvec4<float> PURE operator * <float, float>(const tmat44<float>& lv, const tvec4<float>& rv) {
+    using namespace matrix::simd;
+    float4 r =   mul(load(&lv[0].x), splat(rv.x));
+    r = add(r, mul(load(&lv[1].x), splat(rv.y)));
+    r = add(r, mul(load(&lv[2].x), splat(rv.z)));
+    r = add(r, mul(load(&lv[3].x), splat(rv.w)));
+    tvec4<float> result(tvec4<float>::NO_INIT);
+    store(&result.x, r);
+    return result;
+}
+
+// vector * matrix: the same, with the rows of the matrix
+template <>
+inline tvec4<float> PURE operator * <float, float>(const tvec4<float>& rv, const tmat44<float>& lv) {
+    using namespace matrix::simd;
+    tmat44<float> t(tmat44<float>::NO_INIT);
+    matrix::simd::transpose(&t[0].x, lv.asArray());
+    float4 r =   mul(load(&t[0].x), splat(rv.x));
+    r = add(r, mul(load(&t[1].x), splat(rv.y)));
+    r = add(r, mul(load(&t[2].x), splat(rv.z)));
+    r = add(r, mul(load(&t[3].x), splat(rv.w)));
+    tvec4<float> result(tvec4<float>::NO_INIT);
+    store(&result.x, r);
+    return result;
+}
+
+namespace matrix {
+
+template <>
+inline tmat44<float> PURE multiply< tmat44<float> >(const tmat44<float>& lhs, const tmat44<float>& rhs) {
+    using namespace simd;
+    const float4 c0 = load(&lhs[0].x);
+    const float4 c1 = load(&lhs[1].x);
+    const float4 c2 = load(&lhs[2].x);
+    const float4 c3 = load(&lhs[3].x);
+    tmat44<float> res(tmat44<float>::NO_INIT);
+    for (size_t r=0 ; r<tmat44<float>::row_size() ; r++) {
+        const tvec4<float>& v(rhs[r]);
+        float4 col =   mul(c0, splat(v.x));
+        col = add(col, mul(c1, splat(v.y)));
+        col = add(col, mul(c2, splat(v.z)));
+        col = add(col, mul(c3, splat(v.w)));
+        store(&res[r].x, col);
+    }
+    return res;
+}
+
+template <>
+inline tmat44<float> PURE transpose(const tmat44<float>& m) {
+    tmat44<float> result(tmat44<float>::NO_INIT);
+    simd::transpose(&result[0].x, m.asArray());
+    return result;
+}
+
+// Gauss-Jordan elimination with partial pivoting, like the generic inverse;
+// a row operation on tmp and inverse is a single vector operation each.
+template <>
+inline tmat44<float> PURE inverse(const tmat44<float>& src) {
+    using namespace simd;
+    const size_t N = tmat44<float>::col_size();
+    tmat44<float> tmp(src);
+    tmat44<float> inverse(1);
+
+    for (size_t i=0 ; i<N ; i++) {
+        // look for largest element in column
+        size_t swap = i;
+        for (size_t j=i+1 ; j<N ; j++) {
+            if (fabs(tmp[j][i]) > fabs(tmp[i][i])) {
+                swap = j;
+            }
+        }
+
+        if (swap != i) {
+            /* swap rows. */
+            const tvec4<float> t(tmp[i]);
+            tmp[i] = tmp[swap];
+            tmp[swap] = t;
+            const tvec4<float> u(inverse[i]);
+            inverse[i] = inverse[swap];
+            inverse[swap] = u;
+        }
+
+        const float4 t = splat(1 / tmp[i][i]);
+        const float4 ti = mul(load(&tmp[i].x), t);
+        const float4 ii = mul(load(&inverse[i].x), t);
+        store(&tmp[i].x, ti);
+        store(&inverse[i].x, ii);
+        for (size_t j=0 ; j<N ; j++) {
+            if (j != i) {
+                const float4 s = splat(tmp[j][i]);
+                store(&tmp[j].x, sub(load(&tmp[j].x), mul(ti, s)));
+                store(&inverse[j].x, sub(load(&inverse[j].x), mul(ii, s)));
+            }
+        }
+    }
+    return inverse;
+}
+
+}; // namespace matrix
+
+#endif // UI_TMAT_SIMD
+
 // ----------------------------------------------------------------------------------------
 
 typedef tmat44<float> mat4;
@@ -177,6 +177,11 @@ status_t GLConsumer::setDefaultMaxBufferCount(int bufferCount) {
 }
 
 
+void GLConsumer::setEglImageDeleter(const sp<EglImageDeleter>& deleter) {
+    Mutex::Autolock lock(mMutex);
+    mEglImageDeleter = deleter;
+}
+
 status_t GLConsumer::setDefaultBufferSize(uint32_t w, uint32_t h)
 {
     Mutex::Autolock lock(mMutex);
@@ -281,7 +286,8 @@ status_t GLConsumer::releaseTexImage() {
         }
 
         if (mReleasedTexImage == NULL) {
-            mReleasedTexImage = new EglImage(getDebugTexImageBuffer());
+            mReleasedTexImage = new EglImage(getDebugTexImageBuffer(),
+                    mEglImageDeleter);
         }
 
         mCurrentTexture = BufferQueue::INVALID_BUFFER_SLOT;
@@ -344,7 +350,8 @@ status_t GLConsumer::acquireBufferLocked(BufferQueue::BufferItem *item,
     // replaces any old EglImage with a new one (using the new buffer).
     if (item->mGraphicBuffer != NULL) {
         int slot = item->mBuf;
-        mEglSlots[slot].mEglImage = new EglImage(item->mGraphicBuffer);
+        mEglSlots[slot].mEglImage = new EglImage(item->mGraphicBuffer,
+                mEglImageDeleter);
     }
 
     return NO_ERROR;
@@ -1061,14 +1068,20 @@ static void mtxMul(float out[16], const float a[16], const float b[16]) {
     out[15] = a[3]*b[12] + a[7]*b[13] + a[11]*b[14] + a[15]*b[15];
 }
 
-GLConsumer::EglImage::EglImage(sp<GraphicBuffer> graphicBuffer) :
+GLConsumer::EglImage::EglImage(sp<GraphicBuffer> graphicBuffer,
+        const sp<EglImageDeleter>& deleter) :
     mGraphicBuffer(graphicBuffer),
     mEglImage(EGL_NO_IMAGE_KHR),
-    mEglDisplay(EGL_NO_DISPLAY) {
+    mEglDisplay(EGL_NO_DISPLAY),
+    mDeleter(deleter) {
 }
 
 GLConsumer::EglImage::~EglImage() {
     if (mEglImage != EGL_NO_IMAGE_KHR) {
+        if (mDeleter != NULL) {
+            mDeleter->deleteImage(mEglDisplay, mEglImage);
+            return;
+        }
         if (!eglDestroyImageKHR(mEglDisplay, mEglImage)) {
            ALOGE("~EglImage: eglDestroyImageKHR failed");
         }
@@ -17,7 +17,10 @@
 
 #include <cutils/log.h>
 
+#include <binder/IPCThreadState.h>
+
 #include <ui/GraphicBuffer.h>
+#include <ui/GraphicBufferAllocator.h>
 
 #include <gui/GraphicBufferAlloc.h>
 
@@ -47,6 +50,10 @@ sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t w, uint32_t h
                 w, h, strerror(-err), graphicBuffer->handle);
         return 0;
     }
+    // account the buffer to the process it is made for: the binder caller,
+    // e.g. an app's dequeueBuffer, or ourself for a local BufferQueue
+    GraphicBufferAllocator::get().setOwner(graphicBuffer->handle,
+            IPCThreadState::self()->getCallingPid());
     return graphicBuffer;
 }
 
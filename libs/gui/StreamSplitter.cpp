@@ -273,12 +273,16 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
 }
 
 StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
+      : mBuffer(buffer), mReleaseCount(0) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
+sp<Fence> StreamSplitter::BufferTracker::getMergedFence() const {
+    return mFences.merge(String8("StreamSplitter"));
+}
+
 void StreamSplitter::BufferTracker::mergeFence(const sp<Fence>& with) {
-    mMergedFence = Fence::merge(String8("StreamSplitter"), mMergedFence, with);
+    mFences.add(with);
 }
 
 } // namespace android
@@ -24,10 +24,17 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 #include <input/InputTransport.h>
@@ -41,6 +48,9 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Maximum number of messages handed to a single sendmmsg() call.
+static const size_t SEND_BATCH_SIZE = 16;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
@@ -66,13 +76,67 @@ inline static float lerp(float a, float b, float alpha) {
 
 // --- InputMessage ---
 
+// A pointer with VERSION_COMPACT_POINTERS starts with its properties and the bits of its
+// coords, followed by one float for each bit that is set.
+static const size_t COMPACT_POINTER_HEADER_SIZE = sizeof(PointerProperties) + sizeof(uint64_t);
+
+static size_t writeCompactPointer(uint8_t* out,
+        const PointerProperties& properties, const PointerCoords& coords) {
+    size_t valuesSize = BitSet64::count(coords.bits) * sizeof(float);
+    memcpy(out, &properties, sizeof(PointerProperties));
+    memcpy(out + sizeof(PointerProperties), &coords.bits, sizeof(uint64_t));
+    memcpy(out + COMPACT_POINTER_HEADER_SIZE, coords.values, valuesSize);
+    return COMPACT_POINTER_HEADER_SIZE + valuesSize;
+}
+
+// Returns the size of a compact pointer that starts at data, or 0 if it does not fit in
+// the available bytes or has too many axes.
+static size_t getCompactPointerSize(const uint8_t* data, size_t available) {
+    if (available < COMPACT_POINTER_HEADER_SIZE) {
+        return 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, data + sizeof(PointerProperties), sizeof(uint64_t));
+    uint32_t count = BitSet64::count(bits);
+    size_t size = COMPACT_POINTER_HEADER_SIZE + count * sizeof(float);
+    return count <= PointerCoords::MAX_AXES && size <= available ? size : 0;
+}
+
+// Returns the size of the compact pointers of a motion body, or 0 if they are malformed.
+static size_t getCompactPointersSize(const InputMessage::Body::Motion& motion,
+        size_t available) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(motion.pointers);
+    size_t size = 0;
+    for (uint32_t i = 0; i < motion.pointerCount; i++) {
+        size_t pointerSize = getCompactPointerSize(data + size, available - size);
+        if (!pointerSize) {
+            return 0;
+        }
+        size += pointerSize;
+    }
+    return size;
+}
+
+static inline size_t getMotionHeaderSize() {
+    return offsetof(InputMessage::Body::Motion, pointers);
+}
+
 bool InputMessage::isValid(size_t actualSize) const {
+    if (header.type == TYPE_MOTION && header.version == VERSION_COMPACT_POINTERS) {
+        size_t headerSize = sizeof(Header) + getMotionHeaderSize();
+        return actualSize >= headerSize
+                && body.motion.pointerCount > 0
+                && body.motion.pointerCount <= MAX_POINTERS
+                && getCompactPointersSize(body.motion, actualSize - headerSize)
+                        == actualSize - headerSize;
+    }
     if (size() == actualSize) {
         switch (header.type) {
         case TYPE_KEY:
             return true;
         case TYPE_MOTION:
-            return body.motion.pointerCount > 0
+            return header.version == VERSION_FIXED_POINTERS
+                    && body.motion.pointerCount > 0
                     && body.motion.pointerCount <= MAX_POINTERS;
         case TYPE_FINISHED:
             return true;
@@ -86,6 +150,10 @@ size_t InputMessage::size() const {
     case TYPE_KEY:
         return sizeof(Header) + body.key.size();
     case TYPE_MOTION:
+        if (header.version == VERSION_COMPACT_POINTERS) {
+            return sizeof(Header) + getMotionHeaderSize()
+                    + getCompactPointersSize(body.motion, sizeof(body.motion.pointers));
+        }
         return sizeof(Header) + body.motion.size();
     case TYPE_FINISHED:
         return sizeof(Header) + body.finished.size();
@@ -93,9 +161,331 @@ size_t InputMessage::size() const {
     return sizeof(Header);
 }
 
+void InputMessage::expandPointers() {
+    if (header.type != TYPE_MOTION || header.version != VERSION_COMPACT_POINTERS) {
+        return;
+    }
+
+    // The compact pointers never start after the place their expanded form goes, so
+    // expanding them from the last one back to the first does not overwrite any that
+    // are still to be read.
+    uint8_t* data = reinterpret_cast<uint8_t*>(body.motion.pointers);
+    size_t offsets[MAX_POINTERS];
+    size_t offset = 0;
+    for (uint32_t i = 0; i < body.motion.pointerCount; i++) {
+        offsets[i] = offset;
+        offset += getCompactPointerSize(data + offset, sizeof(body.motion.pointers) - offset);
+    }
+    for (uint32_t i = body.motion.pointerCount; i-- > 0; ) {
+        uint8_t compact[COMPACT_POINTER_HEADER_SIZE + sizeof(float) * PointerCoords::MAX_AXES];
+        memcpy(compact, data + offsets[i], getCompactPointerSize(data + offsets[i],
+                sizeof(body.motion.pointers) - offsets[i]));
+
+        Body::Motion::Pointer& pointer = body.motion.pointers[i];
+        memcpy(&pointer.properties, compact, sizeof(PointerProperties));
+        memcpy(&pointer.coords.bits, compact + sizeof(PointerProperties), sizeof(uint64_t));
+        memcpy(pointer.coords.values, compact + COMPACT_POINTER_HEADER_SIZE,
+                BitSet64::count(pointer.coords.bits) * sizeof(float));
+    }
+    header.version = VERSION_FIXED_POINTERS;
+}
+
+
+// --- InputChannel::SharedMemory ---
+
+// Bytes of message data in each ring of a shared memory channel.  Like the socket buffer,
+// this holds a few dozen large motion events.  Must be a power of two.
+static const uint32_t SHARED_RING_SIZE = 32 * 1024;
+
+// Size of the header in front of each message in a ring.  Records are padded to a
+// multiple of this size so that headers stay aligned.
+static const uint32_t RING_RECORD_HEADER_SIZE = 8;
+
+// Header size marking that the rest of the ring is unused and the next record is at
+// the start of the ring.
+static const uint32_t RING_WRAP = 0xffffffff;
+
+static inline uint32_t getRingRecordSize(uint32_t messageSize) {
+    return (RING_RECORD_HEADER_SIZE + messageSize + RING_RECORD_HEADER_SIZE - 1)
+            & ~(RING_RECORD_HEADER_SIZE - 1);
+}
+
+/*
+ * One end of a shared memory channel.
+ *
+ * Each direction has a ring in its own shared memory region, with a single producer and
+ * a single consumer.  The head and tail of a ring count the bytes consumed and produced,
+ * wrapping around at 2^32, and are only written by the consumer and the producer
+ * respectively.
+ *
+ * The producer writes to the consumer's eventfd when it adds to an empty ring.  The
+ * consumer resets its eventfd before it goes back to sleep on an empty ring, and looks
+ * at the ring once more afterwards so that a message added in between isn't missed.
+ *
+ * Each end also holds one end of a socket pair that never carries data, its only use is
+ * to see the other process go away without a chance to set the closed flag of its ring.
+ * An end whose descriptors were handed out, or that was made from descriptors handed
+ * out by another process, never sets the flag: other copies of it may still be in use,
+ * and only the last of them closing the socket says that the end is gone.
+ */
+class InputChannel::SharedMemory : public RefBase {
+public:
+    struct Ring {
+        volatile int32_t head;
+        volatile int32_t tail;
+        volatile int32_t closed; // set once the producer's end has been destroyed
+        int32_t reserved;
+        uint8_t data[SHARED_RING_SIZE];
+    };
+
+    // The descriptors of one end, in the order InputChannel::getFds() returns them.
+    enum {
+        FD_SOCKET,
+        FD_IN_RING,
+        FD_OUT_RING,
+        FD_IN_EVENT,
+        FD_OUT_EVENT,
+        FD_COUNT
+    };
+
+    // Creates a ring to be shared by both ends, returning its descriptor.
+    static int createRing(const String8& name) {
+        int fd = ashmem_create_region(name.string(), sizeof(Ring));
+        return fd >= 0 ? fd : -errno;
+    }
+
+    // Maps the rings of one end, taking ownership of its descriptors, any of which may be
+    // missing when creating the channel failed part way.  Returns NULL if they don't make
+    // up an end.
+    static sp<SharedMemory> create(const int* fds, bool exported) {
+        sp<SharedMemory> memory = new SharedMemory(fds, exported);
+        if (!memory->mIn || !memory->mOut || memory->mFds[FD_SOCKET] < 0
+                || memory->mFds[FD_IN_EVENT] < 0 || memory->mFds[FD_OUT_EVENT] < 0) {
+            return NULL;
+        }
+        return memory;
+    }
+
+    void getFds(Vector<int>* outFds) {
+        android_atomic_release_store(1, &mExported);
+        outFds->appendArray(mFds, FD_COUNT);
+    }
+
+    // Creates an epoll descriptor that is readable when this end's eventfd is signalled
+    // or when the other end of the socket has been closed.
+    int createPollFd() const {
+        int pollFd = epoll_create(2);
+        if (pollFd < 0) {
+            return -errno;
+        }
+
+        struct epoll_event eventItem;
+        memset(&eventItem, 0, sizeof(eventItem));
+        eventItem.events = EPOLLIN;
+        eventItem.data.fd = mFds[FD_IN_EVENT];
+        if (epoll_ctl(pollFd, EPOLL_CTL_ADD, mFds[FD_IN_EVENT], &eventItem)) {
+            status_t result = -errno;
+            ::close(pollFd);
+            return result;
+        }
+        eventItem.data.fd = mFds[FD_SOCKET];
+        if (epoll_ctl(pollFd, EPOLL_CTL_ADD, mFds[FD_SOCKET], &eventItem)) {
+            status_t result = -errno;
+            ::close(pollFd);
+            return result;
+        }
+        return pollFd;
+    }
+
+    status_t send(const InputMessage* msg) {
+        if (isPeerClosed()) {
+            return DEAD_OBJECT;
+        }
+
+        uint32_t size = msg->size();
+        uint32_t recordSize = getRingRecordSize(size);
+        uint32_t tail = uint32_t(mOut->tail);
+        uint32_t head = uint32_t(android_atomic_acquire_load(&mOut->head));
+        uint32_t offset = tail & (SHARED_RING_SIZE - 1);
+        uint32_t contiguous = SHARED_RING_SIZE - offset;
+        uint32_t needed = recordSize <= contiguous ? recordSize : contiguous + recordSize;
+        if (SHARED_RING_SIZE - (tail - head) < needed) {
+            // An end that was handed out never sets the closed flag.
+            return isSocketClosed() ? DEAD_OBJECT : WOULD_BLOCK;
+        }
+
+        uint32_t newTail = tail;
+        if (recordSize > contiguous) {
+            memcpy(&mOut->data[offset], &RING_WRAP, sizeof(RING_WRAP));
+            newTail += contiguous;
+            offset = 0;
+        }
+        memcpy(&mOut->data[offset], &size, sizeof(size));
+        memcpy(&mOut->data[offset + RING_RECORD_HEADER_SIZE], msg, size);
+        newTail += recordSize;
+        android_atomic_release_store(int32_t(newTail), &mOut->tail);
+
+        // The consumer may have emptied the ring and gone to sleep before seeing the new
+        // tail.  The barrier orders the store of the tail before the load of the head.
+        android_memory_barrier();
+        if (uint32_t(android_atomic_acquire_load(&mOut->head)) == tail) {
+            signal(mFds[FD_OUT_EVENT]);
+        }
+        return OK;
+    }
+
+    status_t receive(InputMessage* msg, size_t* outSize) {
+        status_t status = pop(msg, outSize);
+        if (status != WOULD_BLOCK) {
+            return status;
+        }
+
+        // The ring is empty.  Reset the eventfd, then look again for a message that
+        // came in before the reset and whose signal it cleared.
+        uint64_t count;
+        ssize_t nRead;
+        do {
+            nRead = ::read(mFds[FD_IN_EVENT], &count, sizeof(count));
+        } while (nRead == -1 && errno == EINTR);
+
+        status = pop(msg, outSize);
+        if (status == WOULD_BLOCK) {
+            return isPeerClosed() || isSocketClosed() ? DEAD_OBJECT : WOULD_BLOCK;
+        }
+        if (status == OK && !isEmpty()) {
+            // Keep the channel readable for the messages still waiting.
+            signal(mFds[FD_IN_EVENT]);
+        }
+        return status;
+    }
+
+protected:
+    virtual ~SharedMemory() {
+        if (mOut && !android_atomic_acquire_load(&mExported)) {
+            android_atomic_release_store(1, &mOut->closed);
+            signal(mFds[FD_OUT_EVENT]);
+        }
+        if (mIn) {
+            munmap(mIn, sizeof(Ring));
+        }
+        if (mOut) {
+            munmap(mOut, sizeof(Ring));
+        }
+        for (size_t i = 0; i < FD_COUNT; i++) {
+            closeFd(mFds[i]);
+        }
+    }
+
+private:
+    int mFds[FD_COUNT];
+    Ring* mIn;
+    Ring* mOut;
+    volatile int32_t mExported;
+
+    SharedMemory(const int* fds, bool exported) :
+            mIn(mapRing(fds[FD_IN_RING])), mOut(mapRing(fds[FD_OUT_RING])),
+            mExported(exported) {
+        memcpy(mFds, fds, sizeof(mFds));
+    }
+
+    // The descriptor may come from another process, so the region is checked to be
+    // large enough before it is touched.
+    static Ring* mapRing(int fd) {
+        if (fd < 0 || ashmem_get_size_region(fd) < int(sizeof(Ring))) {
+            return NULL;
+        }
+        void* base = mmap(NULL, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        return base != MAP_FAILED ? static_cast<Ring*>(base) : NULL;
+    }
+
+    static void closeFd(int fd) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    static void signal(int eventFd) {
+        if (eventFd < 0) {
+            return;
+        }
+        uint64_t count = 1;
+        ssize_t nWrite;
+        do {
+            nWrite = ::write(eventFd, &count, sizeof(count));
+        } while (nWrite == -1 && errno == EINTR);
+    }
+
+    bool isPeerClosed() const {
+        return android_atomic_acquire_load(&mIn->closed) != 0;
+    }
+
+    bool isSocketClosed() const {
+        char buffer;
+        ssize_t nRead;
+        do {
+            nRead = ::recv(mFds[FD_SOCKET], &buffer, sizeof(buffer), MSG_DONTWAIT | MSG_PEEK);
+        } while (nRead == -1 && errno == EINTR);
+        return nRead == 0 || (nRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+
+    bool isEmpty() const {
+        return android_atomic_acquire_load(&mIn->tail) == mIn->head;
+    }
+
+    // The other process may write anything into the ring, so everything read from it
+    // is checked before use.
+    status_t pop(InputMessage* msg, size_t* outSize) {
+        uint32_t head = uint32_t(mIn->head);
+        uint32_t tail = uint32_t(android_atomic_acquire_load(&mIn->tail));
+        if (head == tail) {
+            return WOULD_BLOCK;
+        }
+
+        // Records start on header boundaries, so an aligned head always leaves room for
+        // a whole header before the end of the ring.
+        uint32_t offset = head & (SHARED_RING_SIZE - 1);
+        if (tail - head > SHARED_RING_SIZE || (offset & (RING_RECORD_HEADER_SIZE - 1))
+                || offset + RING_RECORD_HEADER_SIZE > SHARED_RING_SIZE) {
+            return BAD_VALUE;
+        }
+        uint32_t size;
+        memcpy(&size, &mIn->data[offset], sizeof(size));
+        if (size == RING_WRAP) {
+            head += SHARED_RING_SIZE - offset;
+            offset = 0;
+            if (head == tail) {
+                return BAD_VALUE;
+            }
+            memcpy(&size, &mIn->data[offset], sizeof(size));
+        }
+
+        if (size > sizeof(InputMessage)) {
+            return BAD_VALUE;
+        }
+        uint32_t recordSize = getRingRecordSize(size);
+        if (tail - head < recordSize || offset + recordSize > SHARED_RING_SIZE) {
+            return BAD_VALUE;
+        }
+        memcpy(msg, &mIn->data[offset + RING_RECORD_HEADER_SIZE], size);
+        android_atomic_release_store(int32_t(head + recordSize), &mIn->head);
+        *outSize = size;
+        return OK;
+    }
+};
+
 
 // --- InputChannel ---
 
+static status_t sendErrorToStatus(int error) {
+    if (error == EAGAIN || error == EWOULDBLOCK) {
+        return WOULD_BLOCK;
+    }
+    if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED || error == ECONNRESET) {
+        return DEAD_OBJECT;
+    }
+    return -error;
+}
+
 InputChannel::InputChannel(const String8& name, int fd) :
         mName(name), mFd(fd) {
 #if DEBUG_CHANNEL_LIFECYCLE
@@ -118,7 +508,12 @@ InputChannel::~InputChannel() {
 }
 
 status_t InputChannel::openInputChannelPair(const String8& name,
-        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
+        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel,
+        Transport transport) {
+    if (transport == TRANSPORT_SHARED_MEMORY) {
+        return openSharedMemoryChannelPair(name, outServerChannel, outClientChannel);
+    }
+
     int sockets[2];
     if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets)) {
         status_t result = -errno;
@@ -145,7 +540,118 @@ status_t InputChannel::openInputChannelPair(const String8& name,
     return OK;
 }
 
+status_t InputChannel::openSharedMemoryChannelPair(const String8& name,
+        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
+    outServerChannel.clear();
+    outClientChannel.clear();
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets)) {
+        status_t result = -errno;
+        ALOGE("channel '%s' ~ Could not create socket pair.  errno=%d",
+                name.string(), errno);
+        return result;
+    }
+    int serverEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int clientEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int serverRingFd = SharedMemory::createRing(name);
+    int clientRingFd = SharedMemory::createRing(name);
+
+    // Each end owns its own copy of every descriptor it uses.
+    int serverFds[SharedMemory::FD_COUNT];
+    serverFds[SharedMemory::FD_SOCKET] = sockets[0];
+    serverFds[SharedMemory::FD_IN_RING] = clientRingFd;
+    serverFds[SharedMemory::FD_OUT_RING] = serverRingFd;
+    serverFds[SharedMemory::FD_IN_EVENT] = serverEventFd;
+    serverFds[SharedMemory::FD_OUT_EVENT] = clientEventFd >= 0 ? ::dup(clientEventFd) : -1;
+
+    int clientFds[SharedMemory::FD_COUNT];
+    clientFds[SharedMemory::FD_SOCKET] = sockets[1];
+    clientFds[SharedMemory::FD_IN_RING] = serverRingFd >= 0 ? ::dup(serverRingFd) : -1;
+    clientFds[SharedMemory::FD_OUT_RING] = clientRingFd >= 0 ? ::dup(clientRingFd) : -1;
+    clientFds[SharedMemory::FD_IN_EVENT] = clientEventFd;
+    clientFds[SharedMemory::FD_OUT_EVENT] = serverEventFd >= 0 ? ::dup(serverEventFd) : -1;
+
+    String8 serverChannelName = name;
+    serverChannelName.append(" (server)");
+    status_t result = openSharedMemoryChannel(serverChannelName, serverFds, false,
+            outServerChannel);
+
+    String8 clientChannelName = name;
+    clientChannelName.append(" (client)");
+    status_t clientResult = openSharedMemoryChannel(clientChannelName, clientFds, false,
+            outClientChannel);
+
+    if (result || clientResult) {
+        outServerChannel.clear();
+        outClientChannel.clear();
+        return result ? result : clientResult;
+    }
+    return OK;
+}
+
+status_t InputChannel::openSharedMemoryChannel(const String8& name, const int* fds,
+        bool exported, sp<InputChannel>& outChannel) {
+    // From here on the end owns the descriptors and releases them on failure.
+    sp<SharedMemory> memory = SharedMemory::create(fds, exported);
+    if (memory == NULL) {
+        ALOGE("channel '%s' ~ Could not create shared memory channel.  errno=%d",
+                name.string(), errno);
+        return NO_MEMORY;
+    }
+
+    int pollFd = memory->createPollFd();
+    if (pollFd < 0) {
+        ALOGE("channel '%s' ~ Could not create poll descriptor.  status=%d",
+                name.string(), pollFd);
+        return pollFd;
+    }
+
+    outChannel = new InputChannel(name, pollFd);
+    outChannel->mSharedMemory = memory;
+    return OK;
+}
+
+sp<InputChannel> InputChannel::createFromFds(const String8& name, const Vector<int>& fds) {
+    if (fds.size() == 1 && fds[0] >= 0) {
+        return new InputChannel(name, fds[0]);
+    }
+    if (fds.size() == SharedMemory::FD_COUNT) {
+        sp<InputChannel> channel;
+        openSharedMemoryChannel(name, fds.array(), true, channel);
+        return channel;
+    }
+
+    ALOGE("channel '%s' ~ Cannot make a channel out of %zu file descriptors.",
+            name.string(), fds.size());
+    for (size_t i = 0; i < fds.size(); i++) {
+        if (fds[i] >= 0) {
+            ::close(fds[i]);
+        }
+    }
+    return NULL;
+}
+
+Vector<int> InputChannel::getFds() const {
+    Vector<int> fds;
+    if (mSharedMemory != NULL) {
+        mSharedMemory->getFds(&fds);
+    } else {
+        fds.push(mFd);
+    }
+    return fds;
+}
+
 status_t InputChannel::sendMessage(const InputMessage* msg) {
+    if (mSharedMemory != NULL) {
+        status_t status = mSharedMemory->send(msg);
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ sent message of type %d to shared memory, status=%d",
+                mName.string(), msg->header.type, status);
+#endif
+        return status;
+    }
+
     size_t msgLength = msg->size();
     ssize_t nWrite;
     do {
@@ -158,13 +664,7 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
         ALOGD("channel '%s' ~ error sending message of type %d, errno=%d", mName.string(),
                 msg->header.type, error);
 #endif
-        if (error == EAGAIN || error == EWOULDBLOCK) {
-            return WOULD_BLOCK;
-        }
-        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED || error == ECONNRESET) {
-            return DEAD_OBJECT;
-        }
-        return -error;
+        return sendErrorToStatus(error);
     }
 
     if (size_t(nWrite) != msgLength) {
@@ -181,11 +681,103 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count, size_t* outSent) {
+    if (count == 1) {
+        status_t status = sendMessage(msgs);
+        *outSent = status ? 0 : 1;
+        return status;
+    }
+    if (mSharedMemory != NULL) {
+        // Messages cost no system call each in shared memory, nothing to gain from batching.
+        status_t status = OK;
+        size_t sent = 0;
+        while (sent < count && !(status = sendMessage(&msgs[sent]))) {
+            sent += 1;
+        }
+        *outSent = sent;
+        return status;
+    }
+
+    struct iovec iovs[SEND_BATCH_SIZE];
+    struct mmsghdr headers[SEND_BATCH_SIZE];
+    memset(headers, 0, sizeof(headers));
+
+    size_t sent = 0;
+    while (sent < count) {
+        size_t batchSize = min(count - sent, SEND_BATCH_SIZE);
+        for (size_t i = 0; i < batchSize; i++) {
+            const InputMessage* msg = &msgs[sent + i];
+            iovs[i].iov_base = const_cast<InputMessage*>(msg);
+            iovs[i].iov_len = msg->size();
+            headers[i].msg_hdr.msg_iov = &iovs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // A SOCK_SEQPACKET socket keeps each message in its own packet.  If the socket
+        // fills up part way through, the call returns the number of messages sent so far
+        // and the next call reports the error.
+        int nSent;
+        do {
+            nSent = ::sendmmsg(mFd, headers, batchSize, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            int error = errno;
+            if (error == ENOSYS) {
+                // No sendmmsg() in this kernel, send the messages one at a time.
+                status_t status = OK;
+                while (sent < count && !(status = sendMessage(&msgs[sent]))) {
+                    sent += 1;
+                }
+                *outSent = sent;
+                return status;
+            }
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ error sending message of type %d, errno=%d", mName.string(),
+                    msgs[sent].header.type, error);
+#endif
+            *outSent = sent;
+            return sendErrorToStatus(error);
+        }
+
+        for (int i = 0; i < nSent; i++) {
+            if (headers[i].msg_len != iovs[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.string(), msgs[sent + i].header.type);
+#endif
+                *outSent = sent + i;
+                return DEAD_OBJECT;
+            }
+        }
+        sent += nSent;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ sent %zu messages", mName.string(), sent);
+#endif
+    *outSent = sent;
+    return OK;
+}
+
 status_t InputChannel::receiveMessage(InputMessage* msg) {
     ssize_t nRead;
-    do {
-        nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
-    } while (nRead == -1 && errno == EINTR);
+    if (mSharedMemory != NULL) {
+        size_t size;
+        status_t status = mSharedMemory->receive(msg, &size);
+        if (status) {
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ receive message from shared memory failed, status=%d",
+                    mName.string(), status);
+#endif
+            return status;
+        }
+        nRead = size;
+    } else {
+        do {
+            nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
+        } while (nRead == -1 && errno == EINTR);
+    }
 
     if (nRead < 0) {
         int error = errno;
@@ -214,6 +806,7 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 #endif
         return BAD_VALUE;
     }
+    msg->expandPointers();
 
 #if DEBUG_CHANNEL_MESSAGES
     ALOGD("channel '%s' ~ received message of type %d", mName.string(), msg->header.type);
@@ -223,20 +816,41 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
-    return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    sp<InputChannel> channel = new InputChannel(getName(), fd);
+    channel->mSharedMemory = mSharedMemory;
+    return channel;
 }
 
 
 // --- InputPublisher ---
 
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mCompactPointers(isCompactPointersEnabled()),
+        mConsumerDecodesCompactPointers(false) {
 }
 
 InputPublisher::~InputPublisher() {
 }
 
-status_t InputPublisher::publishKeyEvent(
+bool InputPublisher::isCompactPointersEnabled() {
+    char value[PROPERTY_VALUE_MAX];
+    int length = property_get("ro.input.nocompactmotion", value, NULL);
+    if (length > 0) {
+        if (!strcmp("1", value)) {
+            return false;
+        }
+        if (strcmp("0", value)) {
+            ALOGD("Unrecognized property value for 'ro.input.nocompactmotion'.  "
+                    "Use '1' or '0'.");
+        }
+    }
+    return true;
+}
+
+status_t InputPublisher::buildKeyMessage(InputMessage* outMsg,
         uint32_t seq,
         int32_t deviceId,
         int32_t source,
@@ -247,9 +861,9 @@ status_t InputPublisher::publishKeyEvent(
         int32_t metaState,
         int32_t repeatCount,
         nsecs_t downTime,
-        nsecs_t eventTime) {
+        nsecs_t eventTime) const {
 #if DEBUG_TRANSPORT_ACTIONS
-    ALOGD("channel '%s' publisher ~ publishKeyEvent: seq=%u, deviceId=%d, source=0x%x, "
+    ALOGD("channel '%s' publisher ~ buildKeyMessage: seq=%u, deviceId=%d, source=0x%x, "
             "action=0x%x, flags=0x%x, keyCode=%d, scanCode=%d, metaState=0x%x, repeatCount=%d,"
             "downTime=%lld, eventTime=%lld",
             mChannel->getName().string(), seq,
@@ -262,23 +876,23 @@ status_t InputPublisher::publishKeyEvent(
         return BAD_VALUE;
     }
 
-    InputMessage msg;
-    msg.header.type = InputMessage::TYPE_KEY;
-    msg.body.key.seq = seq;
-    msg.body.key.deviceId = deviceId;
-    msg.body.key.source = source;
-    msg.body.key.action = action;
-    msg.body.key.flags = flags;
-    msg.body.key.keyCode = keyCode;
-    msg.body.key.scanCode = scanCode;
-    msg.body.key.metaState = metaState;
-    msg.body.key.repeatCount = repeatCount;
-    msg.body.key.downTime = downTime;
-    msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    outMsg->header.type = InputMessage::TYPE_KEY;
+    outMsg->header.version = InputMessage::VERSION_FIXED_POINTERS;
+    outMsg->body.key.seq = seq;
+    outMsg->body.key.deviceId = deviceId;
+    outMsg->body.key.source = source;
+    outMsg->body.key.action = action;
+    outMsg->body.key.flags = flags;
+    outMsg->body.key.keyCode = keyCode;
+    outMsg->body.key.scanCode = scanCode;
+    outMsg->body.key.metaState = metaState;
+    outMsg->body.key.repeatCount = repeatCount;
+    outMsg->body.key.downTime = downTime;
+    outMsg->body.key.eventTime = eventTime;
+    return OK;
 }
 
-status_t InputPublisher::publishMotionEvent(
+status_t InputPublisher::buildMotionMessage(InputMessage* outMsg,
         uint32_t seq,
         int32_t deviceId,
         int32_t source,
@@ -295,9 +909,9 @@ status_t InputPublisher::publishMotionEvent(
         nsecs_t eventTime,
         uint32_t pointerCount,
         const PointerProperties* pointerProperties,
-        const PointerCoords* pointerCoords) {
+        const PointerCoords* pointerCoords) const {
 #if DEBUG_TRANSPORT_ACTIONS
-    ALOGD("channel '%s' publisher ~ publishMotionEvent: seq=%u, deviceId=%d, source=0x%x, "
+    ALOGD("channel '%s' publisher ~ buildMotionMessage: seq=%u, deviceId=%d, source=0x%x, "
             "action=0x%x, flags=0x%x, edgeFlags=0x%x, metaState=0x%x, buttonState=0x%x, "
             "xOffset=%f, yOffset=%f, "
             "xPrecision=%f, yPrecision=%f, downTime=%lld, eventTime=%lld, "
@@ -318,30 +932,98 @@ status_t InputPublisher::publishMotionEvent(
         return BAD_VALUE;
     }
 
+    const bool compact = isPublishingCompactPointers();
+    outMsg->header.type = InputMessage::TYPE_MOTION;
+    outMsg->header.version = compact
+            ? InputMessage::VERSION_COMPACT_POINTERS : InputMessage::VERSION_FIXED_POINTERS;
+    outMsg->body.motion.seq = seq;
+    outMsg->body.motion.deviceId = deviceId;
+    outMsg->body.motion.source = source;
+    outMsg->body.motion.action = action;
+    outMsg->body.motion.flags = flags;
+    outMsg->body.motion.edgeFlags = edgeFlags;
+    outMsg->body.motion.metaState = metaState;
+    outMsg->body.motion.buttonState = buttonState;
+    outMsg->body.motion.xOffset = xOffset;
+    outMsg->body.motion.yOffset = yOffset;
+    outMsg->body.motion.xPrecision = xPrecision;
+    outMsg->body.motion.yPrecision = yPrecision;
+    outMsg->body.motion.downTime = downTime;
+    outMsg->body.motion.eventTime = eventTime;
+    outMsg->body.motion.pointerCount = pointerCount;
+    if (compact) {
+        uint8_t* out = reinterpret_cast<uint8_t*>(outMsg->body.motion.pointers);
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            out += writeCompactPointer(out, pointerProperties[i], pointerCoords[i]);
+        }
+    } else {
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            outMsg->body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
+            outMsg->body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
+        }
+    }
+    return OK;
+}
+
+status_t InputPublisher::publishKeyEvent(
+        uint32_t seq,
+        int32_t deviceId,
+        int32_t source,
+        int32_t action,
+        int32_t flags,
+        int32_t keyCode,
+        int32_t scanCode,
+        int32_t metaState,
+        int32_t repeatCount,
+        nsecs_t downTime,
+        nsecs_t eventTime) {
+    InputMessage msg;
+    status_t status = buildKeyMessage(&msg, seq, deviceId, source, action, flags,
+            keyCode, scanCode, metaState, repeatCount, downTime, eventTime);
+    if (status) {
+        return status;
+    }
+    return mChannel->sendMessage(&msg);
+}
+
+status_t InputPublisher::publishMotionEvent(
+        uint32_t seq,
+        int32_t deviceId,
+        int32_t source,
+        int32_t action,
+        int32_t flags,
+        int32_t edgeFlags,
+        int32_t metaState,
+        int32_t buttonState,
+        float xOffset,
+        float yOffset,
+        float xPrecision,
+        float yPrecision,
+        nsecs_t downTime,
+        nsecs_t eventTime,
+        uint32_t pointerCount,
+        const PointerProperties* pointerProperties,
+        const PointerCoords* pointerCoords) {
     InputMessage msg;
-    msg.header.type = InputMessage::TYPE_MOTION;
-    msg.body.motion.seq = seq;
-    msg.body.motion.deviceId = deviceId;
-    msg.body.motion.source = source;
-    msg.body.motion.action = action;
-    msg.body.motion.flags = flags;
-    msg.body.motion.edgeFlags = edgeFlags;
-    msg.body.motion.metaState = metaState;
-    msg.body.motion.buttonState = buttonState;
-    msg.body.motion.xOffset = xOffset;
-    msg.body.motion.yOffset = yOffset;
-    msg.body.motion.xPrecision = xPrecision;
-    msg.body.motion.yPrecision = yPrecision;
-    msg.body.motion.downTime = downTime;
-    msg.body.motion.eventTime = eventTime;
-    msg.body.motion.pointerCount = pointerCount;
-    for (uint32_t i = 0; i < pointerCount; i++) {
-        msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
-        msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
+    status_t status = buildMotionMessage(&msg, seq, deviceId, source, action, flags,
+            edgeFlags, metaState, buttonState, xOffset, yOffset, xPrecision, yPrecision,
+            downTime, eventTime, pointerCount, pointerProperties, pointerCoords);
+    if (status) {
+        return status;
     }
     return mChannel->sendMessage(&msg);
 }
 
+status_t InputPublisher::publishMessages(const InputMessage* msgs, size_t count,
+        size_t* outPublished) {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ publishMessages: count=%zu",
+            mChannel->getName().string(), count);
+#endif
+
+    return mChannel->sendMessages(msgs, count, outPublished);
+}
+
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
 #if DEBUG_TRANSPORT_ACTIONS
     ALOGD("channel '%s' publisher ~ receiveFinishedSignal",
@@ -360,6 +1042,14 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
                 mChannel->getName().string(), msg.header.type);
         return UNKNOWN_ERROR;
     }
+    if (msg.header.version == InputMessage::VERSION_FINISHED_DECODES_COMPACT_POINTERS
+            && !mConsumerDecodesCompactPointers) {
+#if DEBUG_TRANSPORT_ACTIONS
+        ALOGD("channel '%s' publisher ~ consumer decodes compact pointers",
+                mChannel->getName().string());
+#endif
+        mConsumerDecodesCompactPointers = true;
+    }
     *outSeq = msg.body.finished.seq;
     *outHandled = msg.body.finished.handled;
     return OK;
@@ -846,6 +1536,7 @@ status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
 status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled) {
     InputMessage msg;
     msg.header.type = InputMessage::TYPE_FINISHED;
+    msg.header.version = InputMessage::VERSION_FINISHED_DECODES_COMPACT_POINTERS;
     msg.body.finished.seq = seq;
     msg.body.finished.handled = handled;
     return mChannel->sendMessage(&msg);
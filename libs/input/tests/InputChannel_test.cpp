@@ -19,6 +19,11 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include <gtest/gtest.h>
 #include <input/InputTransport.h>
@@ -155,5 +160,435 @@ TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
             << "sendMessage should have returned DEAD_OBJECT";
 }
 
+TEST_F(InputChannelTest, SendMessages_SendsEachMessageSeparatelyInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    // more than one sendmmsg() batch, of mixed sizes, that fit in the socket buffer
+    const size_t count = 40;
+    InputMessage msgs[count];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < count; i++) {
+        if (i % 3) {
+            msgs[i].header.type = InputMessage::TYPE_MOTION;
+            msgs[i].body.motion.seq = i + 1;
+            msgs[i].body.motion.pointerCount = 1 + i % 3;
+        } else {
+            msgs[i].header.type = InputMessage::TYPE_KEY;
+            msgs[i].body.key.seq = i + 1;
+        }
+    }
+
+    size_t sent = 0;
+    EXPECT_EQ(OK, serverChannel->sendMessages(msgs, count, &sent))
+            << "server channel should be able to send messages to client channel";
+    EXPECT_EQ(count, sent);
+
+    for (size_t i = 0; i < count; i++) {
+        InputMessage clientMsg;
+        ASSERT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+                << "client channel should receive each message on its own, message " << i;
+        EXPECT_EQ(msgs[i].header.type, clientMsg.header.type);
+        EXPECT_EQ(i + 1, clientMsg.header.type == InputMessage::TYPE_KEY
+                ? clientMsg.body.key.seq : clientMsg.body.motion.seq);
+    }
+
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg))
+            << "client channel should have received exactly the messages that were sent";
+}
+
+TEST_F(InputChannelTest, SendMessages_WhenChannelFills_ReportsHowManyWereSent) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage msgs[16];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < 16; i++) {
+        msgs[i].header.type = InputMessage::TYPE_MOTION;
+        msgs[i].body.motion.pointerCount = MAX_POINTERS;
+    }
+
+    size_t total = 0;
+    size_t sent;
+    status_t status;
+    while ((status = serverChannel->sendMessages(msgs, 16, &sent)) == OK) {
+        total += sent;
+        ASSERT_LT(total, 100000U) << "channel never filled up";
+    }
+    total += sent;
+    EXPECT_EQ(WOULD_BLOCK, status)
+            << "sendMessages should have returned WOULD_BLOCK";
+    EXPECT_LT(sent, 16U);
+
+    size_t received = 0;
+    InputMessage msg;
+    while (clientChannel->receiveMessage(&msg) == OK) {
+        received += 1;
+    }
+    EXPECT_EQ(total, received)
+            << "every message counted as sent should have been received";
+}
+
+TEST_F(InputChannelTest, SendMessages_WhenPeerClosed_ReturnsAnError) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    serverChannel.clear(); // close server channel
+
+    InputMessage msgs[2];
+    memset(msgs, 0, sizeof(msgs));
+    msgs[0].header.type = InputMessage::TYPE_KEY;
+    msgs[1].header.type = InputMessage::TYPE_KEY;
+    size_t sent = 1;
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->sendMessages(msgs, 2, &sent))
+            << "sendMessages should have returned DEAD_OBJECT";
+    EXPECT_EQ(0U, sent);
+}
+
+
+static bool isReadable(const sp<InputChannel>& channel, int timeoutMillis) {
+    struct pollfd pfd;
+    pfd.fd = channel->getFd();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeoutMillis) == 1 && (pfd.revents & POLLIN);
+}
+
+TEST_F(InputChannelTest, OpenSharedMemoryChannelPair_ReturnsAPairOfConnectedChannels) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel, InputChannel::TRANSPORT_SHARED_MEMORY);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+    EXPECT_EQ(InputChannel::TRANSPORT_SHARED_MEMORY, serverChannel->getTransport());
+    EXPECT_EQ(InputChannel::TRANSPORT_SHARED_MEMORY, clientChannel->getTransport());
+    EXPECT_FALSE(isReadable(clientChannel, 0))
+            << "client channel should not be readable before anything is sent";
+
+    // Server->Client communication
+    InputMessage serverMsg;
+    memset(&serverMsg, 0, sizeof(InputMessage));
+    serverMsg.header.type = InputMessage::TYPE_KEY;
+    serverMsg.body.key.seq = 1;
+    serverMsg.body.key.action = AKEY_EVENT_ACTION_DOWN;
+    EXPECT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+            << "server channel should be able to send message to client channel";
+    EXPECT_TRUE(isReadable(clientChannel, 0))
+            << "client channel should be readable once a message was sent";
+
+    InputMessage clientMsg;
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to receive message from server channel";
+    EXPECT_EQ(serverMsg.header.type, clientMsg.header.type)
+            << "client channel should receive the correct message from server channel";
+    EXPECT_EQ(serverMsg.body.key.action, clientMsg.body.key.action)
+            << "client channel should receive the correct message from server channel";
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&clientMsg))
+            << "receiveMessage should have returned WOULD_BLOCK";
+    EXPECT_FALSE(isReadable(clientChannel, 0))
+            << "client channel should not be readable once it has been drained";
+
+    // Client->Server communication
+    InputMessage clientReply;
+    memset(&clientReply, 0, sizeof(InputMessage));
+    clientReply.header.type = InputMessage::TYPE_FINISHED;
+    clientReply.body.finished.seq = 0x11223344;
+    clientReply.body.finished.handled = true;
+    EXPECT_EQ(OK, clientChannel->sendMessage(&clientReply))
+            << "client channel should be able to send message to server channel";
+
+    InputMessage serverReply;
+    EXPECT_EQ(OK, serverChannel->receiveMessage(&serverReply))
+            << "server channel should be able to receive message from client channel";
+    EXPECT_EQ(clientReply.header.type, serverReply.header.type)
+            << "server channel should receive the correct message from client channel";
+    EXPECT_EQ(clientReply.body.finished.seq, serverReply.body.finished.seq)
+            << "server channel should receive the correct message from client channel";
+    EXPECT_EQ(clientReply.body.finished.handled, serverReply.body.finished.handled)
+            << "server channel should receive the correct message from client channel";
+}
+
+TEST_F(InputChannelTest, SharedMemory_WhenChannelFills_KeepsMessagesInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel, InputChannel::TRANSPORT_SHARED_MEMORY);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    // Fill and drain the ring a few times with messages of mixed sizes, so that they
+    // wrap around the end of the ring at different places.
+    uint32_t nextSentSeq = 1;
+    uint32_t nextReceivedSeq = 1;
+    for (int round = 0; round < 5; round++) {
+        size_t sent = 0;
+        InputMessage msg;
+        for (;;) {
+            memset(&msg, 0, sizeof(msg));
+            msg.header.type = InputMessage::TYPE_MOTION;
+            msg.body.motion.seq = nextSentSeq;
+            msg.body.motion.pointerCount = 1 + nextSentSeq % MAX_POINTERS;
+            status_t status = serverChannel->sendMessage(&msg);
+            if (status) {
+                EXPECT_EQ(WOULD_BLOCK, status)
+                        << "sendMessage should have returned WOULD_BLOCK";
+                break;
+            }
+            nextSentSeq += 1;
+            sent += 1;
+            ASSERT_LT(sent, 100000U) << "channel never filled up";
+        }
+        EXPECT_GT(sent, 10U) << "channel should hold a few dozen motion events";
+
+        EXPECT_TRUE(isReadable(clientChannel, 0));
+        while ((result = clientChannel->receiveMessage(&msg)) == OK) {
+            ASSERT_EQ(nextReceivedSeq, msg.body.motion.seq)
+                    << "messages should be received in the order they were sent";
+            EXPECT_EQ(1 + nextReceivedSeq % MAX_POINTERS, msg.body.motion.pointerCount);
+            nextReceivedSeq += 1;
+        }
+        EXPECT_EQ(WOULD_BLOCK, result);
+        EXPECT_EQ(nextSentSeq, nextReceivedSeq)
+                << "every message sent should have been received";
+    }
+}
+
+TEST_F(InputChannelTest, SharedMemory_WhenPeerClosed_ReturnsAnError) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel, InputChannel::TRANSPORT_SHARED_MEMORY);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type = InputMessage::TYPE_KEY;
+    msg.body.key.seq = 1;
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+
+    serverChannel.clear(); // close server channel
+
+    EXPECT_TRUE(isReadable(clientChannel, 0))
+            << "client channel should be readable when the peer was closed";
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&msg))
+            << "messages sent before the peer was closed should still be received";
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessage(&msg))
+            << "receiveMessage should have returned DEAD_OBJECT";
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->sendMessage(&msg))
+            << "sendMessage should have returned DEAD_OBJECT";
+}
+
+// Hands copies of the client end's file descriptors to a child process, as a Parcel
+// would, and drops the client end in this process.
+TEST_F(InputChannelTest, SharedMemory_CreateFromFds_WorksInAnotherProcess) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel, InputChannel::TRANSPORT_SHARED_MEMORY);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    Vector<int> fds = clientChannel->getFds();
+    ASSERT_EQ(5U, fds.size())
+            << "a shared memory channel end should be made of five file descriptors";
+    Vector<int> parcelledFds;
+    for (size_t i = 0; i < fds.size(); i++) {
+        parcelledFds.push(::dup(fds[i]));
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        sp<InputChannel> channel = InputChannel::createFromFds(String8("channel name"),
+                parcelledFds);
+        if (channel == NULL || channel->getTransport() != InputChannel::TRANSPORT_SHARED_MEMORY) {
+            _exit(1);
+        }
+        InputMessage msg;
+        status_t status;
+        while ((status = channel->receiveMessage(&msg)) == WOULD_BLOCK) {
+            isReadable(channel, -1);
+        }
+        if (status || msg.body.key.seq != 1) {
+            _exit(2);
+        }
+        msg.header.type = InputMessage::TYPE_FINISHED;
+        msg.body.finished.seq = 1;
+        msg.body.finished.handled = true;
+        _exit(channel->sendMessage(&msg) == OK ? 0 : 3);
+    }
+    ASSERT_GT(pid, 0);
+    for (size_t i = 0; i < parcelledFds.size(); i++) {
+        ::close(parcelledFds[i]);
+    }
+    clientChannel.clear(); // only the child's copy is left
+
+    InputMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type = InputMessage::TYPE_KEY;
+    msg.body.key.seq = 1;
+    EXPECT_EQ(OK, serverChannel->sendMessage(&msg))
+            << "dropping the original client end should not close the channel";
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status))
+            << "the child should have received the message and replied";
+
+    EXPECT_EQ(OK, serverChannel->receiveMessage(&msg))
+            << "server channel should receive the reply sent from the other process";
+    EXPECT_EQ(uint32_t(InputMessage::TYPE_FINISHED), msg.header.type);
+    EXPECT_EQ(DEAD_OBJECT, serverChannel->receiveMessage(&msg))
+            << "receiveMessage should have returned DEAD_OBJECT once the last copy was closed";
+}
+
+TEST_F(InputChannelTest, CreateFromFds_WhenTheFdsAreNotAChannel_ReturnsNull) {
+    Vector<int> fds;
+    EXPECT_TRUE(InputChannel::createFromFds(String8("channel name"), fds) == NULL);
+
+    int pipeFds[2];
+    ASSERT_EQ(0, pipe(pipeFds));
+    fds.push(pipeFds[0]);
+    fds.push(pipeFds[1]);
+    EXPECT_TRUE(InputChannel::createFromFds(String8("channel name"), fds) == NULL);
+    EXPECT_EQ(-1, fcntl(pipeFds[0], F_GETFD))
+            << "createFromFds should have closed the file descriptors";
+
+    // a pipe in place of the rings
+    ASSERT_EQ(0, pipe(pipeFds));
+    fds.clear();
+    for (int i = 0; i < 5; i++) {
+        fds.push(::dup(pipeFds[i % 2]));
+    }
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+    EXPECT_TRUE(InputChannel::createFromFds(String8("channel name"), fds) == NULL);
+}
+
+// The other process can write anything into the rings, including their head and tail,
+// which lead the ring: two int32_t values at the start of the region.
+TEST_F(InputChannelTest, SharedMemory_WhenTheHeadIsCorrupt_ReturnsAnError) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel, InputChannel::TRANSPORT_SHARED_MEMORY);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    Vector<int> fds = clientChannel->getFds();
+    ASSERT_EQ(5U, fds.size());
+    void* base = mmap(NULL, 2 * sizeof(int32_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+            fds[1], 0);
+    ASSERT_NE(MAP_FAILED, base);
+    volatile int32_t* ring = static_cast<volatile int32_t*>(base);
+
+    // a head two bytes short of the end of the 32K ring, with a record apparently behind it
+    ring[0] = 32 * 1024 - 2;
+    ring[1] = ring[0] + 16;
+    InputMessage msg;
+    EXPECT_EQ(BAD_VALUE, clientChannel->receiveMessage(&msg))
+            << "a head that isn't on a record boundary should be rejected";
+
+    // a tail further ahead of the head than the ring holds
+    ring[0] = 0;
+    ring[1] = 64 * 1024;
+    EXPECT_EQ(BAD_VALUE, clientChannel->receiveMessage(&msg))
+            << "a tail more than a ring ahead of the head should be rejected";
+
+    munmap(base, 2 * sizeof(int32_t));
+}
+
+// Sends back a finished signal for every message it receives.
+class EchoThread : public Thread {
+    sp<InputChannel> mChannel;
+
+public:
+    EchoThread(const sp<InputChannel>& channel) : mChannel(channel) { }
+
+protected:
+    virtual bool threadLoop() {
+        InputMessage msg;
+        status_t status;
+        while ((status = mChannel->receiveMessage(&msg)) == WOULD_BLOCK) {
+            isReadable(mChannel, -1);
+        }
+        if (status) {
+            return false;
+        }
+        msg.header.type = InputMessage::TYPE_FINISHED;
+        msg.header.version = InputMessage::VERSION_FIXED_POINTERS;
+        msg.body.finished.handled = true;
+        return mChannel->sendMessage(&msg) == OK;
+    }
+};
+
+static nsecs_t measureRoundTrip(InputChannel::Transport transport, size_t iterations) {
+    sp<InputChannel> serverChannel, clientChannel;
+    if (InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel, transport)) {
+        return -1;
+    }
+
+    sp<EchoThread> thread = new EchoThread(clientChannel);
+    clientChannel.clear();
+    thread->run("EchoThread");
+
+    InputMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.header.type = InputMessage::TYPE_KEY;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < iterations; i++) {
+        msg.body.key.seq = i + 1;
+        serverChannel->sendMessage(&msg);
+        InputMessage reply;
+        while (serverChannel->receiveMessage(&reply) == WOULD_BLOCK) {
+            isReadable(serverChannel, -1);
+        }
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    serverChannel.clear(); // the echo thread stops when the channel is closed
+    thread->join();
+    return elapsed;
+}
+
+TEST_F(InputChannelTest, RoundTripBenchmark) {
+    const size_t ITERATIONS = 20000;
+
+    nsecs_t socketTime = measureRoundTrip(InputChannel::TRANSPORT_SOCKET, ITERATIONS);
+    nsecs_t sharedMemoryTime = measureRoundTrip(InputChannel::TRANSPORT_SHARED_MEMORY,
+            ITERATIONS);
+    ASSERT_GT(socketTime, 0);
+    ASSERT_GT(sharedMemoryTime, 0);
+
+    printf("%-32s %10.1f ns/round trip\n", "socket",
+            double(socketTime) / ITERATIONS);
+    printf("%-32s %10.1f ns/round trip\n", "shared memory",
+            double(sharedMemoryTime) / ITERATIONS);
+}
+
 
 } // namespace android
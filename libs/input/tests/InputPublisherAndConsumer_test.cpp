@@ -249,6 +249,57 @@ TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
 }
 
+TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_FixedPointers_EndToEnd) {
+    mPublisher->setCompactPointersEnabled(false);
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_CompactPointers_EndToEnd) {
+    mPublisher->setCompactPointersEnabled(true);
+    // the consumer's finished signal tells the publisher that it decodes compact pointers
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
+    ASSERT_TRUE(mPublisher->isPublishingCompactPointers());
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_BeforeFinishedSignal_UsesFixedPointers) {
+    mPublisher->setCompactPointersEnabled(true);
+    EXPECT_FALSE(mPublisher->isPublishingCompactPointers());
+
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+    InputMessage msg;
+    ASSERT_EQ(OK, mPublisher->buildMotionMessage(&msg, 1, 1, AINPUT_SOURCE_TOUCHSCREEN,
+            AMOTION_EVENT_ACTION_DOWN, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0,
+            1, &pointerProperties, &pointerCoords));
+    EXPECT_EQ(uint32_t(InputMessage::VERSION_FIXED_POINTERS), msg.header.version);
+}
+
+TEST_F(InputPublisherAndConsumerTest, ReceiveFinishedSignal_FromOlderConsumer_KeepsFixedPointers) {
+    mPublisher->setCompactPointersEnabled(true);
+
+    // a consumer from before the version field, which left it uninitialized
+    const uint32_t versions[] = { 0, InputMessage::VERSION_COMPACT_POINTERS, 0xdeadbeef };
+    for (size_t i = 0; i < sizeof(versions) / sizeof(versions[0]); i++) {
+        InputMessage msg;
+        msg.header.type = InputMessage::TYPE_FINISHED;
+        msg.header.version = versions[i];
+        msg.body.finished.seq = i + 1;
+        msg.body.finished.handled = true;
+        ASSERT_EQ(OK, clientChannel->sendMessage(&msg));
+
+        uint32_t finishedSeq = 0;
+        bool handled = false;
+        ASSERT_EQ(OK, mPublisher->receiveFinishedSignal(&finishedSeq, &handled));
+        EXPECT_EQ(i + 1, finishedSeq);
+        EXPECT_FALSE(mPublisher->isPublishingCompactPointers());
+    }
+
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
+}
+
 TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountLessThan1_ReturnsError) {
     status_t status;
     const size_t pointerCount = 0;
@@ -285,4 +336,193 @@ TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
 }
 
+TEST_F(InputPublisherAndConsumerTest, PublishMessages_EndToEnd) {
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_STYLUS;
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+    pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 10);
+    pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, 20);
+
+    InputMessage msgs[3];
+    ASSERT_EQ(OK, mPublisher->buildMotionMessage(&msgs[0], 1, 1, AINPUT_SOURCE_STYLUS,
+            AMOTION_EVENT_ACTION_DOWN, 0, 0, 0, 0, 0, 0, 1, 1, 3, 3,
+            1, &pointerProperties, &pointerCoords));
+    ASSERT_EQ(OK, mPublisher->buildKeyMessage(&msgs[1], 2, 1, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_ENTER, 13, 0, 0, 4, 4));
+    ASSERT_EQ(OK, mPublisher->buildMotionMessage(&msgs[2], 3, 1, AINPUT_SOURCE_STYLUS,
+            AMOTION_EVENT_ACTION_UP, 0, 0, 0, 0, 0, 0, 1, 1, 3, 5,
+            1, &pointerProperties, &pointerCoords));
+
+    InputMessage badMsg;
+    EXPECT_EQ(BAD_VALUE, mPublisher->buildKeyMessage(&badMsg, 0, 1, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_ENTER, 13, 0, 0, 4, 4))
+            << "buildKeyMessage should return BAD_VALUE for sequence number 0";
+    EXPECT_EQ(BAD_VALUE, mPublisher->buildMotionMessage(&badMsg, 4, 1, AINPUT_SOURCE_STYLUS,
+            AMOTION_EVENT_ACTION_UP, 0, 0, 0, 0, 0, 0, 1, 1, 3, 5,
+            0, &pointerProperties, &pointerCoords))
+            << "buildMotionMessage should return BAD_VALUE for no pointers";
+
+    size_t published = 0;
+    ASSERT_EQ(OK, mPublisher->publishMessages(msgs, 3, &published))
+            << "publisher publishMessages should return OK";
+    ASSERT_EQ(3U, published);
+
+    const int32_t expectedTypes[] = {
+            AINPUT_EVENT_TYPE_MOTION, AINPUT_EVENT_TYPE_KEY, AINPUT_EVENT_TYPE_MOTION };
+    for (uint32_t i = 0; i < 3; i++) {
+        uint32_t consumeSeq;
+        InputEvent* event;
+        status_t status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event);
+        ASSERT_EQ(OK, status)
+                << "consumer consume should return OK";
+        ASSERT_TRUE(event != NULL)
+                << "consumer should have returned non-NULL event";
+        EXPECT_EQ(expectedTypes[i], event->getType());
+        EXPECT_EQ(i + 1, consumeSeq);
+    }
+}
+
+// Replays a 240Hz stylus to an application that stalls for 50ms every 250ms, which is
+// when the dispatcher's outbound queue for it backs up.  Compares publishing the backlog
+// one event at a time with publishing it as a batch.
+TEST_F(InputPublisherAndConsumerTest, PublishMessages_240HzStylusReplay) {
+    const size_t sampleCount = 240 * 2;
+    const nsecs_t samplePeriod = 1000000000LL / 240;
+    const nsecs_t stallPeriod = 250 * 1000000LL;
+    const nsecs_t stallTime = 50 * 1000000LL;
+
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_STYLUS;
+    PointerCoords pointerCoords;
+    pointerCoords.clear();
+
+    for (int batched = 0; batched < 2; batched++) {
+        InputMessage backlog[64];
+        size_t backlogCount = 0;
+        size_t publishCalls = 0;
+        size_t received = 0;
+        nsecs_t publishTime = 0;
+
+        for (size_t n = 0; n < sampleCount; n++) {
+            nsecs_t eventTime = n * samplePeriod;
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, n);
+            pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, n * 2);
+            ASSERT_EQ(OK, mPublisher->buildMotionMessage(&backlog[backlogCount++],
+                    n + 1, 1, AINPUT_SOURCE_STYLUS, AMOTION_EVENT_ACTION_MOVE,
+                    0, 0, 0, 0, 0, 0, 1, 1, 0, eventTime,
+                    1, &pointerProperties, &pointerCoords));
+            ASSERT_LT(backlogCount, 64U);
+            if (eventTime % stallPeriod < stallTime) {
+                continue; // the application is not taking events
+            }
+
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (batched) {
+                size_t published;
+                ASSERT_EQ(OK, mPublisher->publishMessages(backlog, backlogCount, &published));
+                ASSERT_EQ(backlogCount, published);
+                publishCalls += 1;
+            } else {
+                for (size_t i = 0; i < backlogCount; i++) {
+                    // the pointers in the backlog may be packed, so build them again
+                    const InputMessage::Body::Motion& motion = backlog[i].body.motion;
+                    pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, motion.seq - 1);
+                    pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, (motion.seq - 1) * 2);
+                    ASSERT_EQ(OK, mPublisher->publishMotionEvent(motion.seq, motion.deviceId,
+                            motion.source, motion.action, motion.flags, motion.edgeFlags,
+                            motion.metaState, motion.buttonState,
+                            motion.xOffset, motion.yOffset,
+                            motion.xPrecision, motion.yPrecision,
+                            motion.downTime, motion.eventTime,
+                            motion.pointerCount, &pointerProperties, &pointerCoords));
+                    publishCalls += 1;
+                }
+            }
+            publishTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            backlogCount = 0;
+
+            InputMessage msg;
+            while (clientChannel->receiveMessage(&msg) == OK) {
+                ASSERT_EQ(uint32_t(InputMessage::TYPE_MOTION), msg.header.type);
+                ASSERT_EQ(++received, msg.body.motion.seq)
+                        << "messages should arrive one at a time and in order";
+            }
+        }
+        EXPECT_EQ(sampleCount, received);
+
+        // The backlog never exceeds one sendmmsg() batch, so each publishMessages() call
+        // is a single system call, as is each publishMotionEvent() call.
+        printf("%-32s %6zu send calls, %8.1f us publishing\n",
+                batched ? "240Hz stylus, batched" : "240Hz stylus, one at a time",
+                publishCalls, publishTime / 1000.0);
+    }
+}
+
+// Publishes ten finger moves with typical touch screen axes both ways, to compare the
+// bytes that go through the channel.
+TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_TenFingerBandwidth) {
+    const size_t eventCount = 1000;
+    const size_t pointerCount = 10;
+    PointerProperties pointerProperties[pointerCount];
+    PointerCoords pointerCoords[pointerCount];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerProperties[i].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    }
+
+    // let the consumer tell the publisher that it decodes compact pointers
+    mPublisher->setCompactPointersEnabled(true);
+    ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
+
+    for (int compact = 0; compact < 2; compact++) {
+        mPublisher->setCompactPointersEnabled(compact);
+        ASSERT_EQ(bool(compact), mPublisher->isPublishingCompactPointers());
+        size_t bytes = 0;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t n = 0; n < eventCount; n++) {
+            for (size_t i = 0; i < pointerCount; i++) {
+                pointerCoords[i].clear();
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 100 * i + n);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 200 * i + n);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 0.5);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_SIZE, 0.2);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, 12);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MINOR, 10);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_TOOL_MAJOR, 12);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, 10);
+                pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, 0.1);
+            }
+
+            InputMessage msg;
+            ASSERT_EQ(OK, mPublisher->buildMotionMessage(&msg, n + 1, 1,
+                    AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 1, 1,
+                    0, n, pointerCount, pointerProperties, pointerCoords));
+            bytes += msg.size();
+            size_t published;
+            ASSERT_EQ(OK, mPublisher->publishMessages(&msg, 1, &published));
+
+            InputMessage received;
+            ASSERT_EQ(OK, clientChannel->receiveMessage(&received));
+            ASSERT_EQ(uint32_t(InputMessage::VERSION_FIXED_POINTERS), received.header.version);
+            ASSERT_EQ(pointerCount, received.body.motion.pointerCount);
+            for (size_t i = 0; i < pointerCount; i++) {
+                ASSERT_EQ(pointerProperties[i], received.body.motion.pointers[i].properties);
+                ASSERT_EQ(pointerCoords[i], received.body.motion.pointers[i].coords);
+            }
+        }
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        printf("%-32s %6zu bytes/event, %8.1f ns/event\n",
+                compact ? "10 fingers, compact pointers" : "10 fingers, fixed pointers",
+                bytes / eventCount, double(elapsed) / eventCount);
+    }
+}
+
 } // namespace android
@@ -33,6 +33,8 @@ void TestPointerCoordsAlignment() {
 
 void TestInputMessageAlignment() {
   CHECK_OFFSET(InputMessage, body, 8);
+  CHECK_OFFSET(InputMessage::Header, type, 0);
+  CHECK_OFFSET(InputMessage::Header, version, 4);
 
   CHECK_OFFSET(InputMessage::Body::Key, seq, 0);
   CHECK_OFFSET(InputMessage::Body::Key, eventTime, 8);
@@ -64,4 +66,11 @@ void TestInputMessageAlignment() {
   CHECK_OFFSET(InputMessage::Body::Motion, pointers, 80);
 }
 
+void TestCompactPointerLayout() {
+  // Compact pointers are written as the raw bytes of these.
+  static_assert(sizeof(PointerProperties) == 8, "");
+  CHECK_OFFSET(PointerCoords, bits, 0);
+  CHECK_OFFSET(PointerCoords, values, 8);
+}
+
 } // namespace android
@@ -95,6 +95,43 @@ sp<Fence> Fence::merge(const String8& name, const sp<Fence>& f1,
     return sp<Fence>(new Fence(result));
 }
 
+sp<Fence> Fence::mergeMany(const String8& name, const sp<Fence>* fences,
+        size_t count) {
+    ATRACE_CALL();
+    sp<Fence> first;
+    int result = -1;
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Fence>& fence(fences[i]);
+        if (fence == NULL || !fence->isValid()) {
+            continue;
+        }
+        if (first == NULL) {
+            first = fence;
+            continue;
+        }
+        const int fd = result != -1 ? result : first->mFenceFd;
+        int merged = sync_merge(name.string(), fd, fence->mFenceFd);
+        if (merged == -1) {
+            status_t err = -errno;
+            ALOGE("mergeMany: sync_merge(\"%s\", %d, %d) returned an error: "
+                    "%s (%d)", name.string(), fd, fence->mFenceFd,
+                    strerror(-err), err);
+            if (result != -1) {
+                close(result);
+            }
+            return NO_FENCE;
+        }
+        if (result != -1) {
+            close(result);
+        }
+        result = merged;
+    }
+    if (result != -1) {
+        return sp<Fence>(new Fence(result));
+    }
+    return first != NULL ? first : NO_FENCE;
+}
+
 int Fence::dup() const {
     return ::dup(mFenceFd);
 }
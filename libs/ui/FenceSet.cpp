@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceSet"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+//#define LOG_NDEBUG 0
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <errno.h>
+#include <poll.h>
+
+#include <ui/FenceSet.h>
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// The file descriptors of the valid fences of a set, in the order of the
+// set. Sets are usually small, so their pollfds are kept on the stack.
+struct FenceSet::PollList {
+    enum { INLINE_COUNT = 16 };
+
+    struct pollfd inlineFds[INLINE_COUNT];
+    struct pollfd* fds;
+    size_t count;
+
+    PollList(size_t capacity)
+        : fds(capacity > INLINE_COUNT ? new struct pollfd[capacity] : inlineFds),
+          count(0) {
+    }
+
+    ~PollList() {
+        if (fds != inlineFds) {
+            delete [] fds;
+        }
+    }
+
+    void add(int fd) {
+        fds[count].fd = fd;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        count++;
+    }
+
+    // like sync_wait, retry if interrupted
+    int poll(int timeout) {
+        int ret;
+        do {
+            ret = ::poll(fds, count, timeout);
+        } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+        return ret;
+    }
+
+    static bool isError(const struct pollfd& pfd) {
+        return pfd.revents & (POLLERR | POLLNVAL);
+    }
+
+    static bool isSignaled(const struct pollfd& pfd) {
+        return pfd.revents & POLLIN;
+    }
+
+private:
+    PollList(const PollList&);
+    PollList& operator = (const PollList&);
+};
+
+// ---------------------------------------------------------------------------
+
+FenceSet::FenceSet() {
+}
+
+FenceSet::~FenceSet() {
+}
+
+void FenceSet::add(const sp<Fence>& fence) {
+    mFences.add(fence != NULL ? fence : Fence::NO_FENCE);
+}
+
+void FenceSet::clear() {
+    mFences.clear();
+}
+
+void FenceSet::fillPollList(PollList* list) const {
+    const size_t count = mFences.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Fence>& fence(mFences[i]);
+        if (fence->isValid()) {
+            list->add(fence->mFenceFd);
+        }
+    }
+}
+
+sp<Fence> FenceSet::merge(const String8& name) const {
+    return Fence::mergeMany(name, mFences.array(), mFences.size());
+}
+
+ssize_t FenceSet::waitAny(int timeout) const {
+    ATRACE_CALL();
+    const size_t count = mFences.size();
+    for (size_t i=0 ; i<count ; i++) {
+        if (!mFences[i]->isValid()) {
+            return i;
+        }
+    }
+    if (!count) {
+        return -ETIME;
+    }
+
+    // every fence is valid, so the pollfds have the indices of the set
+    PollList list(count);
+    fillPollList(&list);
+    int ret = list.poll(timeout);
+    if (ret < 0) {
+        return -errno;
+    }
+    if (ret == 0) {
+        return -ETIME;
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        if (PollList::isError(list.fds[i])) {
+            return -EINVAL;
+        }
+        if (PollList::isSignaled(list.fds[i])) {
+            return i;
+        }
+    }
+    return -ETIME;
+}
+
+status_t FenceSet::waitAll(int timeout) const {
+    ATRACE_CALL();
+    PollList list(mFences.size());
+    fillPollList(&list);
+
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    int remaining = timeout;
+    while (list.count) {
+        int ret = list.poll(remaining);
+        if (ret < 0) {
+            return -errno;
+        }
+        if (ret == 0) {
+            return -ETIME;
+        }
+        // drop the fences that signaled and poll the others again
+        size_t i = 0;
+        while (i < list.count) {
+            if (PollList::isError(list.fds[i])) {
+                return -EINVAL;
+            }
+            if (PollList::isSignaled(list.fds[i])) {
+                list.fds[i] = list.fds[--list.count];
+            } else {
+                i++;
+            }
+        }
+        remaining = toMillisecondTimeoutDelay(start, timeout);
+    }
+    return NO_ERROR;
+}
+
+status_t FenceSet::getSignalTimes(nsecs_t* earliest, nsecs_t* latest) const {
+    ATRACE_CALL();
+    const size_t count = mFences.size();
+    PollList list(count);
+    fillPollList(&list);
+    if (!list.count) {
+        *earliest = -1;
+        *latest = -1;
+        return NO_ERROR;
+    }
+
+    // find the signaled fences with a single poll, and only ask those for
+    // their signal time
+    if (list.poll(0) < 0) {
+        return -errno;
+    }
+    nsecs_t first = INT64_MAX;
+    nsecs_t last = 0;
+    bool pending = false;
+    for (size_t i=0, j=0 ; i<count ; i++) {
+        const sp<Fence>& fence(mFences[i]);
+        if (!fence->isValid()) {
+            continue;
+        }
+        const struct pollfd& pfd(list.fds[j++]);
+        if (PollList::isError(pfd)) {
+            return -EINVAL;
+        }
+        if (!PollList::isSignaled(pfd)) {
+            pending = true;
+            continue;
+        }
+        const nsecs_t t = fence->getSignalTime();
+        if (t < 0) {
+            return BAD_VALUE;
+        }
+        first = t < first ? t : first;
+        last = t > last ? t : last;
+    }
+    *earliest = first;
+    *latest = pending ? INT64_MAX : last;
+    return NO_ERROR;
+}
+
+nsecs_t FenceSet::getSignalTime() const {
+    nsecs_t earliest, latest;
+    if (getSignalTimes(&earliest, &latest) != NO_ERROR) {
+        return -1;
+    }
+    return latest;
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
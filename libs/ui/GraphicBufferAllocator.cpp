@@ -18,6 +18,8 @@
 #define LOG_TAG "GraphicBufferAllocator"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <unistd.h>
+
 #include <cutils/log.h>
 
 #include <utils/Singleton.h>
@@ -32,8 +34,17 @@ namespace android {
 ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferAllocator )
 
 Mutex GraphicBufferAllocator::sLock;
-KeyedVector<buffer_handle_t,
+BasicHashtable<buffer_handle_t,
     GraphicBufferAllocator::alloc_rec_t> GraphicBufferAllocator::sAllocList;
+KeyedVector<PixelFormat,
+    GraphicBufferAllocator::alloc_stat_t> GraphicBufferAllocator::sFormatStats;
+KeyedVector<uint32_t,
+    GraphicBufferAllocator::alloc_stat_t> GraphicBufferAllocator::sUsageStats;
+KeyedVector<pid_t,
+    GraphicBufferAllocator::alloc_stat_t> GraphicBufferAllocator::sPidStats;
+size_t GraphicBufferAllocator::sTotalSize = 0;
+size_t GraphicBufferAllocator::sPeakSize = 0;
+size_t GraphicBufferAllocator::sPeakCount = 0;
 
 GraphicBufferAllocator::GraphicBufferAllocator()
     : mAllocDev(0)
@@ -51,32 +62,110 @@ GraphicBufferAllocator::~GraphicBufferAllocator()
     gralloc_close(mAllocDev);
 }
 
+template <typename KEY>
+void GraphicBufferAllocator::addStat(KeyedVector<KEY, alloc_stat_t>& stats,
+        const KEY& key, size_t size)
+{
+    ssize_t index = stats.indexOfKey(key);
+    if (index < 0) {
+        alloc_stat_t stat = { 0, 0 };
+        index = stats.add(key, stat);
+    }
+    alloc_stat_t& stat(stats.editValueAt(index));
+    stat.count++;
+    stat.size += size;
+}
+
+template <typename KEY>
+void GraphicBufferAllocator::removeStat(KeyedVector<KEY, alloc_stat_t>& stats,
+        const KEY& key, size_t size)
+{
+    ssize_t index = stats.indexOfKey(key);
+    if (index >= 0) {
+        alloc_stat_t& stat(stats.editValueAt(index));
+        if (--stat.count == 0) {
+            stats.removeItemsAt(index);
+        } else {
+            stat.size -= size;
+        }
+    }
+}
+
+int GraphicBufferAllocator::compareHandles(const alloc_rec_t* lhs,
+        const alloc_rec_t* rhs)
+{
+    return lhs->handle < rhs->handle ? -1 : (lhs->handle > rhs->handle ? 1 : 0);
+}
+
 void GraphicBufferAllocator::dump(String8& result) const
 {
-    Mutex::Autolock _l(sLock);
-    KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
-    size_t total = 0;
+    // take a copy of the records and stats (the KeyedVectors are
+    // copy-on-write) so that they can be formatted without the lock, which
+    // every allocation needs
+    Vector<alloc_rec_t> list;
+    KeyedVector<PixelFormat, alloc_stat_t> formatStats;
+    KeyedVector<uint32_t, alloc_stat_t> usageStats;
+    KeyedVector<pid_t, alloc_stat_t> pidStats;
+    size_t total, peakSize, peakCount;
+    { // scope for the lock
+        Mutex::Autolock _l(sLock);
+        list.setCapacity(sAllocList.size());
+        for (ssize_t i = sAllocList.next(-1); i >= 0; i = sAllocList.next(i)) {
+            list.add(sAllocList.entryAt(i));
+        }
+        formatStats = sFormatStats;
+        usageStats = sUsageStats;
+        pidStats = sPidStats;
+        total = sTotalSize;
+        peakSize = sPeakSize;
+        peakCount = sPeakCount;
+    }
+    // the hashtable isn't ordered, sort by handle for a stable output
+    list.sort(compareHandles);
+
     const size_t SIZE = 4096;
     char buffer[SIZE];
     snprintf(buffer, SIZE, "Allocated buffers:\n");
     result.append(buffer);
     const size_t c = list.size();
     for (size_t i=0 ; i<c ; i++) {
-        const alloc_rec_t& rec(list.valueAt(i));
+        const alloc_rec_t& rec(list[i]);
         if (rec.size) {
-            snprintf(buffer, SIZE, "%10p: %7.2f KiB | %4u (%4u) x %4u | %8X | 0x%08x\n",
-                    list.keyAt(i), rec.size/1024.0f,
-                    rec.w, rec.s, rec.h, rec.format, rec.usage);
+            snprintf(buffer, SIZE, "%10p: %7.2f KiB | %4u (%4u) x %4u | %8X | 0x%08x | pid %d\n",
+                    rec.handle, rec.size/1024.0f,
+                    rec.w, rec.s, rec.h, rec.format, rec.usage, rec.pid);
         } else {
-            snprintf(buffer, SIZE, "%10p: unknown     | %4u (%4u) x %4u | %8X | 0x%08x\n",
-                    list.keyAt(i),
-                    rec.w, rec.s, rec.h, rec.format, rec.usage);
+            snprintf(buffer, SIZE, "%10p: unknown     | %4u (%4u) x %4u | %8X | 0x%08x | pid %d\n",
+                    rec.handle,
+                    rec.w, rec.s, rec.h, rec.format, rec.usage, rec.pid);
         }
         result.append(buffer);
-        total += rec.size;
     }
     snprintf(buffer, SIZE, "Total allocated (estimate): %.2f KB\n", total/1024.0f);
     result.append(buffer);
+    snprintf(buffer, SIZE, "Peak allocated (estimate): %.2f KB in %zu buffers\n",
+            peakSize/1024.0f, peakCount);
+    result.append(buffer);
+
+    result.append("Allocated by format:\n");
+    for (size_t i=0 ; i<formatStats.size() ; i++) {
+        const alloc_stat_t& stat(formatStats.valueAt(i));
+        result.appendFormat("  %8X: %4zu buffers, %10.2f KiB\n",
+                formatStats.keyAt(i), stat.count, stat.size/1024.0f);
+    }
+    result.append("Allocated by usage:\n");
+    for (size_t i=0 ; i<usageStats.size() ; i++) {
+        const alloc_stat_t& stat(usageStats.valueAt(i));
+        result.appendFormat("  0x%08x: %4zu buffers, %10.2f KiB\n",
+                usageStats.keyAt(i), stat.count, stat.size/1024.0f);
+    }
+    result.append("Allocated by process:\n");
+    for (size_t i=0 ; i<pidStats.size() ; i++) {
+        const alloc_stat_t& stat(pidStats.valueAt(i));
+        result.appendFormat("  pid %5d: %4zu buffers, %10.2f KiB\n",
+                pidStats.keyAt(i), stat.count, stat.size/1024.0f);
+    }
+
     if (mAllocDev->common.version >= 1 && mAllocDev->dump) {
         mAllocDev->dump(mAllocDev, buffer, SIZE);
         result.append(buffer);
@@ -126,8 +215,6 @@ status_t GraphicBufferAllocator::alloc(uint32_t w, uint32_t h,
 #endif
 
     if (err == NO_ERROR) {
-        Mutex::Autolock _l(sLock);
-        KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
         int bpp = bytesPerPixel(format);
         if (bpp < 0) {
             // probably a HAL custom format. in any case, we don't know
@@ -135,13 +222,25 @@ status_t GraphicBufferAllocator::alloc(uint32_t w, uint32_t h,
             bpp = 0;
         }
         alloc_rec_t rec;
+        rec.handle = *handle;
         rec.w = w;
         rec.h = h;
         rec.s = *stride;
         rec.format = format;
         rec.usage = usage;
         rec.size = h * stride[0] * bpp;
-        list.add(*handle, rec);
+        rec.pid = getpid();
+
+        Mutex::Autolock _l(sLock);
+        sAllocList.add(hash_type(rec.handle), rec);
+        addStat(sFormatStats, rec.format, rec.size);
+        addStat(sUsageStats, rec.usage, rec.size);
+        addStat(sPidStats, rec.pid, rec.size);
+        sTotalSize += rec.size;
+        if (sTotalSize > sPeakSize) {
+            sPeakSize = sTotalSize;
+            sPeakCount = sAllocList.size();
+        }
     }
 
     return err;
@@ -157,12 +256,35 @@ status_t GraphicBufferAllocator::free(buffer_handle_t handle)
     ALOGW_IF(err, "free(...) failed %d (%s)", err, strerror(-err));
     if (err == NO_ERROR) {
         Mutex::Autolock _l(sLock);
-        KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
-        list.removeItem(handle);
+        ssize_t index = sAllocList.find(-1, hash_type(handle), handle);
+        if (index >= 0) {
+            const alloc_rec_t& rec(sAllocList.entryAt(index));
+            removeStat(sFormatStats, rec.format, rec.size);
+            removeStat(sUsageStats, rec.usage, rec.size);
+            removeStat(sPidStats, rec.pid, rec.size);
+            sTotalSize -= rec.size;
+            sAllocList.removeAt(index);
+        }
     }
 
     return err;
 }
 
+status_t GraphicBufferAllocator::setOwner(buffer_handle_t handle, pid_t pid)
+{
+    Mutex::Autolock _l(sLock);
+    ssize_t index = sAllocList.find(-1, hash_type(handle), handle);
+    if (index < 0) {
+        return BAD_VALUE;
+    }
+    alloc_rec_t& rec(sAllocList.editEntryAt(index));
+    if (rec.pid != pid) {
+        removeStat(sPidStats, rec.pid, rec.size);
+        rec.pid = pid;
+        addStat(sPidStats, rec.pid, rec.size);
+    }
+    return NO_ERROR;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
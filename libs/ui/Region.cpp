@@ -21,7 +21,11 @@
 
 #include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <utils/Debug.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/CallStack.h>
@@ -41,6 +45,14 @@
 #include <core/SkRegion.h>
 #endif
 
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define REGION_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define REGION_USE_SSE2 1
+#endif
+
 namespace android {
 // ----------------------------------------------------------------------------
 
@@ -51,10 +63,107 @@ enum {
     op_xor  = region_operator<Rect>::op_xor
 };
 
-enum {
-    direction_LTR,
-    direction_RTL
-};
+// ----------------------------------------------------------------------------
+// Vectorized helpers. A Rect is four int32_t {left, top, right, bottom},
+// which is exactly one 128-bit vector, so these process a Rect per
+// instruction (with a scalar fallback for other targets).
+
+static inline void offsetRects(Rect* rects, size_t count, int dx, int dy)
+{
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(sizeof(Rect) == 4*sizeof(int32_t));
+#if REGION_USE_NEON
+    const int32_t offset[4] = { dx, dy, dx, dy };
+    const int32x4_t d = vld1q_s32(offset);
+    int32_t* p = reinterpret_cast<int32_t*>(rects);
+    for (size_t i=0 ; i<count ; i++, p+=4) {
+        vst1q_s32(p, vaddq_s32(vld1q_s32(p), d));
+    }
+#elif REGION_USE_SSE2
+    const __m128i d = _mm_setr_epi32(dx, dy, dx, dy);
+    __m128i* p = reinterpret_cast<__m128i*>(rects);
+    for (size_t i=0 ; i<count ; i++, p++) {
+        _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), d));
+    }
+#else
+    for (size_t i=0 ; i<count ; i++) {
+        rects[i].offsetBy(dx, dy);
+    }
+#endif
+}
+
+// returns whether a[i] and b[i] have the same left and right, for all i
+static inline bool sameHorizontalExtents(const Rect* a, const Rect* b,
+        size_t count)
+{
+#if REGION_USE_NEON
+    const int32_t* p = reinterpret_cast<const int32_t*>(a);
+    const int32_t* q = reinterpret_cast<const int32_t*>(b);
+    for (size_t i=0 ; i<count ; i++, p+=4, q+=4) {
+        const uint32x4_t eq = vceqq_s32(vld1q_s32(p), vld1q_s32(q));
+        if (!(vgetq_lane_u32(eq, 0) & vgetq_lane_u32(eq, 2))) {
+            return false;
+        }
+    }
+#elif REGION_USE_SSE2
+    const __m128i* p = reinterpret_cast<const __m128i*>(a);
+    const __m128i* q = reinterpret_cast<const __m128i*>(b);
+    for (size_t i=0 ; i<count ; i++, p++, q++) {
+        const __m128i eq = _mm_cmpeq_epi32(
+                _mm_loadu_si128(p), _mm_loadu_si128(q));
+        // lanes 0 and 2 are left and right
+        if ((_mm_movemask_epi8(eq) & 0x0F0F) != 0x0F0F) {
+            return false;
+        }
+    }
+#else
+    for (size_t i=0 ; i<count ; i++) {
+        if (a[i].left != b[i].left || a[i].right != b[i].right) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+// offsets src by (dx, dy), intersects it with clip and returns whether the
+// result (in dst) is non-empty
+static inline bool clipRect(Rect& dst, const Rect& src, int dx, int dy,
+        const Rect& clip)
+{
+#if REGION_USE_NEON
+    const int32_t offset[4] = { dx, dy, dx, dy };
+    const int32x4_t v = vaddq_s32(
+            vld1q_s32(reinterpret_cast<const int32_t*>(&src)),
+            vld1q_s32(offset));
+    const int32x4_t c = vld1q_s32(reinterpret_cast<const int32_t*>(&clip));
+    // max() for left/top, min() for right/bottom
+    const int32x2_t lt = vmax_s32(vget_low_s32(v), vget_low_s32(c));
+    const int32x2_t rb = vmin_s32(vget_high_s32(v), vget_high_s32(c));
+    vst1q_s32(reinterpret_cast<int32_t*>(&dst), vcombine_s32(lt, rb));
+    const uint32x2_t nonEmpty = vclt_s32(lt, rb);
+    return vget_lane_u32(nonEmpty, 0) & vget_lane_u32(nonEmpty, 1);
+#elif REGION_USE_SSE2
+    const __m128i v = _mm_add_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src)),
+            _mm_setr_epi32(dx, dy, dx, dy));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&clip));
+    // SSE2 has no 32-bit min/max: keep v where it's greater than c in the
+    // left/top lanes and where it's not in the right/bottom lanes
+    const __m128i keep = _mm_xor_si128(_mm_cmpgt_epi32(v, c),
+            _mm_setr_epi32(0, 0, -1, -1));
+    const __m128i r = _mm_or_si128(_mm_and_si128(keep, v),
+            _mm_andnot_si128(keep, c));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst), r);
+    const __m128i rb = _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 2, 3, 2));
+    return (_mm_movemask_epi8(_mm_cmplt_epi32(r, rb)) & 0xFF) == 0xFF;
+#else
+    dst.left   = src.left   + dx > clip.left   ? src.left   + dx : clip.left;
+    dst.top    = src.top    + dy > clip.top    ? src.top    + dy : clip.top;
+    dst.right  = src.right  + dx < clip.right  ? src.right  + dx : clip.right;
+    dst.bottom = src.bottom + dy < clip.bottom ? src.bottom + dy : clip.bottom;
+    return dst.left < dst.right && dst.top < dst.bottom;
+#endif
+}
 
 // ----------------------------------------------------------------------------
 
@@ -78,104 +187,364 @@ Region::~Region()
 {
 }
 
-/**
- * Copy rects from the src vector into the dst vector, resolving vertical T-Junctions along the way
- *
- * First pass through, divideSpanRTL will be set because the 'previous span' (indexing into the dst
- * vector) will be reversed. Each rectangle in the original list, starting from the bottom, will be
- * compared with the span directly below, and subdivided as needed to resolve T-junctions.
- *
- * The resulting temporary vector will be a completely reversed copy of the original, without any
- * bottom-up T-junctions.
- *
- * Second pass through, divideSpanRTL will be false since the previous span will index into the
- * final, correctly ordered region buffer. Each rectangle will be compared with the span directly
- * above it, and subdivided to resolve any remaining T-junctions.
- */
-static void reverseRectsResolvingJunctions(const Rect* begin, const Rect* end,
-        Vector<Rect>& dst, int spanDirection) {
-    dst.clear();
+// ----------------------------------------------------------------------------
 
-    const Rect* current = end - 1;
-    int lastTop = current->top;
-
-    // add first span immediately
-    do {
-        dst.add(*current);
-        current--;
-    } while (current->top == lastTop && current >= begin);
-
-    unsigned int beginLastSpan = -1;
-    unsigned int endLastSpan = -1;
-    int top = -1;
-    int bottom = -1;
-
-    // for all other spans, split if a t-junction exists in the span directly above
-    while (current >= begin) {
-        if (current->top != (current + 1)->top) {
-            // new span
-            if ((spanDirection == direction_RTL && current->bottom != (current + 1)->top) ||
-                    (spanDirection == direction_LTR && current->top != (current + 1)->bottom)) {
-                // previous span not directly adjacent, don't check for T junctions
-                beginLastSpan = INT_MAX;
-            } else {
-                beginLastSpan = endLastSpan + 1;
-            }
-            endLastSpan = dst.size() - 1;
+Region::RectStorage::RectStorage(const RectStorage& rhs)
+    : mCount(rhs.mCount)
+{
+    if (rhs.isInline()) {
+        memcpy(mInline, rhs.mInline, mCount * sizeof(Rect));
+    } else {
+        mHeap = rhs.mHeap;
+    }
+}
+
+Region::RectStorage& Region::RectStorage::operator = (const RectStorage& rhs) {
+    if (rhs.isInline()) {
+        // keep our heap around for later, rhs's isn't needed
+        memmove(mInline, rhs.mInline, rhs.mCount * sizeof(Rect));
+    } else {
+        mHeap = rhs.mHeap;
+    }
+    mCount = rhs.mCount;
+    return *this;
+}
+
+bool Region::RectStorage::isHeapShared() const {
+    SharedBuffer const* sb = SharedBuffer::bufferFromData(mHeap.array());
+    return sb != NULL && !sb->onlyOwner();
+}
+
+Rect* Region::RectStorage::editHeap(size_t count) {
+    if (mHeap.size() < count) {
+        mHeap.resize(count);
+    }
+    return mHeap.editArray();
+}
+
+void Region::RectStorage::resize(size_t count) {
+    if (count > INLINE_RECTS) {
+        const bool wasInline = isInline();
+        Rect* heap = editHeap(count);
+        if (wasInline) {
+            memcpy(heap, mInline, mCount * sizeof(Rect));
+        }
+    } else if (!isInline()) {
+        memcpy(mInline, mHeap.array(), count * sizeof(Rect));
+    }
+    mCount = count;
+}
+
+Rect* Region::RectStorage::editArray() {
+    return isInline() ? mInline : mHeap.editArray();
+}
 
-            top = current->top;
-            bottom = current->bottom;
+void Region::RectStorage::clear() {
+    mCount = 0;
+    if (isHeapShared()) {
+        mHeap = Vector<Rect>();
+    }
+}
+
+void Region::RectStorage::add(const Rect& rect) {
+    if (mCount < INLINE_RECTS) {
+        mInline[mCount++] = rect;
+        return;
+    }
+    // rect may be one of ours, which editHeap() can move
+    const Rect copy(rect);
+    appendArray(&copy, 1);
+}
+
+void Region::RectStorage::appendArray(Rect const* rects, size_t count) {
+    const size_t total = mCount + count;
+    if (total <= INLINE_RECTS) {
+        memcpy(mInline + mCount, rects, count * sizeof(Rect));
+    } else {
+        const bool wasInline = isInline();
+        Rect* heap = editHeap(total);
+        if (wasInline) {
+            memcpy(heap, mInline, mCount * sizeof(Rect));
         }
-        int left = current->left;
-        int right = current->right;
+        memcpy(heap + mCount, rects, count * sizeof(Rect));
+    }
+    mCount = total;
+}
 
-        for (unsigned int prevIndex = beginLastSpan; prevIndex <= endLastSpan; prevIndex++) {
-            const Rect prev = dst[prevIndex];
-            if (spanDirection == direction_RTL) {
-                // iterating over previous span RTL, quit if it's too far left
-                if (prev.right <= left) break;
+void Region::RectStorage::insertAt(const Rect& rect, size_t index) {
+    const Rect copy(rect);
+    const size_t total = mCount + 1;
+    Rect* array = mInline;
+    if (total > INLINE_RECTS) {
+        const bool wasInline = isInline();
+        array = editHeap(total);
+        if (wasInline) {
+            memcpy(array, mInline, mCount * sizeof(Rect));
+        }
+    }
+    memmove(array + index + 1, array + index, (mCount - index) * sizeof(Rect));
+    array[index] = copy;
+    mCount = total;
+}
 
-                if (prev.right > left && prev.right < right) {
-                    dst.add(Rect(prev.right, top, right, bottom));
-                    right = prev.right;
-                }
+void Region::RectStorage::setTo(Rect const* rects, size_t count) {
+    if (count <= INLINE_RECTS) {
+        memmove(mInline, rects, count * sizeof(Rect));
+    } else {
+        // rects may point into our heap. it is large enough already in that
+        // case, and if it's shared editHeap() copies it but the original
+        // stays valid.
+        memmove(editHeap(count), rects, count * sizeof(Rect));
+    }
+    mCount = count;
+}
 
-                if (prev.left > left && prev.left < right) {
-                    dst.add(Rect(prev.left, top, right, bottom));
-                    right = prev.left;
-                }
+void Region::RectStorage::swap(RectStorage& rhs) {
+    Rect rects[INLINE_RECTS];
+    memcpy(rects, mInline, sizeof(rects));
+    memcpy(mInline, rhs.mInline, sizeof(rects));
+    memcpy(rhs.mInline, rects, sizeof(rects));
+    const Vector<Rect> heap(mHeap);
+    mHeap = rhs.mHeap;
+    rhs.mHeap = heap;
+    const size_t count = mCount;
+    mCount = rhs.mCount;
+    rhs.mCount = count;
+}
 
-                // if an entry in the previous span is too far right, nothing further left in the
-                // current span will need it
-                if (prev.left >= right) {
-                    beginLastSpan = prevIndex;
-                }
-            } else {
-                // iterating over previous span LTR, quit if it's too far right
-                if (prev.left >= right) break;
+SharedBuffer const* Region::RectStorage::getSharedBuffer() const {
+    if (!isInline()) {
+        // We can get to the SharedBuffer of a Vector<Rect> because Rect has
+        // a trivial destructor. It may hold spare rects past mCount.
+        SharedBuffer const* sb = SharedBuffer::bufferFromData(mHeap.array());
+        if (sb != NULL) {
+            sb->acquire();
+        }
+        return sb;
+    }
+    SharedBuffer* sb = SharedBuffer::alloc(mCount * sizeof(Rect));
+    if (sb != NULL) {
+        memcpy(sb->data(), mInline, mCount * sizeof(Rect));
+    }
+    return sb;
+}
 
-                if (prev.left > left && prev.left < right) {
-                    dst.add(Rect(left, top, prev.left, bottom));
-                    left = prev.left;
-                }
+// ----------------------------------------------------------------------------
 
-                if (prev.right > left && prev.right < right) {
-                    dst.add(Rect(left, top, prev.right, bottom));
-                    left = prev.right;
-                }
-                // if an entry in the previous span is too far left, nothing further right in the
-                // current span will need it
-                if (prev.right <= left) {
-                    beginLastSpan = prevIndex;
-                }
+// Per-thread scratch storage. An operation whose destination is one of its
+// operands is computed into 'region', which is then swapped with the
+// destination, and the rasterizer collects spans into 'span'. Both keep
+// their capacity from one operation to the next, so that in steady state
+// Region operations don't allocate.
+//
+// createTJunctionFreeRegion() works in 'below' and 'vertices'.
+struct Region::Scratch {
+    Region region;
+    RectStorage span;
+
+    Vector<int32_t> below;
+    Vector<int32_t> vertices;
+
+    Vector<Rect> disjoint;
+    Vector<Rect> active;
+
+    static pthread_once_t sKeyOnce;
+    static pthread_key_t sKey;
+
+    static void createKey() {
+        pthread_key_create(&sKey, release);
+    }
+    static void release(void* scratch) {
+        delete static_cast<Scratch*>(scratch);
+    }
+};
+
+pthread_once_t Region::Scratch::sKeyOnce = PTHREAD_ONCE_INIT;
+pthread_key_t Region::Scratch::sKey;
+
+Region::Scratch& Region::getScratch() {
+    pthread_once(&Scratch::sKeyOnce, Scratch::createKey);
+    Scratch* scratch = static_cast<Scratch*>(pthread_getspecific(Scratch::sKey));
+    if (scratch == NULL) {
+        scratch = new Scratch;
+        pthread_setspecific(Scratch::sKey, scratch);
+    }
+    return *scratch;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * T-junction removal
+ *
+ * A corner of a rect lying strictly inside the bottom edge of a rect in the
+ * band above (or the top edge of one in the band below) is a T-junction,
+ * which is resolved by splitting the latter rect at that x. The split adds
+ * a vertex at x to that band, which can in turn lie inside an edge of the
+ * next band: a vertex spreads up and down through vertically adjacent
+ * bands for as long as it is within the horizontal extent of their rects.
+ *
+ * The vertices each band receives from below (its own edges included) are
+ * computed bottom-up first, then those received from above top-down,
+ * merging both into the band's final set of vertices and counting the rects
+ * this will produce. Only x coordinates are handled until then; the rects
+ * are written once, in order, into storage of the exact size.
+ */
+
+// returns an array of at least count elements, keeping v's contents and
+// storage (which is never shrunk)
+template <typename T>
+static inline T* editScratch(Vector<T>& v, size_t count) {
+    if (v.size() < count) {
+        v.resize(count);
+    }
+    return v.editArray();
+}
+
+// Writes to out the vertices of the band [begin, end) given the sorted
+// vertices of an adjacent band: the edges of its rects, plus the vertices
+// that are within the horizontal extent of one of them. out must have room
+// for count + 2 * (end - begin) vertices. Returns how many were written.
+static size_t spreadVertices(const Rect* begin, const Rect* end,
+        const int32_t* in, size_t count, int32_t* out)
+{
+    const int32_t* const inEnd = in + count;
+    int32_t* const start = out;
+    for (const Rect* r = begin; r != end; r++) {
+        // rects touch in a region that is already T-junction free
+        if (out == start || out[-1] != r->left) {
+            *out++ = r->left;
+        }
+        while (in != inEnd && *in <= r->left) {
+            in++;
+        }
+        while (in != inEnd && *in < r->right) {
+            *out++ = *in++;
+        }
+        *out++ = r->right;
+    }
+    return out - start;
+}
+
+// writes the union of the sorted vertices a and b to out, returns its size
+static size_t mergeVertices(const int32_t* a, size_t aCount,
+        const int32_t* b, size_t bCount, int32_t* out)
+{
+    const int32_t* const aEnd = a + aCount;
+    const int32_t* const bEnd = b + bCount;
+    int32_t* const start = out;
+    while (a != aEnd && b != bEnd) {
+        if (*a < *b) {
+            *out++ = *a++;
+        } else {
+            if (*a == *b) {
+                a++;
             }
+            *out++ = *b++;
+        }
+    }
+    while (a != aEnd) {
+        *out++ = *a++;
+    }
+    while (b != bEnd) {
+        *out++ = *b++;
+    }
+    return out - start;
+}
+
+template <typename STORAGE>
+static void resolveTJunctions(const Rect* begin, const Rect* end,
+        STORAGE& dst, Vector<int32_t>& below, Vector<int32_t>& vertices)
+{
+    // bottom-up, each band's vertices received from below are appended to
+    // 'below' followed by their count, so that they can be walked back
+    // top-down
+    size_t used = 0;
+    size_t prev = 0;
+    size_t prevCount = 0;
+    const Rect* bandEnd = end;
+    while (bandEnd != begin) {
+        const Rect* bandBegin = bandEnd - 1;
+        while (bandBegin != begin && (bandBegin - 1)->top == bandBegin->top) {
+            bandBegin--;
         }
+        const bool adjacent = bandEnd != end && bandBegin->bottom == bandEnd->top;
+        const size_t inCount = adjacent ? prevCount : 0;
+        int32_t* const v = editScratch(below,
+                used + inCount + 2 * (bandEnd - bandBegin) + 1);
+        prevCount = spreadVertices(bandBegin, bandEnd, v + prev, inCount, v + used);
+        prev = used;
+        used += prevCount;
+        v[used++] = prevCount;
+        bandEnd = bandBegin;
+    }
 
-        if (left < right) {
-            dst.add(Rect(left, top, right, bottom));
+    // top-down, 'vertices' receives for each band the count and vertices it
+    // receives from above, followed by the count and vertices of its final
+    // set
+    size_t total = 0;
+    size_t pos = used;
+    used = 0;
+    prev = 0;
+    prevCount = 0;
+    const Rect* bandBegin = begin;
+    while (bandBegin != end) {
+        const Rect* bandEnd = bandBegin + 1;
+        while (bandEnd != end && bandEnd->top == bandBegin->top) {
+            bandEnd++;
+        }
+        const size_t rects = bandEnd - bandBegin;
+        const bool adjacent = bandBegin != begin &&
+                (bandBegin - 1)->bottom == bandBegin->top;
+        const size_t inCount = adjacent ? prevCount : 0;
+        const size_t upCount = below[pos - 1];
+        pos -= upCount + 1;
+        int32_t* const v = editScratch(vertices,
+                used + 2 * (inCount + 2 * rects + 1) + upCount);
+        const size_t downCount = spreadVertices(bandBegin, bandEnd,
+                v + prev, inCount, v + used + 1);
+        v[used] = downCount;
+        prev = used + 1;
+        prevCount = downCount;
+        used = prev + downCount;
+        const size_t count = mergeVertices(below.array() + pos, upCount,
+                v + prev, downCount, v + used + 1);
+        v[used] = count;
+        used += count + 1;
+
+        // each rect is split at the vertices within its extent, which
+        // includes its edges
+        size_t touching = 0;
+        for (const Rect* r = bandBegin + 1; r != bandEnd; r++) {
+            touching += (r - 1)->right == r->left;
         }
+        total += count + touching - rects;
+        bandBegin = bandEnd;
+    }
 
-        current--;
+    dst.clear();
+    dst.resize(total);
+    Rect* out = dst.editArray();
+    const int32_t* v = vertices.array();
+    bandBegin = begin;
+    while (bandBegin != end) {
+        v += *v + 1;            // skip the vertices received from above
+        const int32_t* vertex = v + 1;
+        v = vertex + *v;
+        const int top = bandBegin->top;
+        const int bottom = bandBegin->bottom;
+        for (const Rect* r = bandBegin; r != end && r->top == top; r++) {
+            int left = r->left;
+            while (*vertex <= left) {
+                vertex++;
+            }
+            while (*vertex < r->right) {
+                *out++ = Rect(left, top, *vertex, bottom);
+                left = *vertex++;
+            }
+            *out++ = Rect(left, top, r->right, bottom);
+            bandBegin = r + 1;
+        }
     }
 }
 
@@ -190,12 +559,10 @@ Region Region::createTJunctionFreeRegion(const Region& r) {
     if (r.isEmpty()) return r;
     if (r.isRect()) return r;
 
-    Vector<Rect> reversed;
-    reverseRectsResolvingJunctions(r.begin(), r.end(), reversed, direction_RTL);
-
+    Scratch& scratch(getScratch());
     Region outputRegion;
-    reverseRectsResolvingJunctions(reversed.begin(), reversed.end(),
-            outputRegion.mStorage, direction_LTR);
+    resolveTJunctions(r.begin(), r.end(), outputRegion.mStorage,
+            scratch.below, scratch.vertices);
     outputRegion.mStorage.add(r.getBounds()); // to make region valid, mStorage must end with bounds
 
 #if VALIDATE_REGIONS
@@ -260,6 +627,13 @@ void Region::set(uint32_t w, uint32_t h)
 }
 
 bool Region::isTriviallyEqual(const Region& region) const {
+    // small regions are stored inline and never share storage, but they
+    // are cheap to compare
+    if (mStorage.isInline() && region.mStorage.isInline()) {
+        return mStorage.size() == region.mStorage.size() &&
+                !memcmp(mStorage.array(), region.mStorage.array(),
+                        mStorage.size() * sizeof(Rect));
+    }
     return begin() == region.begin();
 }
 
@@ -269,7 +643,7 @@ void Region::addRectUnchecked(int l, int t, int r, int b)
 {
     Rect rect(l,t,r,b);
     size_t where = mStorage.size() - 1;
-    mStorage.insertAt(rect, where, 1);
+    mStorage.insertAt(rect, where);
 }
 
 // ----------------------------------------------------------------------------
@@ -287,8 +661,7 @@ Region& Region::subtractSelf(const Rect& r) {
     return operationSelf(r, op_nand);
 }
 Region& Region::operationSelf(const Rect& r, int op) {
-    Region lhs(*this);
-    boolean_operation(op, *this, lhs, r);
+    operation(r, op, this);
     return *this;
 }
 
@@ -307,8 +680,7 @@ Region& Region::subtractSelf(const Region& rhs) {
     return operationSelf(rhs, op_nand);
 }
 Region& Region::operationSelf(const Region& rhs, int op) {
-    Region lhs(*this);
-    boolean_operation(op, *this, lhs, rhs);
+    operation(rhs, 0, 0, op, this);
     return *this;
 }
 
@@ -365,6 +737,63 @@ const Region Region::translate(int x, int y) const {
 
 // ----------------------------------------------------------------------------
 
+void Region::merge(const Rect& rhs, Region* dst) const {
+    operation(rhs, op_or, dst);
+}
+void Region::mergeExclusive(const Rect& rhs, Region* dst) const {
+    operation(rhs, op_xor, dst);
+}
+void Region::intersect(const Rect& rhs, Region* dst) const {
+    operation(rhs, op_and, dst);
+}
+void Region::subtract(const Rect& rhs, Region* dst) const {
+    operation(rhs, op_nand, dst);
+}
+void Region::operation(const Rect& rhs, int op, Region* dst) const {
+    if (!rhs.isValid()) {
+        // boolean_operation() logs this and leaves dst untouched
+        boolean_operation(op, *dst, *this, rhs);
+        return;
+    }
+    // rhs may be one of dst's rects, which the rasterizer overwrites
+    const Rect r(rhs);
+    if (dst != this) {
+        boolean_operation(op, *dst, *this, r);
+        return;
+    }
+    Region& result(getScratch().region);
+    boolean_operation(op, result, *this, r);
+    dst->mStorage.swap(result.mStorage);
+}
+
+void Region::merge(const Region& rhs, Region* dst) const {
+    operation(rhs, 0, 0, op_or, dst);
+}
+void Region::mergeExclusive(const Region& rhs, Region* dst) const {
+    operation(rhs, 0, 0, op_xor, dst);
+}
+void Region::intersect(const Region& rhs, Region* dst) const {
+    operation(rhs, 0, 0, op_and, dst);
+}
+void Region::subtract(const Region& rhs, Region* dst) const {
+    operation(rhs, 0, 0, op_nand, dst);
+}
+void Region::operation(const Region& rhs, int dx, int dy, int op,
+        Region* dst) const {
+    if (dst != this && dst != &rhs) {
+        boolean_operation(op, *dst, *this, rhs, dx, dy);
+        return;
+    }
+    // the rasterizer would overwrite the operands as they are read, build
+    // the result on the side and trade storage with dst, whose old storage
+    // becomes the scratch for the next operation
+    Region& result(getScratch().region);
+    boolean_operation(op, result, *this, rhs, dx, dy);
+    dst->mStorage.swap(result.mStorage);
+}
+
+// ----------------------------------------------------------------------------
+
 Region& Region::orSelf(const Region& rhs, int dx, int dy) {
     return operationSelf(rhs, dx, dy, op_or);
 }
@@ -378,8 +807,7 @@ Region& Region::subtractSelf(const Region& rhs, int dx, int dy) {
     return operationSelf(rhs, dx, dy, op_nand);
 }
 Region& Region::operationSelf(const Region& rhs, int dx, int dy, int op) {
-    Region lhs(*this);
-    boolean_operation(op, *this, lhs, rhs, dx, dy);
+    operation(rhs, dx, dy, op, this);
     return *this;
 }
 
@@ -410,15 +838,17 @@ const Region Region::operation(const Region& rhs, int dx, int dy, int op) const
 class Region::rasterizer : public region_operator<Rect>::region_rasterizer 
 {
     Rect bounds;
-    Vector<Rect>& storage;
+    RectStorage& storage;
     Rect* head;
     Rect* tail;
-    Vector<Rect> span;
+    RectStorage& span;
     Rect* cur;
 public:
     rasterizer(Region& reg) 
-        : bounds(INT_MAX, 0, INT_MIN, 0), storage(reg.mStorage), head(), tail(), cur() {
+        : bounds(INT_MAX, 0, INT_MIN, 0), storage(reg.mStorage), head(), tail(),
+          span(getScratch().span), cur() {
         storage.clear();
+        span.clear();
     }
 
     ~rasterizer() {
@@ -460,17 +890,10 @@ private:
     void flushSpan() {
         bool merge = false;
         if (tail-head == ssize_t(span.size())) {
-            Rect const* p = span.editArray();
+            Rect const* p = span.array();
             Rect const* q = head;
             if (p->top == q->bottom) {
-                merge = true;
-                while (q != tail) {
-                    if ((p->left != q->left) || (p->right != q->right)) {
-                        merge = false;
-                        break;
-                    }
-                    p++, q++;
-                }
+                merge = sameHorizontalExtents(p, q, tail-head);
             }
         }
         if (merge) {
@@ -483,7 +906,7 @@ private:
         } else {
             bounds.left = min(span.itemAt(0).left, bounds.left);
             bounds.right = max(span.top().right, bounds.right);
-            storage.appendVector(span);
+            storage.appendArray(span.array(), span.size());
             tail = storage.editArray() + storage.size();
             head = tail - span.size();
         }
@@ -491,6 +914,88 @@ private:
     }
 };
 
+// ----------------------------------------------------------------------------
+
+static int compareRects(const void* lhs, const void* rhs) {
+    const Rect& l(*static_cast<const Rect*>(lhs));
+    const Rect& r(*static_cast<const Rect*>(rhs));
+    if (l.top != r.top) {
+        return l.top < r.top ? -1 : 1;
+    }
+    return l.left < r.left ? -1 : (l.left > r.left ? 1 : 0);
+}
+
+/*
+ * The rects are swept top to bottom, keeping those crossing the current
+ * band in left order. A band ends where a rect starts or ends, and its
+ * spans go to the rasterizer, which joins touching spans and coalesces
+ * bands that have the same ones, like it does for the boolean operations.
+ */
+void Region::setDisjointRects(Rect const* rects, size_t count)
+{
+    Scratch& scratch(getScratch());
+    Vector<Rect>& active(scratch.active);
+
+    // rects may be ours, copy them before the rasterizer clears us
+    Rect* const sorted = editScratch(scratch.disjoint, count);
+    size_t n = 0;
+    bool inOrder = true;
+    for (size_t i=0 ; i<count ; i++) {
+        if (!rects[i].isEmpty()) {
+            if (n && compareRects(&sorted[n - 1], &rects[i]) > 0) {
+                inOrder = false;
+            }
+            sorted[n++] = rects[i];
+        }
+    }
+    if (!inOrder) {
+        qsort(sorted, n, sizeof(Rect), compareRects);
+    }
+
+    { // scope for rasterizer (dtor has side effects)
+        rasterizer r(*this);
+        active.clear();
+        Rect const* next = sorted;
+        Rect const* const end = sorted + n;
+        int32_t top = n ? next->top : 0;
+        while (next != end || !active.isEmpty()) {
+            // start the rects at the top of this band, keeping left order
+            size_t j = 0;
+            while (next != end && next->top == top) {
+                while (j < active.size() && active[j].left < next->left) {
+                    j++;
+                }
+                active.insertAt(*next++, j++);
+            }
+
+            // the band ends at the next top or at the first bottom
+            int32_t bottom = next != end ? next->top : INT_MAX;
+            for (size_t i=0 ; i<active.size() ; i++) {
+                if (active[i].bottom < bottom) {
+                    bottom = active[i].bottom;
+                }
+            }
+
+            size_t i = 0;
+            while (i < active.size()) {
+                const Rect& a(active[i]);
+                r(Rect(a.left, top, a.right, bottom));
+                if (a.bottom == bottom) {
+                    active.removeAt(i);
+                } else {
+                    i++;
+                }
+            }
+            top = bottom;
+        }
+    }
+#if VALIDATE_REGIONS
+    validate(*this, "setDisjointRects");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
 bool Region::validate(const Region& reg, const char* name, bool silent)
 {
     bool result = true;
@@ -575,12 +1080,24 @@ void Region::boolean_operation(int op, Region& dst,
     size_t rhs_count;
     Rect const * const rhs_rects = rhs.getArray(&rhs_count);
 
-    region_operator<Rect>::region lhs_region(lhs_rects, lhs_count);
-    region_operator<Rect>::region rhs_region(rhs_rects, rhs_count, dx, dy);
-    region_operator<Rect> operation(op, lhs_region, rhs_region);
-    { // scope for rasterizer (dtor has side effects)
-        rasterizer r(dst);
-        operation(r);
+    if (op == op_and && (lhs.isRect() || rhs.isRect())) {
+        // intersecting with a single rect, by far the most common case,
+        // doesn't need the general sweep
+        if (rhs.isRect()) {
+            Rect clip(rhs.getBounds());
+            clip.offsetBy(dx, dy);
+            clip_operation(dst, lhs, 0, 0, clip);
+        } else {
+            clip_operation(dst, rhs, dx, dy, lhs.getBounds());
+        }
+    } else {
+        region_operator<Rect>::region lhs_region(lhs_rects, lhs_count);
+        region_operator<Rect>::region rhs_region(rhs_rects, rhs_count, dx, dy);
+        region_operator<Rect> operation(op, lhs_region, rhs_region);
+        { // scope for rasterizer (dtor has side effects)
+            rasterizer r(dst);
+            operation(r);
+        }
     }
 
 #if VALIDATE_REGIONS
@@ -682,6 +1199,13 @@ void Region::boolean_operation(int op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    if (op == op_and) {
+        Rect clip(rhs);
+        clip.offsetBy(dx, dy);
+        clip_operation(dst, lhs, 0, 0, clip);
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -696,6 +1220,39 @@ void Region::boolean_operation(int op, Region& dst,
 #endif
 }
 
+void Region::clip_operation(Region& dst, const Region& src, int dx, int dy,
+        const Rect& clip)
+{
+    size_t count;
+    Rect const* rects = src.getArray(&count);
+    Rect const* const end = rects + count;
+
+    // bands are sorted and don't overlap, so the bottoms are sorted too:
+    // bisect to the first rect that isn't entirely above the clip rect
+    size_t skip = 0;
+    while (count) {
+        const size_t half = count / 2;
+        if (rects[skip + half].bottom + dy <= clip.top) {
+            skip += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    rects += skip;
+
+    // clipping keeps the bands sorted, the rasterizer coalesces those that
+    // became identical
+    rasterizer r(dst);
+    Rect clipped;
+    while (rects != end && rects->top + dy < clip.bottom) {
+        if (clipRect(clipped, *rects, dx, dy, clip)) {
+            r(clipped);
+        }
+        rects++;
+    }
+}
+
 void Region::boolean_operation(int op, Region& dst,
         const Region& lhs, const Region& rhs)
 {
@@ -714,13 +1271,7 @@ void Region::translate(Region& reg, int dx, int dy)
 #if VALIDATE_REGIONS
         validate(reg, "translate (before)");
 #endif
-        size_t count = reg.mStorage.size();
-        Rect* rects = reg.mStorage.editArray();
-        while (count) {
-            rects->offsetBy(dx, dy);
-            rects++;
-            count--;
-        }
+        offsetRects(reg.mStorage.editArray(), reg.mStorage.size(), dx, dy);
 #if VALIDATE_REGIONS
         validate(reg, "translate (after)");
 #endif
@@ -757,12 +1308,7 @@ status_t Region::unflatten(void const* buffer, size_t size) {
         Rect const* rects = reinterpret_cast<Rect const*>(buffer);
         size_t count = size / sizeof(Rect);
         if (count > 0) {
-            result.mStorage.clear();
-            ssize_t err = result.mStorage.insertAt(0, count);
-            if (err < 0) {
-                return status_t(err);
-            }
-            memcpy(result.mStorage.editArray(), rects, count*sizeof(Rect));
+            result.mStorage.setTo(rects, count);
         }
     }
 #if VALIDATE_REGIONS
@@ -796,16 +1342,11 @@ Rect const* Region::getArray(size_t* count) const {
 }
 
 SharedBuffer const* Region::getSharedBuffer(size_t* count) const {
-    // We can get to the SharedBuffer of a Vector<Rect> because Rect has
-    // a trivial destructor.
-    SharedBuffer const* sb = SharedBuffer::bufferFromData(mStorage.array());
+    SharedBuffer const* sb = mStorage.getSharedBuffer();
     if (count) {
         size_t numRects = isRect() ? 1 : mStorage.size() - 1;
         count[0] = numRects;
     }
-    if (sb != NULL) {
-       sb->acquire();
-    }
     return sb;
 }
 
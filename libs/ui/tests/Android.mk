@@ -4,11 +4,16 @@ include $(CLEAR_VARS)
 
 # Build the unit tests.
 test_src_files := \
+    Fence_benchmark.cpp \
+    GraphicBufferAllocator_test.cpp \
     Region_test.cpp \
+    Region_benchmark.cpp \
     vec_test.cpp \
-    mat_test.cpp
+    mat_test.cpp \
+    mat_benchmark.cpp
 
 shared_libraries := \
+    libsync \
     libutils \
     libui
 
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BENCHMARKHELPERS_H
+#define BENCHMARKHELPERS_H
+
+#include <stdio.h>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+// Prints the time per iteration of a timed loop. The timing tests always
+// pass; their output is meant to be compared before and after a change.
+static inline void report(const char* name, nsecs_t elapsed, size_t iterations) {
+    printf("%-32s %10.1f ns/iteration\n", name,
+            double(elapsed) / double(iterations));
+}
+
+} // namespace android
+
+#endif // BENCHMARKHELPERS_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceBenchmark"
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Timers.h>
+#include <ui/Fence.h>
+#include <ui/FenceSet.h>
+#include <gtest/gtest.h>
+
+#include "BenchmarkHelpers.h"
+
+// software sync timelines, exported by libsync but without a public header
+extern "C" {
+int sw_sync_timeline_create(void);
+int sw_sync_timeline_inc(int fd, unsigned count);
+int sw_sync_fence_create(int fd, const char* name, unsigned value);
+}
+
+namespace android {
+
+// Fences on a software timeline, as HWC release handling and the stream
+// splitter see them: a handful of fences from one frame. The timing tests
+// always pass; they print the time per iteration so that the set operations
+// can be compared with doing the same one fence at a time.
+class FenceBenchmark : public testing::Test {
+protected:
+    enum { FENCE_COUNT = 16 };
+    enum { ITERATIONS = 2000 };
+
+    FenceBenchmark() : mTimeline(-1) { }
+
+    virtual void SetUp() {
+        mTimeline = sw_sync_timeline_create();
+        if (mTimeline < 0) {
+            printf("sw_sync isn't available (%s), skipping\n", strerror(errno));
+        }
+    }
+
+    virtual void TearDown() {
+        if (mTimeline >= 0) {
+            close(mTimeline);
+        }
+    }
+
+    // a fence that signals when the timeline reaches value
+    sp<Fence> createFence(unsigned value) {
+        return new Fence(sw_sync_fence_create(mTimeline, "test", value));
+    }
+
+    // fences signaling at 1..FENCE_COUNT, one per timeline step
+    void createFences(FenceSet* set) {
+        for (unsigned i=1 ; i<=FENCE_COUNT ; i++) {
+            set->add(createFence(i));
+        }
+    }
+
+    void advance(unsigned count) {
+        sw_sync_timeline_inc(mTimeline, count);
+    }
+
+    int mTimeline;
+};
+
+TEST_F(FenceBenchmark, MergeMany) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    sp<Fence> merged = set.merge(String8("merged"));
+    ASSERT_TRUE(merged->isValid());
+    EXPECT_EQ(-ETIME, merged->wait(0));
+    advance(FENCE_COUNT - 1);
+    EXPECT_EQ(-ETIME, merged->wait(0));
+    advance(1);
+    EXPECT_EQ(NO_ERROR, merged->wait(0));
+}
+
+TEST_F(FenceBenchmark, MergeManySkipsInvalidFences) {
+    if (mTimeline < 0) return;
+    sp<Fence> fence = createFence(1);
+    sp<Fence> fences[] = { Fence::NO_FENCE, fence, Fence::NO_FENCE };
+    EXPECT_EQ(fence.get(), Fence::mergeMany(String8("one"), fences, 3).get());
+    EXPECT_EQ(Fence::NO_FENCE.get(),
+            Fence::mergeMany(String8("none"), fences, 1).get());
+}
+
+TEST_F(FenceBenchmark, Wait) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    set.add(createFence(2));
+    set.add(createFence(1));
+    EXPECT_EQ(-ETIME, set.waitAny(0));
+    EXPECT_EQ(-ETIME, set.waitAll(10));
+    advance(1);
+    EXPECT_EQ(1, set.waitAny(10));
+    EXPECT_EQ(-ETIME, set.waitAll(0));
+    advance(1);
+    EXPECT_EQ(NO_ERROR, set.waitAll(Fence::TIMEOUT_NEVER));
+
+    // invalid fences count as signaled
+    set.add(Fence::NO_FENCE);
+    EXPECT_EQ(2, set.waitAny(0));
+}
+
+TEST_F(FenceBenchmark, SignalTimes) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    nsecs_t earliest, latest;
+    ASSERT_EQ(NO_ERROR, set.getSignalTimes(&earliest, &latest));
+    EXPECT_EQ(INT64_MAX, earliest);
+    EXPECT_EQ(INT64_MAX, latest);
+
+    advance(1);
+    ASSERT_EQ(NO_ERROR, set.getSignalTimes(&earliest, &latest));
+    EXPECT_EQ(set[0]->getSignalTime(), earliest);
+    EXPECT_EQ(INT64_MAX, latest);
+
+    advance(FENCE_COUNT - 1);
+    ASSERT_EQ(NO_ERROR, set.getSignalTimes(&earliest, &latest));
+    EXPECT_EQ(set[FENCE_COUNT - 1]->getSignalTime(), latest);
+    EXPECT_LE(earliest, latest);
+    EXPECT_EQ(latest, set.getSignalTime());
+}
+
+TEST_F(FenceBenchmark, PairwiseMerge) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        sp<Fence> merged(Fence::NO_FENCE);
+        for (size_t j=0 ; j<set.size() ; j++) {
+            merged = Fence::merge(String8("pairwise"), merged, set[j]);
+        }
+    }
+    report("PairwiseMerge", systemTime() - start, ITERATIONS);
+}
+
+TEST_F(FenceBenchmark, MergeManyTiming) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        sp<Fence> merged(set.merge(String8("many")));
+    }
+    report("MergeMany", systemTime() - start, ITERATIONS);
+}
+
+TEST_F(FenceBenchmark, WaitEach) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    advance(FENCE_COUNT);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        for (size_t j=0 ; j<set.size() ; j++) {
+            set[j]->wait(Fence::TIMEOUT_NEVER);
+        }
+    }
+    report("WaitEach", systemTime() - start, ITERATIONS);
+}
+
+TEST_F(FenceBenchmark, WaitAll) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    advance(FENCE_COUNT);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        set.waitAll(Fence::TIMEOUT_NEVER);
+    }
+    report("WaitAll", systemTime() - start, ITERATIONS);
+}
+
+TEST_F(FenceBenchmark, SignalTimeEach) {
+    if (mTimeline < 0) return;
+    // half of the fences signaled
+    FenceSet set;
+    createFences(&set);
+    advance(FENCE_COUNT / 2);
+    nsecs_t latest = 0;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        for (size_t j=0 ; j<set.size() ; j++) {
+            nsecs_t t = set[j]->getSignalTime();
+            latest = t > latest ? t : latest;
+        }
+    }
+    report("SignalTimeEach", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(INT64_MAX, latest);
+}
+
+TEST_F(FenceBenchmark, SignalTimeSet) {
+    if (mTimeline < 0) return;
+    FenceSet set;
+    createFences(&set);
+    advance(FENCE_COUNT / 2);
+    nsecs_t latest = 0;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        latest = set.getSignalTime();
+    }
+    report("SignalTimeSet", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(INT64_MAX, latest);
+}
+
+}; // namespace android
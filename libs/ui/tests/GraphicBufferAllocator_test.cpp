@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferAllocatorTest"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/String8.h>
+#include <ui/GraphicBufferAllocator.h>
+#include <ui/PixelFormat.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+// The allocator's accounting, as dump() reports it. The allocator is shared
+// by the whole process, so the tests look at differences and at entries of
+// their own rather than at absolute totals.
+class GraphicBufferAllocatorTest : public testing::Test {
+protected:
+    enum { WIDTH = 64, HEIGHT = 32 };
+    enum { USAGE = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN };
+    // a pid that no test process has
+    enum { OWNER_PID = 0x7ffffff0 };
+
+    struct Stat {
+        size_t count;
+        float kib;
+    };
+
+    static String8 dump() {
+        String8 result;
+        GraphicBufferAllocator::get().dump(result);
+        return result;
+    }
+
+    // Looks for the line starting with 'key' in the given section of the
+    // dump, and returns its buffer count and size; a count of 0 if none.
+    static Stat findStat(const char* section, const char* key) {
+        Stat stat = { 0, 0 };
+        String8 d(dump());
+        const char* p = strstr(d.string(), section);
+        if (p == NULL) {
+            return stat;
+        }
+        p = strchr(p, '\n');
+        while (p && p[1] == ' ') {
+            const char* line = p + 1;
+            const char* colon = strchr(line, ':');
+            if (colon) {
+                String8 k(line, colon - line);
+                if (strstr(k.string(), key)) {
+                    sscanf(colon + 1, " %zu buffers, %f KiB", &stat.count, &stat.kib);
+                    return stat;
+                }
+            }
+            p = strchr(line, '\n');
+        }
+        return stat;
+    }
+
+    static float findTotal(const char* prefix, size_t* count) {
+        String8 d(dump());
+        const char* p = strstr(d.string(), prefix);
+        float kib = -1;
+        if (p) {
+            size_t n = 0;
+            sscanf(p + strlen(prefix), " %f KB in %zu buffers", &kib, &n);
+            if (count) {
+                *count = n;
+            }
+        }
+        return kib;
+    }
+
+    static buffer_handle_t allocate(PixelFormat format, int usage, int32_t* stride) {
+        buffer_handle_t handle = NULL;
+        EXPECT_EQ(NO_ERROR, GraphicBufferAllocator::get().alloc(WIDTH, HEIGHT,
+                format, usage, &handle, stride));
+        return handle;
+    }
+};
+
+TEST_F(GraphicBufferAllocatorTest, AccountsByFormatAndUsage) {
+    char format[16];
+    snprintf(format, sizeof(format), "%8X", PIXEL_FORMAT_RGB_565);
+    char usage[16];
+    snprintf(usage, sizeof(usage), "0x%08x", USAGE);
+    const Stat formatBefore = findStat("Allocated by format:", format);
+    const Stat usageBefore = findStat("Allocated by usage:", usage);
+
+    int32_t stride[2];
+    buffer_handle_t a = allocate(PIXEL_FORMAT_RGB_565, USAGE, &stride[0]);
+    buffer_handle_t b = allocate(PIXEL_FORMAT_RGB_565, USAGE, &stride[1]);
+    ASSERT_TRUE(a != NULL && b != NULL);
+    const float kib = HEIGHT * (stride[0] + stride[1]) * bytesPerPixel(PIXEL_FORMAT_RGB_565)
+            / 1024.0f;
+
+    Stat stat = findStat("Allocated by format:", format);
+    EXPECT_EQ(formatBefore.count + 2, stat.count);
+    EXPECT_NEAR(formatBefore.kib + kib, stat.kib, 0.01f);
+    stat = findStat("Allocated by usage:", usage);
+    EXPECT_EQ(usageBefore.count + 2, stat.count);
+    EXPECT_NEAR(usageBefore.kib + kib, stat.kib, 0.01f);
+
+    EXPECT_EQ(NO_ERROR, GraphicBufferAllocator::get().free(a));
+    EXPECT_EQ(NO_ERROR, GraphicBufferAllocator::get().free(b));
+    EXPECT_EQ(formatBefore.count, findStat("Allocated by format:", format).count);
+    EXPECT_EQ(usageBefore.count, findStat("Allocated by usage:", usage).count);
+}
+
+TEST_F(GraphicBufferAllocatorTest, AccountsToTheOwner) {
+    char self[16];
+    snprintf(self, sizeof(self), "pid %5d", getpid());
+    char owner[16];
+    snprintf(owner, sizeof(owner), "pid %5d", OWNER_PID);
+    const size_t selfBefore = findStat("Allocated by process:", self).count;
+
+    int32_t stride;
+    buffer_handle_t handle = allocate(PIXEL_FORMAT_RGBA_8888, USAGE, &stride);
+    ASSERT_TRUE(handle != NULL);
+    EXPECT_EQ(selfBefore + 1, findStat("Allocated by process:", self).count)
+            << "a buffer should be accounted to the process allocating it";
+
+    EXPECT_EQ(NO_ERROR, GraphicBufferAllocator::get().setOwner(handle, OWNER_PID));
+    EXPECT_EQ(selfBefore, findStat("Allocated by process:", self).count);
+    Stat stat = findStat("Allocated by process:", owner);
+    EXPECT_EQ(1U, stat.count);
+    EXPECT_NEAR(HEIGHT * stride * 4 / 1024.0f, stat.kib, 0.01f);
+
+    EXPECT_EQ(NO_ERROR, GraphicBufferAllocator::get().free(handle));
+    EXPECT_EQ(0U, findStat("Allocated by process:", owner).count)
+            << "a process should be dropped from the dump with its last buffer";
+    EXPECT_EQ(BAD_VALUE, GraphicBufferAllocator::get().setOwner(handle, OWNER_PID))
+            << "a freed buffer has no owner to change";
+}
+
+TEST_F(GraphicBufferAllocatorTest, TracksThePeak) {
+    enum { COUNT = 4 };
+    buffer_handle_t handles[COUNT];
+    int32_t stride;
+    for (size_t i = 0; i < COUNT; i++) {
+        handles[i] = allocate(PIXEL_FORMAT_RGBA_8888, USAGE, &stride);
+        ASSERT_TRUE(handles[i] != NULL);
+    }
+    size_t peakCount;
+    const float total = findTotal("Total allocated (estimate):", NULL);
+    const float peak = findTotal("Peak allocated (estimate):", &peakCount);
+    EXPECT_LE(total, peak + 0.01f);
+    EXPECT_LE(size_t(COUNT), peakCount);
+
+    for (size_t i = 0; i < COUNT; i++) {
+        EXPECT_EQ(NO_ERROR, GraphicBufferAllocator::get().free(handles[i]));
+    }
+    EXPECT_NEAR(total - COUNT * HEIGHT * stride * 4 / 1024.0f,
+            findTotal("Total allocated (estimate):", NULL), 0.01f);
+    EXPECT_NEAR(peak, findTotal("Peak allocated (estimate):", NULL), 0.01f)
+            << "freeing buffers should leave the peak alone";
+}
+
+} // namespace android
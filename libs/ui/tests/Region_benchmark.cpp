@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RegionBenchmark"
+
+#include <stdio.h>
+
+#include <utils/Timers.h>
+#include <ui/Region.h>
+#include <ui/Rect.h>
+#include <gtest/gtest.h>
+
+#include "BenchmarkHelpers.h"
+
+namespace android {
+
+// Region workloads modeled on what SurfaceFlinger does every frame. These
+// always pass; they print the time per iteration so that changes to Region
+// can be compared before and after.
+class RegionBenchmark : public testing::Test {
+protected:
+    struct TestLayer {
+        Rect bounds;
+        bool opaque;
+        Region visibleRegion;
+        Region coveredRegion;
+    };
+
+    enum { ITERATIONS = 20000 };
+
+    // a phone-like layer stack, bottom to top: wallpaper, launcher, an app,
+    // a dialog with a translucent dim behind it, status and navigation bars
+    static void makeLayerStack(TestLayer* layers, size_t* count) {
+        static const struct { Rect bounds; bool opaque; } kStack[] = {
+            { Rect(0, 0, 1080, 1920), true  },  // wallpaper
+            { Rect(0, 0, 1080, 1920), false },  // launcher
+            { Rect(0, 75, 1080, 1776), true },  // app
+            { Rect(0, 0, 1080, 1920), false },  // dim
+            { Rect(90, 600, 990, 1300), true }, // dialog
+            { Rect(0, 0, 1080, 75), false },    // status bar
+            { Rect(0, 1776, 1080, 1920), false } // navigation bar
+        };
+        *count = sizeof(kStack) / sizeof(kStack[0]);
+        for (size_t i=0 ; i<*count ; i++) {
+            layers[i].bounds = kStack[i].bounds;
+            layers[i].opaque = kStack[i].opaque;
+        }
+    }
+
+    // the body of SurfaceFlinger::computeVisibleRegions
+    static void computeVisibleRegions(TestLayer* layers, size_t count,
+            Region& outDirtyRegion, Region& outOpaqueRegion) {
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+        Region dirty;
+        Region opaqueRegion;
+        Region visibleRegion;
+        Region coveredRegion;
+        Region newExposed;
+        Region oldExposed;
+
+        outDirtyRegion.clear();
+        size_t i = count;
+        while (i--) {
+            TestLayer& layer(layers[i]);
+            opaqueRegion.clear();
+
+            visibleRegion.set(layer.bounds);
+            if (layer.opaque) {
+                opaqueRegion = visibleRegion;
+            }
+            aboveCoveredLayers.intersect(visibleRegion, &coveredRegion);
+            aboveCoveredLayers.orSelf(visibleRegion);
+            visibleRegion.subtractSelf(aboveOpaqueLayers);
+
+            visibleRegion.subtract(coveredRegion, &newExposed);
+            layer.visibleRegion.subtract(layer.coveredRegion, &oldExposed);
+            newExposed.subtractSelf(oldExposed);
+            visibleRegion.intersect(layer.coveredRegion, &dirty);
+            dirty.orSelf(newExposed);
+            dirty.subtractSelf(aboveOpaqueLayers);
+
+            outDirtyRegion.orSelf(dirty);
+            aboveOpaqueLayers.orSelf(opaqueRegion);
+
+            layer.visibleRegion = visibleRegion;
+            layer.coveredRegion = coveredRegion;
+        }
+        outOpaqueRegion = aboveOpaqueLayers;
+    }
+};
+
+TEST_F(RegionBenchmark, VisibleRegions) {
+    TestLayer layers[8];
+    size_t count;
+    makeLayerStack(layers, &count);
+
+    Region dirty;
+    Region opaque;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        computeVisibleRegions(layers, count, dirty, opaque);
+    }
+    report("VisibleRegions", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(Rect(0, 0, 1080, 1920), opaque.getBounds());
+}
+
+TEST_F(RegionBenchmark, SingleRectOperations) {
+    // the most common case by far: regions that are a single rect
+    const Rect screen(0, 0, 1080, 1920);
+    Region total;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        const int offset = int(i % 64);
+        Region a(Rect(offset, offset, 500 + offset, 500 + offset));
+        Region b(a);
+        b.andSelf(screen);
+        const Region c(b.intersect(screen));
+        total = c.merge(Rect(0, 0, 100, 100)).subtract(Rect(0, 0, 50, 50));
+    }
+    report("SingleRectOperations", systemTime() - start, ITERATIONS);
+    EXPECT_FALSE(total.isEmpty());
+}
+
+TEST_F(RegionBenchmark, DirtyRegionAccumulation) {
+    // dirty rects from a few layers accumulated into a display's dirty
+    // region, then clipped to the screen
+    const Rect screen(0, 0, 1080, 1920);
+    Region dirty;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        dirty.clear();
+        for (int j=0 ; j<6 ; j++) {
+            const int x = (int(i) * 37 + j * 180) % 900;
+            const int y = (int(i) * 53 + j * 300) % 1700;
+            dirty.orSelf(Rect(x, y, x + 120, y + 160));
+        }
+        dirty.andSelf(screen);
+    }
+    report("DirtyRegionAccumulation", systemTime() - start, ITERATIONS);
+    EXPECT_FALSE(dirty.isEmpty());
+}
+
+TEST_F(RegionBenchmark, CopyAndCompare) {
+    // layers copy regions between their current and drawing state and
+    // test them with isTriviallyEqual() when latching
+    Region requested(Rect(0, 0, 1080, 75));
+    size_t changes = 0;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        Region active(requested);
+        if (!active.isTriviallyEqual(requested)) {
+            changes++;
+        }
+        if ((i % 256) == 0) {
+            requested.set(Rect(0, 0, 1080, 75 + int(i % 3)));
+        }
+    }
+    report("CopyAndCompare", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(0U, changes);
+}
+
+// a 32x32 grid of disjoint rects, i.e. 1024 rects in 32 bands
+static Region makeGridRegion(int offset) {
+    Region r;
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            const int left = x * 32 + offset;
+            const int top = y * 32 + offset;
+            r.addRectUnchecked(left, top, left + 24, top + 24);
+        }
+    }
+    r.orSelf(Rect(0, 0));   // fix up the bounds
+    return r;
+}
+
+TEST_F(RegionBenchmark, LargeRegionIntersectRect) {
+    const Region grid(makeGridRegion(0));
+    ASSERT_EQ(1024, grid.end() - grid.begin());
+    Region result;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS / 10 ; i++) {
+        const int offset = int(i % 128);
+        result = grid.intersect(Rect(offset, offset, 512 + offset, 512 + offset));
+    }
+    report("LargeRegionIntersectRect", systemTime() - start, ITERATIONS / 10);
+    EXPECT_FALSE(result.isEmpty());
+}
+
+TEST_F(RegionBenchmark, LargeRegionIntersect) {
+    const Region a(makeGridRegion(0));
+    const Region b(makeGridRegion(12));
+    Region result;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS / 100 ; i++) {
+        result = a.intersect(b);
+    }
+    report("LargeRegionIntersect", systemTime() - start, ITERATIONS / 100);
+    // each cell overlaps two cells of the other grid in x and in y
+    EXPECT_EQ(63 * 63, result.end() - result.begin());
+}
+
+TEST_F(RegionBenchmark, LargeRegionUnion) {
+    const Region a(makeGridRegion(0));
+    const Region b(makeGridRegion(12));
+    Region result;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS / 100 ; i++) {
+        result = a.merge(b);
+    }
+    report("LargeRegionUnion", systemTime() - start, ITERATIONS / 100);
+    EXPECT_FALSE(result.isEmpty());
+}
+
+TEST_F(RegionBenchmark, LargeRegionUnionInto) {
+    // same as above, into a destination that is reused
+    const Region a(makeGridRegion(0));
+    const Region b(makeGridRegion(12));
+    Region result;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS / 100 ; i++) {
+        a.merge(b, &result);
+    }
+    report("LargeRegionUnionInto", systemTime() - start, ITERATIONS / 100);
+    EXPECT_FALSE(result.isEmpty());
+}
+
+TEST_F(RegionBenchmark, LargeRegionSelfOperations) {
+    // in-place operations on a large region, which trade storage with the
+    // scratch region instead of allocating a new one each time
+    const Region grid(makeGridRegion(0));
+    Region r(grid);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS / 100 ; i++) {
+        r.subtractSelf(Rect(0, 0, 512, 512));
+        r.orSelf(grid);
+    }
+    report("LargeRegionSelfOperations", systemTime() - start, ITERATIONS / 100);
+    EXPECT_EQ(1024, r.end() - r.begin());
+}
+
+TEST_F(RegionBenchmark, TJunctionFree) {
+    // a staircase, where every band has to be split at the edges of all
+    // the others
+    Region stairs;
+    for (int i = 0; i < 16; i++) {
+        stairs.orSelf(Rect(i * 8, i * 8, i * 8 + 64, i * 8 + 8));
+    }
+    const Region grid(makeGridRegion(0));
+    size_t count = 0;
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS / 10 ; i++) {
+        Region r(stairs);
+        r.orSelf(grid);
+        count += Region::createTJunctionFreeRegion(r).end() - r.begin();
+    }
+    report("TJunctionFree", systemTime() - start, ITERATIONS / 10);
+    EXPECT_NE(0U, count);
+}
+
+TEST_F(RegionBenchmark, LargeRegionTranslate) {
+    Region r(makeGridRegion(0));
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        r.translateSelf((i & 1) ? -3 : 3, (i & 1) ? -5 : 5);
+    }
+    report("LargeRegionTranslate", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(Rect(0, 0, 1016, 1016), r.getBounds());
+}
+
+}; // namespace android
@@ -17,6 +17,8 @@
 #define LOG_TAG "RegionTest"
 
 #include <stdlib.h>
+#include <string.h>
+#include <utils/SharedBuffer.h>
 #include <ui/Region.h>
 #include <ui/Rect.h>
 #include <gtest/gtest.h>
@@ -152,5 +154,368 @@ TEST_F(RegionTest, Random_TJunction) {
     }
 }
 
+TEST_F(RegionTest, InlineAndSpilledStorage) {
+    // grow a region one rect at a time, past the inline capacity, and make
+    // sure copies taken along the way aren't affected
+    Region r;
+    Region copies[8];
+    for (int i = 0; i < 8; i++) {
+        copies[i] = r;
+        r.orSelf(Rect(i * 2, i * 2, i * 2 + 1, i * 2 + 1));
+        EXPECT_EQ(i + 1, r.end() - r.begin());
+        EXPECT_EQ(Rect(0, 0, i * 2 + 1, i * 2 + 1), r.getBounds());
+    }
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(i == 0 ? 1 : i, copies[i].end() - copies[i].begin());
+    }
+
+    // and shrink it back to a single rect
+    r.andSelf(Rect(0, 0, 1, 1));
+    EXPECT_TRUE(r.isRect());
+    EXPECT_EQ(Rect(0, 0, 1, 1), r.getBounds());
+}
+
+TEST_F(RegionTest, SelfOperations) {
+    // operands aliasing the destination
+    Region r;
+    for (int i = 0; i < 8; i++) {
+        Region expected(r.merge(Rect(i, i * 2, i + 4, i * 2 + 1)));
+        r.orSelf(Rect(i, i * 2, i + 4, i * 2 + 1));
+        EXPECT_TRUE((expected ^ r).isEmpty());
+
+        r.orSelf(r);
+        EXPECT_TRUE((expected ^ r).isEmpty());
+        Region tmp(r);
+        tmp.subtractSelf(tmp);
+        EXPECT_TRUE(tmp.isEmpty());
+        tmp = r;
+        tmp.andSelf(*tmp.begin());
+        EXPECT_EQ(*r.begin(), tmp.getBounds());
+    }
+}
+
+TEST_F(RegionTest, TriviallyEqual) {
+    Region a(Rect(0, 0, 10, 10));
+    Region b(a);
+    EXPECT_TRUE(a.isTriviallyEqual(b));
+    b.set(Rect(0, 0, 10, 11));
+    EXPECT_FALSE(a.isTriviallyEqual(b));
+
+    for (int i = 0; i < 8; i++) {
+        a.orSelf(Rect(i * 20, i * 20, i * 20 + 10, i * 20 + 10));
+    }
+    b = a;
+    EXPECT_TRUE(a.isTriviallyEqual(b));
+    b.orSelf(Rect(1000, 1000, 1001, 1001));
+    EXPECT_FALSE(a.isTriviallyEqual(b));
+}
+
+TEST_F(RegionTest, SharedBufferAndFlatten) {
+    for (int n = 1; n < 8; n++) {
+        Region r;
+        for (int i = 0; i < n; i++) {
+            r.orSelf(Rect(i * 2, i * 2, i * 2 + 1, i * 2 + 1));
+        }
+
+        size_t count;
+        SharedBuffer const* sb = r.getSharedBuffer(&count);
+        ASSERT_TRUE(sb != NULL);
+        EXPECT_EQ(size_t(n), count);
+        EXPECT_EQ(0, memcmp(sb->data(), r.begin(), count * sizeof(Rect)));
+        sb->release();
+
+        const size_t size = r.getFlattenedSize();
+        uint8_t buffer[size];
+        ASSERT_EQ(NO_ERROR, r.flatten(buffer, size));
+        Region copy;
+        ASSERT_EQ(NO_ERROR, copy.unflatten(buffer, size));
+        EXPECT_EQ(r.end() - r.begin(), copy.end() - copy.begin());
+        EXPECT_TRUE((r ^ copy).isEmpty());
+        EXPECT_EQ(r.getBounds(), copy.getBounds());
+    }
+}
+
+TEST_F(RegionTest, ReusedDestination) {
+    Region a;
+    Region b;
+    for (int i = 0; i < 16; i++) {
+        a.orSelf(Rect(i * 10, i * 10, i * 10 + 5, i * 10 + 5));
+        b.orSelf(Rect(i * 10 + 2, i * 10, i * 10 + 7, i * 10 + 5));
+    }
+
+    // a destination recomputed with results of the same size keeps its
+    // storage
+    Region dst;
+    a.merge(b, &dst);
+    ASSERT_EQ(16, dst.end() - dst.begin());
+    const Rect* storage = dst.begin();
+    for (int i = 0; i < 8; i++) {
+        a.intersect(b, &dst);
+        a.merge(b, &dst);
+        EXPECT_EQ(storage, dst.begin());
+    }
+
+    // shrinking inline and growing again reuses it too
+    a.intersect(Rect(0, 0, 5, 5), &dst);
+    EXPECT_TRUE(dst.isRect());
+    a.merge(b, &dst);
+    EXPECT_EQ(storage, dst.begin());
+    EXPECT_TRUE((dst ^ (a | b)).isEmpty());
+
+    // the spare rects past the end of the storage are not counted
+    a.subtract(Rect(0, 0, 40, 40), &dst);
+    size_t count;
+    SharedBuffer const* sb = dst.getSharedBuffer(&count);
+    ASSERT_TRUE(sb != NULL);
+    EXPECT_EQ(size_t(dst.end() - dst.begin()), count);
+
+    // a destination whose storage is still referenced elsewhere doesn't
+    // write over it
+    const Region copy(dst);
+    a.merge(b, &dst);
+    EXPECT_EQ(0, memcmp(sb->data(), copy.begin(), count * sizeof(Rect)));
+    sb->release();
+    EXPECT_TRUE((copy ^ a.subtract(Rect(0, 0, 40, 40))).isEmpty());
+}
+
+TEST_F(RegionTest, DisjointRects) {
+    srand(7);
+    for (int iteration = 0; iteration < 100; iteration++) {
+        Region r;
+        for (int i = 0; i < 32; i++) {
+            const int left = rand() % 200;
+            const int top = rand() % 200;
+            r.orSelf(Rect(left, top, left + 1 + rand() % 50, top + 1 + rand() % 50));
+        }
+
+        // the rects of a region, reversed and with x and y swapped: the
+        // region rotated by 90 degrees and flipped
+        size_t count;
+        Rect const* rects = r.getArray(&count);
+        Vector<Rect> swapped;
+        Region expected;
+        for (size_t i = count; i-- > 0;) {
+            const Rect s(rects[i].top, rects[i].left,
+                    rects[i].bottom, rects[i].right);
+            swapped.add(s);
+            expected.orSelf(s);
+        }
+        swapped.add(Rect(5, 5, 5, 5));  // empty rects are ignored
+
+        Region result;
+        result.setDisjointRects(swapped.array(), swapped.size());
+        ASSERT_EQ(expected.end() - expected.begin(), result.end() - result.begin());
+        EXPECT_EQ(0, memcmp(expected.begin(), result.begin(),
+                (expected.end() - expected.begin()) * sizeof(Rect)));
+        EXPECT_EQ(expected.getBounds(), result.getBounds());
+
+        // rects that are already in order, the region's own included
+        result.setDisjointRects(rects, count);
+        EXPECT_TRUE((result ^ r).isEmpty());
+        result.setDisjointRects(result.begin(), result.end() - result.begin());
+        EXPECT_TRUE((result ^ r).isEmpty());
+    }
+
+    Region empty;
+    empty.setDisjointRects(NULL, 0);
+    EXPECT_TRUE(empty.isEmpty());
+    const Rect one(1, 2, 3, 4);
+    empty.setDisjointRects(&one, 1);
+    EXPECT_TRUE(empty.isRect());
+    EXPECT_EQ(one, empty.getBounds());
+}
+
+// Randomized differential tests: the result of every operation is checked,
+// rect by rect, against the canonical banded representation of the same
+// set computed on a bitmap.
+class RegionOperationTest : public testing::Test {
+protected:
+    enum { SIZE = 64, ORIGIN = 16, RANGE = 32 };
+
+    struct Bitmap {
+        bool pixels[SIZE][SIZE];
+        Bitmap() { memset(pixels, 0, sizeof(pixels)); }
+        bool& at(int x, int y) { return pixels[y + ORIGIN][x + ORIGIN]; }
+    };
+
+    static Bitmap toBitmap(const Region& r, int dx = 0, int dy = 0) {
+        Bitmap b;
+        for (const Rect* rect = r.begin(); rect != r.end(); rect++) {
+            for (int y = rect->top; y < rect->bottom; y++) {
+                for (int x = rect->left; x < rect->right; x++) {
+                    b.at(x + dx, y + dy) = true;
+                }
+            }
+        }
+        return b;
+    }
+
+    // rects of the canonical representation: maximal horizontal runs,
+    // vertically adjacent rows with identical runs merged into one band
+    static void canonicalRects(Bitmap& b, Vector<Rect>& rects, Rect& bounds) {
+        rects.clear();
+        bounds = Rect(0, 0);
+        bool first = true;
+        size_t bandStart = 0;
+        for (int y = -ORIGIN; y < SIZE - ORIGIN; y++) {
+            Vector<Rect> row;
+            for (int x = -ORIGIN; x < SIZE - ORIGIN; x++) {
+                if (b.at(x, y)) {
+                    int end = x;
+                    while (end < SIZE - ORIGIN && b.at(end, y)) end++;
+                    row.add(Rect(x, y, end, y + 1));
+                    x = end;
+                }
+            }
+            bool extend = row.size() && row.size() == rects.size() - bandStart
+                    && rects[bandStart].bottom == y;
+            for (size_t i = 0; extend && i < row.size(); i++) {
+                extend = row[i].left == rects[bandStart + i].left &&
+                        row[i].right == rects[bandStart + i].right;
+            }
+            if (extend) {
+                for (size_t i = bandStart; i < rects.size(); i++) {
+                    rects.editItemAt(i).bottom = y + 1;
+                }
+            } else if (row.size()) {
+                bandStart = rects.size();
+                rects.appendVector(row);
+            }
+            for (size_t i = 0; i < row.size(); i++) {
+                if (first) {
+                    bounds = row[i];
+                    first = false;
+                } else {
+                    if (row[i].left < bounds.left) bounds.left = row[i].left;
+                    if (row[i].right > bounds.right) bounds.right = row[i].right;
+                    bounds.bottom = y + 1;
+                }
+            }
+        }
+    }
+
+    static Region randomRegion(size_t maxRects) {
+        Region r;
+        const size_t count = random() % (maxRects + 1);
+        for (size_t i = 0; i < count; i++) {
+            const int x = random() % RANGE;
+            const int y = random() % RANGE;
+            r.orSelf(Rect(x, y, x + 1 + random() % (RANGE - x),
+                    y + 1 + random() % (RANGE - y)));
+        }
+        return r;
+    }
+
+    static void expectEqual(const Region& r, Bitmap& expected, const char* what) {
+        Vector<Rect> rects;
+        Rect bounds;
+        canonicalRects(expected, rects, bounds);
+        if (rects.isEmpty()) {
+            // an empty region holds a single, empty, rect
+            ASSERT_TRUE(r.isEmpty()) << what;
+            ASSERT_EQ(Rect(0, 0), r.getBounds()) << what;
+            return;
+        }
+        ASSERT_EQ(ssize_t(rects.size()), r.end() - r.begin()) << what;
+        for (size_t i = 0; i < rects.size(); i++) {
+            ASSERT_EQ(rects[i], r.begin()[i]) << what << " rect " << i;
+        }
+        ASSERT_EQ(bounds, r.getBounds()) << what;
+    }
+
+    static void checkOperations(const Region& a, const Region& b, int dx, int dy) {
+        Bitmap pa = toBitmap(a);
+        Bitmap pb = toBitmap(b, dx, dy);
+        Bitmap pOr, pAnd, pSub, pXor;
+        for (int y = 0; y < SIZE; y++) {
+            for (int x = 0; x < SIZE; x++) {
+                pOr.pixels[y][x] = pa.pixels[y][x] || pb.pixels[y][x];
+                pAnd.pixels[y][x] = pa.pixels[y][x] && pb.pixels[y][x];
+                pSub.pixels[y][x] = pa.pixels[y][x] && !pb.pixels[y][x];
+                pXor.pixels[y][x] = pa.pixels[y][x] != pb.pixels[y][x];
+            }
+        }
+        if (dx || dy) {
+            expectEqual(a.merge(b, dx, dy), pOr, "merge");
+            expectEqual(a.intersect(b, dx, dy), pAnd, "intersect");
+            expectEqual(a.subtract(b, dx, dy), pSub, "subtract");
+            expectEqual(a.mergeExclusive(b, dx, dy), pXor, "mergeExclusive");
+            Region r(a);
+            expectEqual(r.andSelf(b, dx, dy), pAnd, "andSelf");
+            expectEqual(b.translate(dx, dy), pb, "translate");
+        } else {
+            expectEqual(a.merge(b), pOr, "merge");
+            expectEqual(a.intersect(b), pAnd, "intersect");
+            expectEqual(a.subtract(b), pSub, "subtract");
+            expectEqual(a.mergeExclusive(b), pXor, "mergeExclusive");
+            Region r(a);
+            expectEqual(r.andSelf(b), pAnd, "andSelf");
+
+            // into a destination holding a previous result, or aliasing
+            // either operand
+            Region dst(b);
+            a.merge(b, &dst);
+            expectEqual(dst, pOr, "merge into");
+            a.subtract(b, &dst);
+            expectEqual(dst, pSub, "subtract into");
+            r = a;
+            r.mergeExclusive(b, &r);
+            expectEqual(r, pXor, "mergeExclusive into lhs");
+            r = b;
+            a.intersect(r, &r);
+            expectEqual(r, pAnd, "intersect into rhs");
+
+            if (b.isRect()) {
+                expectEqual(a.merge(b.getBounds()), pOr, "merge rect");
+                expectEqual(a.intersect(b.getBounds()), pAnd, "intersect rect");
+                expectEqual(a.subtract(b.getBounds()), pSub, "subtract rect");
+                expectEqual(a.mergeExclusive(b.getBounds()), pXor,
+                        "mergeExclusive rect");
+                a.intersect(b.getBounds(), &dst);
+                expectEqual(dst, pAnd, "intersect rect into");
+                r = a;
+                r.merge(b.getBounds(), &r);
+                expectEqual(r, pOr, "merge rect into lhs");
+            }
+        }
+    }
+};
+
+TEST_F(RegionOperationTest, RandomRegions) {
+    srandom(4321);
+    for (int iter = 0; iter < 2000; iter++) {
+        Region a(randomRegion(8));
+        Region b(randomRegion(8));
+        checkOperations(a, b, 0, 0);
+        checkOperations(b, a, 0, 0);
+        ASSERT_FALSE(HasFatalFailure()) << "iteration " << iter;
+    }
+}
+
+TEST_F(RegionOperationTest, RandomRects) {
+    // single rects take the fast path on either side of an intersection
+    srandom(1234);
+    for (int iter = 0; iter < 2000; iter++) {
+        Region a(randomRegion(8));
+        Region b(randomRegion(1));
+        checkOperations(a, b, 0, 0);
+        checkOperations(b, a, 0, 0);
+        ASSERT_FALSE(HasFatalFailure()) << "iteration " << iter;
+    }
+}
+
+TEST_F(RegionOperationTest, RandomTranslatedRegions) {
+    srandom(5678);
+    for (int iter = 0; iter < 2000; iter++) {
+        Region a(randomRegion(8));
+        Region b(randomRegion(iter % 2 ? 1 : 8));
+        const int dx = int(random() % 17) - 8;
+        const int dy = int(random() % 17) - 8;
+        checkOperations(a, b, dx, dy);
+        checkOperations(b, a, dx, dy);
+        ASSERT_FALSE(HasFatalFailure()) << "iteration " << iter;
+    }
+}
+
 }; // namespace android
 
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MatBenchmark"
+
+#include <stdlib.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+
+#include "BenchmarkHelpers.h"
+
+#include <ui/vec4.h>
+#include <ui/mat4.h>
+
+namespace android {
+
+// The float mat4 and vec4 operations that have vector specializations. Each
+// test checks that the result of its loop is still sane, so that the loop
+// isn't optimized away.
+class MatBenchmark : public testing::Test {
+protected:
+    enum { ITERATIONS = 1000000 };
+
+    // a well conditioned matrix: random in [-1, 1] plus a dominant diagonal
+    static mat4 random() {
+        mat4 m(mat4::NO_INIT);
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                m[c][r] = (rand() / float(RAND_MAX)) * 2 - 1 + (c == r ? 4 : 0);
+            }
+        }
+        return m;
+    }
+
+    static vec4 randomVec() {
+        return vec4(rand(), rand(), rand(), rand()) / float(RAND_MAX) * 2 - 1;
+    }
+
+    static void expectNear(const mat4& expected, const mat4& actual, float error) {
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                EXPECT_NEAR(expected[c][r], actual[c][r], error);
+            }
+        }
+    }
+};
+
+TEST_F(MatBenchmark, Multiply) {
+    srand(4);
+    const mat4 original(random());
+    const mat4 b(random());
+    const mat4 bi(inverse(b));
+    mat4 a(original);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i+=2) {
+        // b and its inverse, so that a stays bounded
+        a = a * b;
+        a = a * bi;
+    }
+    report("mat4 * mat4", systemTime() - start, ITERATIONS);
+    expectNear(original, a, 1e-2f);
+}
+
+TEST_F(MatBenchmark, Transpose) {
+    srand(5);
+    mat4 m(random());
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        m = transpose(m);
+    }
+    report("transpose(mat4)", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(m, transpose(transpose(m)));
+}
+
+TEST_F(MatBenchmark, Inverse) {
+    srand(6);
+    mat4 m(random());
+    const mat4 original(m);
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        m = inverse(m);
+    }
+    report("inverse(mat4)", systemTime() - start, ITERATIONS);
+    // an even number of inversions
+    expectNear(original, m, 1e-3f);
+}
+
+TEST_F(MatBenchmark, MatrixProducts) {
+    srand(2);
+    // scaled down so that repeated products shrink rather than overflow
+    const mat4 m(random() * 0.1f);
+    vec4 v(randomVec());
+    nsecs_t start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        v = m * v;
+    }
+    report("mat4 * vec4", systemTime() - start, ITERATIONS);
+
+    v = randomVec();
+    start = systemTime();
+    for (size_t i=0 ; i<ITERATIONS ; i++) {
+        v = v * m;
+    }
+    report("vec4 * mat4", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(v, v);
+}
+
+}; // namespace android
@@ -27,6 +27,47 @@ namespace android {
 
 class MatTest : public testing::Test {
 protected:
+    // a well conditioned matrix: random in [-1, 1] plus a dominant diagonal
+    static mat4 random() {
+        mat4 m(mat4::NO_INIT);
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                m[c][r] = (rand() / float(RAND_MAX)) * 2 - 1 + (c == r ? 4 : 0);
+            }
+        }
+        return m;
+    }
+
+    // the generic algorithms, written out with scalars
+    static mat4 multiply(const mat4& lhs, const mat4& rhs) {
+        mat4 res(mat4::NO_INIT);
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                float v = 0;
+                for (size_t k=0 ; k<4 ; k++) {
+                    v += lhs[k][r] * rhs[c][k];
+                }
+                res[c][r] = v;
+            }
+        }
+        return res;
+    }
+
+    static void expectFloatEq(const mat4& expected, const mat4& actual) {
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                EXPECT_FLOAT_EQ(expected[c][r], actual[c][r]);
+            }
+        }
+    }
+
+    static void expectNear(const mat4& expected, const mat4& actual, float error) {
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                EXPECT_NEAR(expected[c][r], actual[c][r], error);
+            }
+        }
+    }
 };
 
 TEST_F(MatTest, Basics) {
@@ -136,4 +177,60 @@ TEST_F(MatTest, MiscOps) {
     EXPECT_EQ(m1, m1*identity);
 }
 
+TEST_F(MatTest, Multiply) {
+    srand(1);
+    for (size_t i=0 ; i<100 ; i++) {
+        const mat4 a(random());
+        const mat4 b(random());
+        expectFloatEq(multiply(a, b), a * b);
+    }
+
+    mat4 m1(vec4(1,2,3,4), vec4(5,6,7,8), vec4(9,10,11,12), vec4(13,14,15,16));
+    EXPECT_EQ(mat4(vec4(90,100,110,120), vec4(202,228,254,280),
+            vec4(314,356,398,440), vec4(426,484,542,600)), m1*m1);
+}
+
+TEST_F(MatTest, Transpose) {
+    srand(2);
+    for (size_t i=0 ; i<100 ; i++) {
+        const mat4 m(random());
+        const mat4 t(transpose(m));
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                EXPECT_EQ(m[c][r], t[r][c]);
+            }
+        }
+        EXPECT_EQ(m, transpose(t));
+    }
+}
+
+TEST_F(MatTest, Inverse) {
+    srand(3);
+    const mat4 identity;
+    for (size_t i=0 ; i<100 ; i++) {
+        const mat4 m(random());
+        const mat4 mi(inverse(m));
+        expectNear(identity, m * mi, 1e-5f);
+        expectNear(identity, mi * m, 1e-5f);
+
+        // against the generic inverse, in double precision
+        tmat44<double> md(tmat44<double>::NO_INIT);
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                md[c][r] = m[c][r];
+            }
+        }
+        const tmat44<double> mdi(inverse(md));
+        for (size_t c=0 ; c<4 ; c++) {
+            for (size_t r=0 ; r<4 ; r++) {
+                EXPECT_NEAR(mdi[c][r], mi[c][r], 1e-5);
+            }
+        }
+    }
+
+    // rows need swapping
+    const mat4 p(vec4(0,1,0,0), vec4(1,0,0,0), vec4(0,0,0,1), vec4(0,0,1,0));
+    EXPECT_EQ(p, inverse(p));
+}
+
 }; // namespace android
@@ -22,11 +22,23 @@
 #include <gtest/gtest.h>
 
 #include <ui/vec4.h>
+#include <ui/mat4.h>
 
 namespace android {
 
 class VecTest : public testing::Test {
 protected:
+    static float random() {
+        return (rand() / float(RAND_MAX)) * 2 - 1;
+    }
+
+    static vec4 randomVec() {
+        return vec4(random(), random(), random(), random());
+    }
+
+    static mat4 randomMat() {
+        return mat4(randomVec(), randomVec(), randomVec(), randomVec());
+    }
 };
 
 TEST_F(VecTest, Basics) {
@@ -253,4 +265,33 @@ TEST_F(VecTest, ArithmeticFunc) {
     EXPECT_EQ(length(vd), 1);
 }
 
+TEST_F(VecTest, MatrixProducts) {
+    srand(1);
+    for (size_t i=0 ; i<100 ; i++) {
+        const mat4 m(randomMat());
+        const vec4 v(randomVec());
+
+        // the columns of m weighted by v
+        const vec4 mv(m * v);
+        for (size_t r=0 ; r<4 ; r++) {
+            float e = 0;
+            for (size_t c=0 ; c<4 ; c++) {
+                e += m[c][r] * v[c];
+            }
+            EXPECT_FLOAT_EQ(e, mv[r]);
+        }
+
+        // the dot products of v with the columns of m
+        const vec4 vm(v * m);
+        for (size_t c=0 ; c<4 ; c++) {
+            EXPECT_FLOAT_EQ(dot(v, m[c]), vm[c]);
+        }
+        EXPECT_EQ(vm, transpose(m) * v);
+    }
+
+    const mat4 m(vec4(1,2,3,4), vec4(5,6,7,8), vec4(9,10,11,12), vec4(13,14,15,16));
+    EXPECT_EQ(vec4(90,100,110,120), m * vec4(1,2,3,4));
+    EXPECT_EQ(vec4(30,70,110,150), vec4(1,2,3,4) * m);
+}
+
 }; // namespace android
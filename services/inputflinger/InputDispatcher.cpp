@@ -88,6 +88,10 @@ const nsecs_t SLOW_EVENT_PROCESSING_WARNING_TIMEOUT = 2000 * 1000000LL; // 2sec
 // Number of recent events to keep for debugging purposes.
 const size_t RECENT_QUEUE_MAX_SIZE = 10;
 
+// Number of released entries of each type to keep for reuse.  This covers the events in
+// flight during a fast multi-touch gesture dispatched to a few windows.
+const size_t ENTRY_POOL_MAX_FREE = 32;
+
 static inline nsecs_t now() {
     return systemTime(SYSTEM_TIME_MONOTONIC);
 }
@@ -471,8 +475,9 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
     // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
+    InputWindowIndex::Iterator it(mWindowIndex, displayId, x, y);
+    size_t i;
+    while (it.next(&i)) {
         sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         if (windowInfo->displayId == displayId) {
@@ -1187,8 +1192,9 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         bool isTouchModal = false;
 
         // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
+        InputWindowIndex::Iterator it(mWindowIndex, displayId, x, y);
+        size_t i;
+        while (it.next(&i)) {
             sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             if (windowInfo->displayId != displayId) {
@@ -1600,12 +1606,13 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
     int32_t displayId = windowHandle->getInfo()->displayId;
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
+    // Only the windows in front of this one can obscure it.
+    ssize_t windowIndex = mWindowIndex.indexOf(windowHandle);
+    size_t end = windowIndex >= 0 ? size_t(windowIndex) : mWindowHandles.size();
+    InputWindowIndex::Iterator it(mWindowIndex, displayId, x, y);
+    size_t i;
+    while (it.next(&i) && i < end) {
         sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
-            break;
-        }
 
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherInfo->displayId == displayId
@@ -1924,76 +1931,41 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
 
     while (connection->status == Connection::STATUS_NORMAL
             && !connection->outboundQueue.isEmpty()) {
-        DispatchEntry* dispatchEntry = connection->outboundQueue.head;
-        dispatchEntry->deliveryTime = currentTime;
-
-        // Publish the event.
-        status_t status;
-        EventEntry* eventEntry = dispatchEntry->eventEntry;
-        switch (eventEntry->type) {
-        case EventEntry::TYPE_KEY: {
-            KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
-
-            // Publish the key event.
-            status = connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
-                    keyEntry->deviceId, keyEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    keyEntry->keyCode, keyEntry->scanCode,
-                    keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
-                    keyEntry->eventTime);
-            break;
-        }
-
-        case EventEntry::TYPE_MOTION: {
-            MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
-
-            PointerCoords scaledCoords[MAX_POINTERS];
-            const PointerCoords* usingCoords = motionEntry->pointerCoords;
-
-            // Set the X and Y offset depending on the input source.
-            float xOffset, yOffset, scaleFactor;
-            if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
-                    && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
-                scaleFactor = dispatchEntry->scaleFactor;
-                xOffset = dispatchEntry->xOffset * scaleFactor;
-                yOffset = dispatchEntry->yOffset * scaleFactor;
-                if (scaleFactor != 1.0f) {
-                    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i] = motionEntry->pointerCoords[i];
-                        scaledCoords[i].scale(scaleFactor);
-                    }
-                    usingCoords = scaledCoords;
-                }
-            } else {
-                xOffset = 0.0f;
-                yOffset = 0.0f;
-                scaleFactor = 1.0f;
-
-                // We don't want the dispatch target to know.
-                if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
-                    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i].clear();
-                    }
-                    usingCoords = scaledCoords;
-                }
+        // Build the messages for as many outbound events as fit in a batch, then publish
+        // them together.  A backed up queue (say from a fast stylus) is then flushed with
+        // one system call instead of one per event.
+        status_t status = OK;
+        size_t count = 0;
+        for (DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+                dispatchEntry && count < OUTBOUND_BATCH_SIZE;
+                dispatchEntry = dispatchEntry->next) {
+            dispatchEntry->deliveryTime = currentTime;
+            status = buildDispatchMessageLocked(connection, dispatchEntry,
+                    &mOutboundMessages[count]);
+            if (status) {
+                break;
+            }
+            count += 1;
+        }
+
+        // Publish the events.  The events ahead of one that could not be built are still
+        // published, as they would have been one at a time.
+        size_t published = 0;
+        if (count) {
+            status_t publishStatus = connection->inputPublisher.publishMessages(
+                    mOutboundMessages, count, &published);
+            if (publishStatus) {
+                status = publishStatus;
             }
+        }
 
-            // Publish the motion event.
-            status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
-                    motionEntry->deviceId, motionEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
-                    xOffset, yOffset,
-                    motionEntry->xPrecision, motionEntry->yPrecision,
-                    motionEntry->downTime, motionEntry->eventTime,
-                    motionEntry->pointerCount, motionEntry->pointerProperties,
-                    usingCoords);
-            break;
-        }
-
-        default:
-            ALOG_ASSERT(false);
-            return;
+        // Re-enqueue the published events on the wait queue.
+        for (size_t i = 0; i < published; i++) {
+            DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+            connection->outboundQueue.dequeue(dispatchEntry);
+            traceOutboundQueueLengthLocked(connection);
+            connection->waitQueue.enqueueAtTail(dispatchEntry);
+            traceWaitQueueLengthLocked(connection);
         }
 
         // Check the result.
@@ -2022,12 +1994,72 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             }
             return;
         }
+    }
+}
 
-        // Re-enqueue the event on the wait queue.
-        connection->outboundQueue.dequeue(dispatchEntry);
-        traceOutboundQueueLengthLocked(connection);
-        connection->waitQueue.enqueueAtTail(dispatchEntry);
-        traceWaitQueueLengthLocked(connection);
+status_t InputDispatcher::buildDispatchMessageLocked(const sp<Connection>& connection,
+        const DispatchEntry* dispatchEntry, InputMessage* outMsg) {
+    EventEntry* eventEntry = dispatchEntry->eventEntry;
+    switch (eventEntry->type) {
+    case EventEntry::TYPE_KEY: {
+        KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
+
+        return connection->inputPublisher.buildKeyMessage(outMsg, dispatchEntry->seq,
+                keyEntry->deviceId, keyEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                keyEntry->keyCode, keyEntry->scanCode,
+                keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
+                keyEntry->eventTime);
+    }
+
+    case EventEntry::TYPE_MOTION: {
+        MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
+
+        PointerCoords scaledCoords[MAX_POINTERS];
+        const PointerCoords* usingCoords = motionEntry->pointerCoords;
+
+        // Set the X and Y offset depending on the input source.
+        float xOffset, yOffset, scaleFactor;
+        if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
+                && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
+            scaleFactor = dispatchEntry->scaleFactor;
+            xOffset = dispatchEntry->xOffset * scaleFactor;
+            yOffset = dispatchEntry->yOffset * scaleFactor;
+            if (scaleFactor != 1.0f) {
+                for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i] = motionEntry->pointerCoords[i];
+                    scaledCoords[i].scale(scaleFactor);
+                }
+                usingCoords = scaledCoords;
+            }
+        } else {
+            xOffset = 0.0f;
+            yOffset = 0.0f;
+            scaleFactor = 1.0f;
+
+            // We don't want the dispatch target to know.
+            if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
+                for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i].clear();
+                }
+                usingCoords = scaledCoords;
+            }
+        }
+
+        return connection->inputPublisher.buildMotionMessage(outMsg, dispatchEntry->seq,
+                motionEntry->deviceId, motionEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
+                xOffset, yOffset,
+                motionEntry->xPrecision, motionEntry->yPrecision,
+                motionEntry->downTime, motionEntry->eventTime,
+                motionEntry->pointerCount, motionEntry->pointerProperties,
+                usingCoords);
+    }
+
+    default:
+        ALOG_ASSERT(false);
+        return BAD_VALUE;
     }
 }
 
@@ -2128,6 +2160,11 @@ int InputDispatcher::handleReceiveCallback(int fd, int events, void* data) {
                 if (status == WOULD_BLOCK) {
                     return 1;
                 }
+            } else if (status == WOULD_BLOCK && connection->inputChannel->getTransport()
+                    == InputChannel::TRANSPORT_SHARED_MEMORY) {
+                // A shared memory channel may wake us after its signals were already
+                // received by an earlier callback.
+                return 1;
             }
 
             notify = status != DEAD_OBJECT || !connection->monitor;
@@ -2785,13 +2822,7 @@ sp<InputWindowHandle> InputDispatcher::getWindowHandleLocked(
 
 bool InputDispatcher::hasWindowHandleLocked(
         const sp<InputWindowHandle>& windowHandle) const {
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        if (mWindowHandles.itemAt(i) == windowHandle) {
-            return true;
-        }
-    }
-    return false;
+    return mWindowIndex.indexOf(windowHandle) >= 0;
 }
 
 void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) {
@@ -2819,6 +2850,7 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
                 foundHoveredWindow = true;
             }
         }
+        mWindowIndex.build(mWindowHandles);
 
         if (!foundHoveredWindow) {
             mLastHoverWindowHandle = NULL;
@@ -3276,6 +3308,11 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
         dump.append(INDENT "AppSwitch: not pending\n");
     }
 
+    dump.append(INDENT "EntryPools:\n");
+    dumpEntryPool(dump, "KeyEntry", KeyEntry::sPool);
+    dumpEntryPool(dump, "MotionEntry", MotionEntry::sPool);
+    dumpEntryPool(dump, "DispatchEntry", DispatchEntry::sPool);
+
     dump.append(INDENT "Configuration:\n");
     dump.appendFormat(INDENT2 "KeyRepeatDelay: %0.1fms\n",
             mConfig.keyRepeatDelay * 0.000001f);
@@ -3283,6 +3320,15 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             mConfig.keyRepeatTimeout * 0.000001f);
 }
 
+template <typename T>
+void InputDispatcher::dumpEntryPool(String8& dump, const char* name, const EntryPool<T>& pool) {
+    dump.appendFormat(INDENT2 "%s: live=%zu, free=%zu, allocations=%llu, "
+            "heapAllocations=%llu\n", name,
+            pool.getLiveCount(), pool.getFreeCount(),
+            (unsigned long long)pool.getAllocationCount(),
+            (unsigned long long)pool.getHeapAllocationCount());
+}
+
 status_t InputDispatcher::registerInputChannel(const sp<InputChannel>& inputChannel,
         const sp<InputWindowHandle>& inputWindowHandle, bool monitor) {
 #if DEBUG_REGISTRATION
@@ -3884,6 +3930,8 @@ void InputDispatcher::DeviceResetEntry::appendDescription(String8& msg) const {
 
 // --- InputDispatcher::KeyEntry ---
 
+EntryPool<InputDispatcher::KeyEntry> InputDispatcher::KeyEntry::sPool(ENTRY_POOL_MAX_FREE);
+
 InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action,
         int32_t flags, int32_t keyCode, int32_t scanCode, int32_t metaState,
@@ -3907,6 +3955,14 @@ void InputDispatcher::KeyEntry::appendDescription(String8& msg) const {
             repeatCount, policyFlags);
 }
 
+void* InputDispatcher::KeyEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::KeyEntry::operator delete(void* p, size_t size) {
+    sPool.recycle(p, size);
+}
+
 void InputDispatcher::KeyEntry::recycle() {
     releaseInjectionState();
 
@@ -3919,6 +3975,8 @@ void InputDispatcher::KeyEntry::recycle() {
 
 // --- InputDispatcher::MotionEntry ---
 
+EntryPool<InputDispatcher::MotionEntry> InputDispatcher::MotionEntry::sPool(ENTRY_POOL_MAX_FREE);
+
 InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action, int32_t flags,
         int32_t metaState, int32_t buttonState,
@@ -3944,6 +4002,14 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
 InputDispatcher::MotionEntry::~MotionEntry() {
 }
 
+void* InputDispatcher::MotionEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::MotionEntry::operator delete(void* p, size_t size) {
+    sPool.recycle(p, size);
+}
+
 void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
     msg.appendFormat("MotionEvent(deviceId=%d, source=0x%08x, action=%d, "
             "flags=0x%08x, metaState=0x%08x, buttonState=0x%08x, edgeFlags=0x%08x, "
@@ -3965,6 +4031,9 @@ void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
 
 volatile int32_t InputDispatcher::DispatchEntry::sNextSeqAtomic;
 
+EntryPool<InputDispatcher::DispatchEntry> InputDispatcher::DispatchEntry::sPool(
+        ENTRY_POOL_MAX_FREE);
+
 InputDispatcher::DispatchEntry::DispatchEntry(EventEntry* eventEntry,
         int32_t targetFlags, float xOffset, float yOffset, float scaleFactor) :
         seq(nextSeq()),
@@ -3978,6 +4047,14 @@ InputDispatcher::DispatchEntry::~DispatchEntry() {
     eventEntry->release();
 }
 
+void* InputDispatcher::DispatchEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::DispatchEntry::operator delete(void* p, size_t size) {
+    sPool.recycle(p, size);
+}
+
 uint32_t InputDispatcher::DispatchEntry::nextSeq() {
     // Sequence number 0 is reserved and will never be returned.
     uint32_t seq;
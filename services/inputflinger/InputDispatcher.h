@@ -343,6 +343,107 @@ public:
     virtual status_t unregisterInputChannel(const sp<InputChannel>& inputChannel) = 0;
 };
 
+/*
+ * A free list of recycled storage for objects of type T.
+ *
+ * The dispatcher creates a key or motion entry for every event and a dispatch entry for
+ * every target, and motion entries hold MAX_POINTERS pointers inline, so these are
+ * recycled through pools rather than the heap.  Up to maxFree released objects are kept
+ * for reuse; anything beyond that, or of an unexpected size, goes back to the heap.
+ *
+ * The pools are static, so they are shared by every dispatcher in the process and by
+ * entries released on any thread; each pool has its own lock.
+ */
+template <typename T>
+class EntryPool {
+public:
+    explicit EntryPool(size_t maxFree) :
+            mFreeList(NULL), mFreeCount(0), mMaxFree(maxFree),
+            mLiveCount(0), mAllocationCount(0), mHeapAllocationCount(0) {
+    }
+
+    ~EntryPool() {
+        trim();
+    }
+
+    inline void* allocate(size_t size) {
+        AutoMutex _l(mLock);
+        mLiveCount += 1;
+        mAllocationCount += 1;
+        if (size == sizeof(T) && mFreeList) {
+            Node* node = mFreeList;
+            mFreeList = node->next;
+            mFreeCount -= 1;
+            return node;
+        }
+        mHeapAllocationCount += 1;
+        return ::operator new(size);
+    }
+
+    inline void recycle(void* p, size_t size) {
+        if (!p) {
+            return;
+        }
+        AutoMutex _l(mLock);
+        mLiveCount -= 1;
+        if (size == sizeof(T) && mFreeCount < mMaxFree) {
+            Node* node = static_cast<Node*>(p);
+            node->next = mFreeList;
+            mFreeList = node;
+            mFreeCount += 1;
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    // Returns all free storage to the heap.
+    void trim() {
+        AutoMutex _l(mLock);
+        while (mFreeList) {
+            Node* node = mFreeList;
+            mFreeList = node->next;
+            ::operator delete(node);
+        }
+        mFreeCount = 0;
+    }
+
+    size_t getFreeCount() const {
+        AutoMutex _l(mLock);
+        return mFreeCount;
+    }
+
+    size_t getLiveCount() const {
+        AutoMutex _l(mLock);
+        return mLiveCount;
+    }
+
+    uint64_t getAllocationCount() const {
+        AutoMutex _l(mLock);
+        return mAllocationCount;
+    }
+
+    uint64_t getHeapAllocationCount() const {
+        AutoMutex _l(mLock);
+        return mHeapAllocationCount;
+    }
+
+private:
+    struct Node {
+        Node* next;
+    };
+
+    mutable Mutex mLock;
+    Node* mFreeList;
+    size_t mFreeCount;
+    size_t mMaxFree;
+    size_t mLiveCount;
+    uint64_t mAllocationCount;
+    uint64_t mHeapAllocationCount; // allocations that were not served from the free list
+
+    EntryPool(const EntryPool&);
+    EntryPool& operator=(const EntryPool&);
+};
+
 /* Dispatches events to input targets.  Some functions of the input dispatcher, such as
  * identifying input targets, are controlled by a separate policy object.
  *
@@ -495,6 +596,10 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* p, size_t size);
+        static EntryPool<KeyEntry> sPool;
+
     protected:
         virtual ~KeyEntry();
     };
@@ -526,6 +631,10 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(String8& msg) const;
 
+        static void* operator new(size_t size);
+        static void operator delete(void* p, size_t size);
+        static EntryPool<MotionEntry> sPool;
+
     protected:
         virtual ~MotionEntry();
     };
@@ -549,6 +658,10 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* p, size_t size);
+        static EntryPool<DispatchEntry> sPool;
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -938,6 +1051,8 @@ private:
     bool mInputFilterEnabled;
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
+    // Where mWindowHandles are, for hit testing. Rebuilt by setInputWindows.
+    InputWindowIndex mWindowIndex;
 
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
@@ -1045,6 +1160,11 @@ private:
             const sp<InputWindowHandle>& windowHandle, const EventEntry* eventEntry,
             const char* targetType);
 
+    // Messages published together by startDispatchCycleLocked, at most
+    // OUTBOUND_BATCH_SIZE at a time.
+    enum { OUTBOUND_BATCH_SIZE = 16 };
+    InputMessage mOutboundMessages[OUTBOUND_BATCH_SIZE];
+
     // Manage the dispatch cycle for a single connection.
     // These methods are deliberately not Interruptible because doing all of the work
     // with the mutex held makes it easier to ensure that connection invariants are maintained.
@@ -1056,6 +1176,8 @@ private:
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
+    status_t buildDispatchMessageLocked(const sp<Connection>& connection,
+            const DispatchEntry* dispatchEntry, InputMessage* outMsg);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
     void abortBrokenDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
@@ -1079,6 +1201,8 @@ private:
 
     // Dump state.
     void dumpDispatchStateLocked(String8& dump);
+    template <typename T>
+    static void dumpEntryPool(String8& dump, const char* name, const EntryPool<T>& pool);
     void logDispatchStateLocked();
 
     // Registration.
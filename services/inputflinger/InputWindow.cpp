@@ -19,6 +19,9 @@
 
 #include "InputWindow.h"
 
+#include <limits.h>
+#include <string.h>
+
 #include <cutils/log.h>
 
 #include <ui/Rect.h>
@@ -69,4 +72,196 @@ void InputWindowHandle::releaseInfo() {
     }
 }
 
+
+// --- InputWindowIndex ---
+
+template<typename T>
+inline static T min(const T& a, const T& b) {
+    return a < b ? a : b;
+}
+
+template<typename T>
+inline static T max(const T& a, const T& b) {
+    return a > b ? a : b;
+}
+
+// The part of a window that can be found at a point: its frame (which
+// includes its right and bottom edges) and its touchable region.
+struct WindowBounds {
+    int32_t left, top, right, bottom;
+
+    explicit WindowBounds(const InputWindowInfo* info) :
+            left(info->frameLeft), top(info->frameTop),
+            right(info->frameRight), bottom(info->frameBottom) {
+        const Rect touchable(info->touchableRegion.getBounds());
+        if (!touchable.isEmpty()) {
+            left = min(left, touchable.left);
+            top = min(top, touchable.top);
+            right = max(right, touchable.right - 1);
+            bottom = max(bottom, touchable.bottom - 1);
+        }
+    }
+};
+
+static bool isTouchableAnywhere(const InputWindowInfo* info) {
+    int32_t flags = info->layoutParamsFlags;
+    bool isTouchModal = !(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)
+            && (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                    | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+    return isTouchModal || (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+}
+
+InputWindowIndex::Grid::Grid() :
+        displayId(0), left(INT_MAX), top(INT_MAX), right(INT_MIN), bottom(INT_MIN) {
+}
+
+int32_t InputWindowIndex::Grid::columnAt(int32_t x) const {
+    return int32_t((int64_t(x) - left) * GRID_SIZE / (int64_t(right) - left + 1));
+}
+
+int32_t InputWindowIndex::Grid::rowAt(int32_t y) const {
+    return int32_t((int64_t(y) - top) * GRID_SIZE / (int64_t(bottom) - top + 1));
+}
+
+ssize_t InputWindowIndex::Grid::cellAt(int32_t x, int32_t y) const {
+    if (x < left || x > right || y < top || y > bottom) {
+        return -1;
+    }
+    return rowAt(y) * GRID_SIZE + columnAt(x);
+}
+
+InputWindowIndex::InputWindowIndex() {
+}
+
+void InputWindowIndex::clear() {
+    mGrids.clear();
+    mIndices.clear();
+}
+
+ssize_t InputWindowIndex::indexOfGrid(int32_t displayId) const {
+    for (size_t i = 0; i < mGrids.size(); i++) {
+        if (mGrids[i].displayId == displayId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void InputWindowIndex::build(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    clear();
+
+    // Find the displays and the bounds of their grids.
+    size_t numWindows = windowHandles.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* info = windowHandles[i]->getInfo();
+        mIndices.add(windowHandles[i].get(), i);
+        if (!info->visible) {
+            continue;
+        }
+        ssize_t g = indexOfGrid(info->displayId);
+        if (g < 0) {
+            Grid grid;
+            grid.displayId = info->displayId;
+            g = mGrids.add(grid);
+        }
+        if (!isTouchableAnywhere(info)) {
+            Grid& grid = mGrids.editItemAt(g);
+            WindowBounds bounds(info);
+            grid.left = min(grid.left, bounds.left);
+            grid.top = min(grid.top, bounds.top);
+            grid.right = max(grid.right, bounds.right);
+            grid.bottom = max(grid.bottom, bounds.bottom);
+        }
+    }
+
+    // Count the windows of each cell, then list them in z order.
+    for (size_t g = 0; g < mGrids.size(); g++) {
+        mGrids.editItemAt(g).cellStarts.insertAt(0, 0, GRID_SIZE * GRID_SIZE + 1);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < numWindows; i++) {
+            const InputWindowInfo* info = windowHandles[i]->getInfo();
+            if (!info->visible) {
+                continue;
+            }
+            Grid& grid = mGrids.editItemAt(indexOfGrid(info->displayId));
+            if (isTouchableAnywhere(info)) {
+                if (pass) {
+                    grid.anywhere.push(i);
+                }
+                continue;
+            }
+            WindowBounds bounds(info);
+            if (bounds.left > bounds.right || bounds.top > bounds.bottom) {
+                continue;
+            }
+            int32_t firstColumn = grid.columnAt(bounds.left);
+            int32_t lastColumn = grid.columnAt(bounds.right);
+            int32_t lastRow = grid.rowAt(bounds.bottom);
+            uint32_t* starts = grid.cellStarts.editArray();
+            for (int32_t row = grid.rowAt(bounds.top); row <= lastRow; row++) {
+                for (int32_t column = firstColumn; column <= lastColumn; column++) {
+                    size_t cell = row * GRID_SIZE + column;
+                    if (pass) {
+                        grid.cells.editItemAt(starts[cell]++) = i;
+                    } else {
+                        starts[cell + 1]++;
+                    }
+                }
+            }
+        }
+        for (size_t g = 0; g < mGrids.size(); g++) {
+            Grid& grid = mGrids.editItemAt(g);
+            uint32_t* starts = grid.cellStarts.editArray();
+            if (!pass) {
+                // turn the counts into the starts of the cells
+                for (size_t c = 1; c <= GRID_SIZE * GRID_SIZE; c++) {
+                    starts[c] += starts[c - 1];
+                }
+                grid.cells.insertAt(0, 0, starts[GRID_SIZE * GRID_SIZE]);
+            } else {
+                // filling the cells moved each start to the next one
+                memmove(starts + 1, starts, GRID_SIZE * GRID_SIZE * sizeof(uint32_t));
+                starts[0] = 0;
+            }
+        }
+    }
+}
+
+ssize_t InputWindowIndex::indexOf(const sp<InputWindowHandle>& windowHandle) const {
+    ssize_t index = mIndices.indexOfKey(windowHandle.get());
+    return index >= 0 ? ssize_t(mIndices.valueAt(index)) : -1;
+}
+
+InputWindowIndex::Iterator::Iterator(const InputWindowIndex& index,
+        int32_t displayId, int32_t x, int32_t y) :
+        mCell(NULL), mCellEnd(NULL), mAnywhere(NULL), mAnywhereEnd(NULL) {
+    ssize_t g = index.indexOfGrid(displayId);
+    if (g < 0) {
+        return;
+    }
+    const Grid& grid = index.mGrids[g];
+    mAnywhere = grid.anywhere.array();
+    mAnywhereEnd = mAnywhere + grid.anywhere.size();
+    ssize_t cell = grid.cellAt(x, y);
+    if (cell >= 0) {
+        const uint32_t* starts = grid.cellStarts.array();
+        mCell = grid.cells.array() + starts[cell];
+        mCellEnd = grid.cells.array() + starts[cell + 1];
+    }
+}
+
+bool InputWindowIndex::Iterator::next(size_t* outIndex) {
+    if (mCell != mCellEnd
+            && (mAnywhere == mAnywhereEnd || *mCell < *mAnywhere)) {
+        *outIndex = *mCell++;
+        return true;
+    }
+    if (mAnywhere != mAnywhereEnd) {
+        *outIndex = *mAnywhere++;
+        return true;
+    }
+    return false;
+}
+
 } // namespace android
@@ -21,9 +21,11 @@
 #include <input/InputTransport.h>
 #include <ui/Rect.h>
 #include <ui/Region.h>
+#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include "InputApplication.h"
 
@@ -199,6 +201,75 @@ protected:
     InputWindowInfo* mInfo;
 };
 
+
+/*
+ * A spatial index of the input windows, for finding the windows that may be at a
+ * point without looking at all of them.
+ *
+ * Windows are referred to by their position in the list the index is built from,
+ * which is their z order, front to back. Each display has a grid over the frames
+ * and touchable regions of its windows, each cell listing the windows that overlap
+ * it. Windows that take touches anywhere on their display (touch modal windows and
+ * those watching outside touches) are listed separately and found at every point.
+ * Windows that aren't visible are left out, they can't be touched or obscure others.
+ *
+ * The index must be rebuilt whenever the list or the info of its windows change.
+ */
+class InputWindowIndex {
+public:
+    InputWindowIndex();
+
+    void build(const Vector<sp<InputWindowHandle> >& windowHandles);
+    void clear();
+
+    // Returns the position of a window in the list, or -1 if it isn't in it.
+    ssize_t indexOf(const sp<InputWindowHandle>& windowHandle) const;
+
+    /*
+     * Iterates front to back over the positions of the windows of a display that
+     * may be at a point: all windows whose frame or touchable region contains the
+     * point and all windows taking touches anywhere are included, along with some
+     * that share a cell with the point.
+     */
+    class Iterator {
+    public:
+        Iterator(const InputWindowIndex& index, int32_t displayId, int32_t x, int32_t y);
+
+        // Returns false when there are no more windows.
+        bool next(size_t* outIndex);
+
+    private:
+        const uint32_t* mCell;
+        const uint32_t* mCellEnd;
+        const uint32_t* mAnywhere;
+        const uint32_t* mAnywhereEnd;
+    };
+
+private:
+    enum { GRID_SIZE = 16 };
+
+    struct Grid {
+        int32_t displayId;
+        // inclusive bounds of the windows, like frames
+        int32_t left, top, right, bottom;
+        // cells[cellStarts[i]] to cells[cellStarts[i + 1]] are the windows of cell i
+        Vector<uint32_t> cellStarts;
+        Vector<uint32_t> cells;
+        Vector<uint32_t> anywhere;
+
+        Grid();
+        int32_t columnAt(int32_t x) const;
+        int32_t rowAt(int32_t y) const;
+        // the cell containing a point, or -1 if it is outside the grid
+        ssize_t cellAt(int32_t x, int32_t y) const;
+    };
+
+    ssize_t indexOfGrid(int32_t displayId) const;
+
+    Vector<Grid> mGrids;
+    KeyedVector<const InputWindowHandle*, uint32_t> mIndices;
+};
+
 } // namespace android
 
 #endif // _UI_INPUT_WINDOW_H
@@ -18,6 +18,9 @@
 
 #include <gtest/gtest.h>
 #include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
 
 namespace android {
 
@@ -255,4 +258,443 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
             << "Should reject motion events with duplicate pointer ids.";
 }
 
+
+// --- InputWindowIndexTest ---
+
+class FakeInputWindowHandle : public InputWindowHandle {
+public:
+    FakeInputWindowHandle() : InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->layoutParamsFlags = 0;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->frameLeft = mInfo->frameTop = mInfo->frameRight = mInfo->frameBottom = 0;
+        mInfo->visible = true;
+        mInfo->displayId = DISPLAY_ID;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+
+    InputWindowInfo* editInfo() {
+        return mInfo;
+    }
+};
+
+// Many small overlay windows over a few full screen ones, as on kiosk builds, on two
+// displays. The index must give the same answers as walking all of the windows,
+// which is what InputDispatcher did before.
+class InputWindowIndexTest : public testing::Test {
+protected:
+    enum { WINDOW_COUNT = 200 };
+    enum { WIDTH = 1080, HEIGHT = 1920 };
+
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowIndex mIndex;
+
+    static void report(const char* name, nsecs_t elapsed, size_t iterations) {
+        printf("%-32s %10.1f ns/iteration\n", name,
+                double(elapsed) / double(iterations));
+    }
+
+    void makeWindows(unsigned int seed) {
+        srand(seed);
+        mWindowHandles.clear();
+        for (size_t i = 0; i < WINDOW_COUNT; i++) {
+            sp<FakeInputWindowHandle> handle = new FakeInputWindowHandle();
+            InputWindowInfo* info = handle->editInfo();
+            int32_t w = 20 + rand() % 300;
+            int32_t h = 20 + rand() % 300;
+            info->frameLeft = rand() % WIDTH - 10;
+            info->frameTop = rand() % HEIGHT - 10;
+            info->frameRight = info->frameLeft + w;
+            info->frameBottom = info->frameTop + h;
+            info->layoutParamsFlags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+            switch (rand() % 20) {
+            case 0: info->layoutParamsFlags |= InputWindowInfo::FLAG_NOT_FOCUSABLE; break;
+            case 1: info->layoutParamsFlags |= InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH; break;
+            case 2: info->layoutParamsFlags |= InputWindowInfo::FLAG_NOT_TOUCHABLE; break;
+            case 3: info->visible = false; break;
+            case 4: info->displayId = DISPLAY_ID + 1; break;
+            case 5: info->layoutParamsType = InputWindowInfo::TYPE_INPUT_METHOD; break;
+            }
+            if (i >= WINDOW_COUNT - 3) {
+                // the full screen, touch modal windows at the back
+                info->layoutParamsFlags = 0;
+                info->frameLeft = info->frameTop = 0;
+                info->frameRight = WIDTH;
+                info->frameBottom = HEIGHT;
+            }
+            // touchable regions are usually inside the frame, but not always
+            if (rand() % 8) {
+                info->addTouchableRegion(Rect(info->frameLeft + 5, info->frameTop + 5,
+                        info->frameRight - 5, info->frameBottom - 5));
+            } else {
+                info->addTouchableRegion(Rect(info->frameLeft - 30, info->frameTop,
+                        info->frameLeft, info->frameTop + 30));
+            }
+            mWindowHandles.add(handle);
+        }
+        mIndex.build(mWindowHandles);
+    }
+
+    static bool isTouchedAt(const InputWindowInfo* info, int32_t x, int32_t y) {
+        int32_t flags = info->layoutParamsFlags;
+        if (!info->visible || (flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+            return false;
+        }
+        bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+        return isTouchModal || info->touchableRegionContainsPoint(x, y);
+    }
+
+    static bool obscures(const InputWindowInfo* info, int32_t displayId, int32_t x, int32_t y) {
+        return info->displayId == displayId && info->visible && !info->isTrustedOverlay()
+                && info->frameContainsPoint(x, y);
+    }
+
+    // like InputDispatcher::findTouchedWindowAtLocked used to
+    ssize_t findTouchedWindowLinear(int32_t displayId, int32_t x, int32_t y) const {
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            const InputWindowInfo* info = mWindowHandles[i]->getInfo();
+            if (info->displayId == displayId && isTouchedAt(info, x, y)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    ssize_t findTouchedWindowIndexed(int32_t displayId, int32_t x, int32_t y) const {
+        InputWindowIndex::Iterator it(mIndex, displayId, x, y);
+        size_t i;
+        while (it.next(&i)) {
+            const InputWindowInfo* info = mWindowHandles[i]->getInfo();
+            if (info->displayId == displayId && isTouchedAt(info, x, y)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // like InputDispatcher::isWindowObscuredAtPointLocked used to
+    bool isObscuredLinear(size_t window, int32_t x, int32_t y) const {
+        int32_t displayId = mWindowHandles[window]->getInfo()->displayId;
+        for (size_t i = 0; i < window; i++) {
+            if (obscures(mWindowHandles[i]->getInfo(), displayId, x, y)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool isObscuredIndexed(size_t window, int32_t x, int32_t y) const {
+        int32_t displayId = mWindowHandles[window]->getInfo()->displayId;
+        size_t end = mIndex.indexOf(mWindowHandles[window]);
+        InputWindowIndex::Iterator it(mIndex, displayId, x, y);
+        size_t i;
+        while (it.next(&i) && i < end) {
+            if (obscures(mWindowHandles[i]->getInfo(), displayId, x, y)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+TEST_F(InputWindowIndexTest, MatchesLinearSearch) {
+    for (unsigned int seed = 1; seed <= 10; seed++) {
+        makeWindows(seed);
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            EXPECT_EQ(ssize_t(i), mIndex.indexOf(mWindowHandles[i]));
+        }
+        EXPECT_EQ(-1, mIndex.indexOf(new FakeInputWindowHandle()));
+
+        for (int32_t n = 0; n < 2000; n++) {
+            int32_t displayId = DISPLAY_ID + n % 3;
+            int32_t x = rand() % (WIDTH + 200) - 100;
+            int32_t y = rand() % (HEIGHT + 200) - 100;
+            ASSERT_EQ(findTouchedWindowLinear(displayId, x, y),
+                    findTouchedWindowIndexed(displayId, x, y))
+                    << "seed " << seed << " at " << x << ", " << y;
+
+            size_t window = rand() % mWindowHandles.size();
+            ASSERT_EQ(isObscuredLinear(window, x, y), isObscuredIndexed(window, x, y))
+                    << "seed " << seed << " window " << window << " at " << x << ", " << y;
+
+            // every window taking touches anywhere is visited, in z order
+            InputWindowIndex::Iterator it(mIndex, displayId, x, y);
+            size_t i, previous = 0, visited = 0;
+            while (it.next(&i)) {
+                ASSERT_TRUE(visited == 0 || i > previous);
+                previous = i;
+                visited++;
+            }
+            ASSERT_LE(visited, mWindowHandles.size());
+        }
+    }
+}
+
+TEST_F(InputWindowIndexTest, EdgesAndEmptyIndex) {
+    size_t i;
+    InputWindowIndex::Iterator none(mIndex, DISPLAY_ID, 0, 0);
+    EXPECT_FALSE(none.next(&i));
+
+    // frames include their right and bottom edges
+    sp<FakeInputWindowHandle> handle = new FakeInputWindowHandle();
+    InputWindowInfo* info = handle->editInfo();
+    info->frameLeft = 10;
+    info->frameTop = 20;
+    info->frameRight = 110;
+    info->frameBottom = 220;
+    info->layoutParamsFlags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+    mWindowHandles.add(handle);
+    mIndex.build(mWindowHandles);
+
+    InputWindowIndex::Iterator corner(mIndex, DISPLAY_ID, 110, 220);
+    ASSERT_TRUE(corner.next(&i));
+    EXPECT_EQ(0U, i);
+    EXPECT_FALSE(corner.next(&i));
+    InputWindowIndex::Iterator outside(mIndex, DISPLAY_ID, 111, 220);
+    EXPECT_FALSE(outside.next(&i));
+    InputWindowIndex::Iterator otherDisplay(mIndex, DISPLAY_ID + 1, 50, 50);
+    EXPECT_FALSE(otherDisplay.next(&i));
+
+    mIndex.clear();
+    InputWindowIndex::Iterator cleared(mIndex, DISPLAY_ID, 50, 50);
+    EXPECT_FALSE(cleared.next(&i));
+    EXPECT_EQ(-1, mIndex.indexOf(handle));
+}
+
+TEST_F(InputWindowIndexTest, Benchmark) {
+    enum { ITERATIONS = 100000 };
+    makeWindows(1);
+
+    int32_t* xs = new int32_t[ITERATIONS];
+    int32_t* ys = new int32_t[ITERATIONS];
+    for (size_t n = 0; n < ITERATIONS; n++) {
+        xs[n] = rand() % WIDTH;
+        ys[n] = rand() % HEIGHT;
+    }
+
+    ssize_t linear = 0, indexed = 0;
+    nsecs_t start = systemTime();
+    for (size_t n = 0; n < ITERATIONS; n++) {
+        ssize_t window = findTouchedWindowLinear(DISPLAY_ID, xs[n], ys[n]);
+        linear += window >= 0 ? isObscuredLinear(window, xs[n], ys[n]) : 0;
+    }
+    report("hit test, linear", systemTime() - start, ITERATIONS);
+
+    start = systemTime();
+    for (size_t n = 0; n < ITERATIONS; n++) {
+        ssize_t window = findTouchedWindowIndexed(DISPLAY_ID, xs[n], ys[n]);
+        indexed += window >= 0 ? isObscuredIndexed(window, xs[n], ys[n]) : 0;
+    }
+    report("hit test, indexed", systemTime() - start, ITERATIONS);
+    EXPECT_EQ(linear, indexed);
+
+    start = systemTime();
+    for (size_t n = 0; n < ITERATIONS / 100; n++) {
+        mIndex.build(mWindowHandles);
+    }
+    report("index build, 200 windows", systemTime() - start, ITERATIONS / 100);
+
+    delete[] xs;
+    delete[] ys;
+}
+
+
+// --- EntryPoolTest ---
+
+class EntryPoolTest : public testing::Test {
+protected:
+    // The shapes of a motion entry and a dispatch entry.
+    struct FakeMotionEntry {
+        nsecs_t eventTime;
+        uint32_t pointerCount;
+        PointerProperties pointerProperties[MAX_POINTERS];
+        PointerCoords pointerCoords[MAX_POINTERS];
+    };
+
+    struct FakeDispatchEntry {
+        void* next;
+        void* prev;
+        FakeMotionEntry* eventEntry;
+        int32_t targetFlags;
+        float xOffset, yOffset, scaleFactor;
+        nsecs_t deliveryTime;
+    };
+
+    struct HeapAllocator {
+        template <typename T>
+        T* create() { return new T(); }
+        template <typename T>
+        void destroy(T* p) { delete p; }
+    };
+
+    struct PoolAllocator {
+        EntryPool<FakeMotionEntry> motions;
+        EntryPool<FakeDispatchEntry> dispatches;
+
+        PoolAllocator() : motions(32), dispatches(32) { }
+
+        template <typename T>
+        T* create() { return new (pool<T>()->allocate(sizeof(T))) T(); }
+        template <typename T>
+        void destroy(T* p) { p->~T(); pool<T>()->recycle(p, sizeof(T)); }
+
+        template <typename T>
+        EntryPool<T>* pool();
+    };
+
+    enum { TARGET_COUNT = 3, IN_FLIGHT = 8 };
+
+    // One second of a ten finger gesture reported at 1000Hz, each sample dispatched to a
+    // few windows, with a few samples waiting to be finished at any time.
+    template <typename Allocator>
+    static void runGesture(Allocator& allocator) {
+        FakeMotionEntry* motions[IN_FLIGHT] = { };
+        FakeDispatchEntry* dispatches[IN_FLIGHT][TARGET_COUNT] = { };
+        for (size_t n = 0; n < 1000; n++) {
+            size_t slot = n % IN_FLIGHT;
+            if (motions[slot]) {
+                for (size_t t = 0; t < TARGET_COUNT; t++) {
+                    allocator.destroy(dispatches[slot][t]);
+                }
+                allocator.destroy(motions[slot]);
+            }
+            FakeMotionEntry* motion = allocator.template create<FakeMotionEntry>();
+            motion->eventTime = n * 1000000LL;
+            motion->pointerCount = 10;
+            for (size_t t = 0; t < TARGET_COUNT; t++) {
+                FakeDispatchEntry* dispatch = allocator.template create<FakeDispatchEntry>();
+                dispatch->eventEntry = motion;
+                dispatches[slot][t] = dispatch;
+            }
+            motions[slot] = motion;
+        }
+        for (size_t slot = 0; slot < IN_FLIGHT; slot++) {
+            for (size_t t = 0; t < TARGET_COUNT; t++) {
+                allocator.destroy(dispatches[slot][t]);
+            }
+            allocator.destroy(motions[slot]);
+        }
+    }
+};
+
+template <>
+EntryPool<EntryPoolTest::FakeMotionEntry>* EntryPoolTest::PoolAllocator::pool() {
+    return &motions;
+}
+
+template <>
+EntryPool<EntryPoolTest::FakeDispatchEntry>* EntryPoolTest::PoolAllocator::pool() {
+    return &dispatches;
+}
+
+TEST_F(EntryPoolTest, RecyclesUpToMaxFree) {
+    EntryPool<FakeDispatchEntry> pool(2);
+
+    void* a = pool.allocate(sizeof(FakeDispatchEntry));
+    void* b = pool.allocate(sizeof(FakeDispatchEntry));
+    void* c = pool.allocate(sizeof(FakeDispatchEntry));
+    EXPECT_EQ(3U, pool.getLiveCount());
+    EXPECT_EQ(3U, pool.getHeapAllocationCount());
+
+    pool.recycle(a, sizeof(FakeDispatchEntry));
+    pool.recycle(b, sizeof(FakeDispatchEntry));
+    pool.recycle(c, sizeof(FakeDispatchEntry)); // over the limit, back to the heap
+    EXPECT_EQ(0U, pool.getLiveCount());
+    EXPECT_EQ(2U, pool.getFreeCount());
+
+    EXPECT_EQ(b, pool.allocate(sizeof(FakeDispatchEntry)));
+    EXPECT_EQ(a, pool.allocate(sizeof(FakeDispatchEntry)));
+    EXPECT_EQ(0U, pool.getFreeCount());
+    EXPECT_EQ(5U, pool.getAllocationCount());
+    EXPECT_EQ(3U, pool.getHeapAllocationCount());
+
+    // storage of another size is never pooled
+    void* d = pool.allocate(sizeof(FakeDispatchEntry) * 2);
+    EXPECT_EQ(4U, pool.getHeapAllocationCount());
+    pool.recycle(d, sizeof(FakeDispatchEntry) * 2);
+    EXPECT_EQ(0U, pool.getFreeCount());
+
+    pool.recycle(a, sizeof(FakeDispatchEntry));
+    pool.recycle(b, sizeof(FakeDispatchEntry));
+    pool.trim();
+    EXPECT_EQ(0U, pool.getFreeCount());
+}
+
+// Entries can be released on any thread and by any dispatcher in the process.
+struct PoolChurnEntry {
+    void* next;
+    uint64_t payload[4];
+};
+
+class PoolChurnThread : public Thread {
+    EntryPool<PoolChurnEntry>* mPool;
+
+public:
+    enum { ITERATIONS = 100000 };
+
+    explicit PoolChurnThread(EntryPool<PoolChurnEntry>* pool) :
+            Thread(false), mPool(pool) { }
+
+protected:
+    virtual bool threadLoop() {
+        for (size_t i = 0; i < ITERATIONS; i++) {
+            void* p = mPool->allocate(sizeof(PoolChurnEntry));
+            mPool->recycle(p, sizeof(PoolChurnEntry));
+        }
+        return false;
+    }
+};
+
+TEST_F(EntryPoolTest, CanBeSharedBetweenThreads) {
+    EntryPool<PoolChurnEntry> pool(4);
+
+    sp<PoolChurnThread> first = new PoolChurnThread(&pool);
+    sp<PoolChurnThread> second = new PoolChurnThread(&pool);
+    ASSERT_EQ(OK, first->run("PoolChurn1"));
+    ASSERT_EQ(OK, second->run("PoolChurn2"));
+    first->join();
+    second->join();
+
+    EXPECT_EQ(0U, pool.getLiveCount());
+    EXPECT_EQ(uint64_t(2 * PoolChurnThread::ITERATIONS), pool.getAllocationCount());
+    EXPECT_GE(4U, pool.getFreeCount());
+    EXPECT_GE(2U, pool.getHeapAllocationCount());
+}
+
+TEST_F(EntryPoolTest, GestureBenchmark) {
+    enum { ITERATIONS = 200 };
+
+    HeapAllocator heap;
+    runGesture(heap);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        runGesture(heap);
+    }
+    nsecs_t heapTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    PoolAllocator pools;
+    runGesture(pools);
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        runGesture(pools);
+    }
+    nsecs_t poolTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    // 1000 samples per gesture, each with a motion entry and TARGET_COUNT dispatch entries
+    printf("%-32s %10.1f ns/sample\n", "1000Hz gesture, heap",
+            double(heapTime) / (ITERATIONS * 1000));
+    printf("%-32s %10.1f ns/sample\n", "1000Hz gesture, pooled",
+            double(poolTime) / (ITERATIONS * 1000));
+
+    // after warming up every allocation is served from the free lists
+    EXPECT_EQ(size_t(IN_FLIGHT), pools.motions.getHeapAllocationCount());
+    EXPECT_EQ(size_t(IN_FLIGHT * TARGET_COUNT), pools.dispatches.getHeapAllocationCount());
+    EXPECT_EQ(0U, pools.motions.getLiveCount());
+    EXPECT_EQ(0U, pools.dispatches.getLiveCount());
+}
+
 } // namespace android
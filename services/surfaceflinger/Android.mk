@@ -6,13 +6,17 @@ LOCAL_CLANG := true
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES:= \
     Client.cpp \
+    DisplayCompositionThread.cpp \
     DisplayDevice.cpp \
     DispSync.cpp \
     EventControlThread.cpp \
     EventThread.cpp \
+    FenceWatcher.cpp \
     FrameTracker.cpp \
+    GLDeletionQueue.cpp \
     Layer.cpp \
     LayerDim.cpp \
+    LayerJournal.cpp \
     MessageQueue.cpp \
     MonitoredProducer.cpp \
     SurfaceFlinger.cpp \
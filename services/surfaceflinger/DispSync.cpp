@@ -31,6 +31,7 @@
 #include <utils/Vector.h>
 
 #include "DispSync.h"
+#include "FenceWatcher.h"
 #include "EventLog/EventLog.h"
 
 namespace android {
@@ -291,6 +292,13 @@ DispSync::DispSync() :
         mRefreshSkipCount(0),
         mThread(new DispSyncThread()) {
 
+    if (!kIgnorePresentFences) {
+        mFenceWatcher = FenceWatcher::getInstance();
+        if (mFenceWatcher != NULL) {
+            mFenceCallback = new FenceWatcherCallback<DispSync>(this);
+        }
+    }
+
     mThread->run("DispSync", PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
 
     reset();
@@ -308,7 +316,11 @@ DispSync::DispSync() :
     }
 }
 
-DispSync::~DispSync() {}
+DispSync::~DispSync() {
+    if (mFenceCallback != NULL) {
+        mFenceCallback->detach();
+    }
+}
 
 void DispSync::reset() {
     Mutex::Autolock lock(mMutex);
@@ -323,13 +335,16 @@ bool DispSync::addPresentFence(const sp<Fence>& fence) {
     Mutex::Autolock lock(mMutex);
 
     mPresentFences[mPresentSampleOffset] = fence;
+    mPresentFenceWatched[mPresentSampleOffset] = mFenceWatcher != NULL &&
+            mFenceWatcher->watch(fence, mFenceCallback) == NO_ERROR;
     mPresentTimes[mPresentSampleOffset] = 0;
     mPresentSampleOffset = (mPresentSampleOffset + 1) % NUM_PRESENT_SAMPLES;
     mNumResyncSamplesSincePresent = 0;
 
+    // watched fences report their signal time through onFenceSignaled
     for (size_t i = 0; i < NUM_PRESENT_SAMPLES; i++) {
         const sp<Fence>& f(mPresentFences[i]);
-        if (f != NULL) {
+        if (f != NULL && !mPresentFenceWatched[i]) {
             nsecs_t t = f->getSignalTime();
             if (t < INT64_MAX) {
                 mPresentFences[i].clear();
@@ -343,6 +358,22 @@ bool DispSync::addPresentFence(const sp<Fence>& fence) {
     return mPeriod == 0 || mError > kErrorThreshold;
 }
 
+void DispSync::onFenceSignaled(const sp<Fence>& fence, nsecs_t signalTime) {
+    Mutex::Autolock lock(mMutex);
+    for (size_t i = 0; i < NUM_PRESENT_SAMPLES; i++) {
+        if (mPresentFences[i] == fence) {
+            mPresentFences[i].clear();
+            mPresentFenceWatched[i] = false;
+            // a fence that errored has no signal time to sample:
+            // getSignalTime() returns -1 if the fence can't be queried and
+            // INT64_MAX if it is in an error state rather than signaled
+            if (signalTime >= 0 && signalTime < INT64_MAX) {
+                mPresentTimes[i] = signalTime + kPresentTimeOffset;
+            }
+        }
+    }
+}
+
 void DispSync::beginResync() {
     Mutex::Autolock lock(mMutex);
 
@@ -497,6 +528,7 @@ void DispSync::resetErrorLocked() {
     mError = 0;
     for (size_t i = 0; i < NUM_PRESENT_SAMPLES; i++) {
         mPresentFences[i].clear();
+        mPresentFenceWatched[i] = false;
         mPresentTimes[i] = 0;
     }
 }
@@ -36,7 +36,9 @@ static const bool kIgnorePresentFences = false;
 
 class String8;
 class Fence;
+class FenceWatcher;
 class DispSyncThread;
+template <typename T> class FenceWatcherCallback;
 
 // DispSync maintains a model of the periodic hardware-based vsync events of a
 // display and uses that model to execute period callbacks at specific phase
@@ -128,6 +130,11 @@ public:
     void dump(String8& result) const;
 
 private:
+    friend class FenceWatcherCallback<DispSync>;
+
+    // onFenceSignaled is called by the FenceWatcher when a present fence
+    // signals, it records the fence's signal time as a present time.
+    void onFenceSignaled(const sp<Fence>& fence, nsecs_t signalTime);
 
     void updateModelLocked();
     void updateErrorLocked();
@@ -161,10 +168,16 @@ private:
 
     // These member variables store information about the present fences used
     // to validate the currently computed model.
+    // Fences left to the FenceWatcher aren't polled by addPresentFence.
     sp<Fence> mPresentFences[NUM_PRESENT_SAMPLES];
+    bool mPresentFenceWatched[NUM_PRESENT_SAMPLES];
     nsecs_t mPresentTimes[NUM_PRESENT_SAMPLES];
     size_t mPresentSampleOffset;
 
+    // mFenceWatcher is NULL if present fences can't be watched.
+    sp<FenceWatcher> mFenceWatcher;
+    sp<FenceWatcherCallback<DispSync> > mFenceCallback;
+
     int mRefreshSkipCount;
 
     // mThread is the thread from which all the callbacks are called.
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include "DisplayCompositionThread.h"
+#include "DisplayDevice.h"
+#include "SurfaceFlinger.h"
+
+#include "DisplayHardware/HWComposer.h"
+#include "RenderEngine/RenderEngine.h"
+
+namespace android {
+
+DisplayCompositionThread::DisplayCompositionThread(
+        SurfaceFlinger* flinger, const sp<DisplayDevice>& hw)
+    : mFlinger(flinger),
+      mDisplayDevice(hw),
+      mEGLDisplay(eglGetDisplay(EGL_DEFAULT_DISPLAY)),
+      mRenderEngine(NULL),
+      mReady(false),
+      mPending(false),
+      mRepaintEverything(false),
+      mSync(EGL_NO_SYNC_KHR) {
+}
+
+DisplayCompositionThread::~DisplayCompositionThread() {
+}
+
+void DisplayCompositionThread::onFirstRef() {
+    run("DisplayComposition", PRIORITY_URGENT_DISPLAY);
+}
+
+status_t DisplayCompositionThread::readyToRun() {
+    // the context must be created (and later used) on this thread
+    RenderEngine* engine = RenderEngine::createShared(mEGLDisplay,
+            mFlinger->getHwComposer().getVisualID(),
+            mFlinger->getRenderEngine());
+    if (engine == NULL) {
+        ALOGW("display %s will be composed on the main thread",
+                mDisplayDevice->getDisplayName().string());
+        return NO_INIT;
+    }
+    Mutex::Autolock _l(mLock);
+    mRenderEngine = engine;
+    mReady = true;
+    return NO_ERROR;
+}
+
+bool DisplayCompositionThread::isReady() const {
+    Mutex::Autolock _l(mLock);
+    return mReady;
+}
+
+RenderEngine* DisplayCompositionThread::getRenderEngine() const {
+    Mutex::Autolock _l(mLock);
+    return mRenderEngine;
+}
+
+const sp<DisplayDevice>& DisplayCompositionThread::getDisplayDevice() const {
+    return mDisplayDevice;
+}
+
+void DisplayCompositionThread::compose(bool repaintEverything, EGLSyncKHR sync) {
+    Mutex::Autolock _l(mLock);
+    mPending = true;
+    mRepaintEverything = repaintEverything;
+    mSync = sync;
+    mCondition.broadcast();
+}
+
+void DisplayCompositionThread::waitForCompletion() {
+    ATRACE_CALL();
+    Mutex::Autolock _l(mLock);
+    while (mPending) {
+        mCondition.wait(mLock);
+    }
+}
+
+void DisplayCompositionThread::stop() {
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mCondition.broadcast();
+    }
+    requestExitAndWait();
+    mDisplayDevice->setRenderEngine(NULL);
+}
+
+bool DisplayCompositionThread::threadLoop() {
+    bool repaintEverything;
+    EGLSyncKHR sync;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mPending && !exitPending()) {
+            mCondition.wait(mLock);
+        }
+        if (!mPending) {
+            // release the display's surface before the engine goes away
+            eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                    EGL_NO_CONTEXT);
+            RenderEngine::destroy(mEGLDisplay, mRenderEngine);
+            mRenderEngine = NULL;
+            mReady = false;
+            return false;
+        }
+        repaintEverything = mRepaintEverything;
+        sync = mSync;
+        mSync = EGL_NO_SYNC_KHR;
+    }
+
+    {
+        ATRACE_NAME("composeDisplay");
+        if (sync != EGL_NO_SYNC_KHR) {
+            // wait for the main thread's texture bindings to land
+            eglClientWaitSyncKHR(mEGLDisplay, sync, 0, EGL_FOREVER_KHR);
+            eglDestroySyncKHR(mEGLDisplay, sync);
+        }
+        // keeps the display's surface current from one frame to the next;
+        // this is what makes the display use this thread's engine.
+        if (mDisplayDevice->makeCurrent(mEGLDisplay,
+                mRenderEngine->getEGLContext())) {
+            mFlinger->composeDisplay(mDisplayDevice, repaintEverything);
+        } else {
+            ALOGW("can't make display %s current on its composition thread",
+                    mDisplayDevice->getDisplayName().string());
+        }
+    }
+
+    Mutex::Autolock _l(mLock);
+    mPending = false;
+    mCondition.broadcast();
+    return true;
+}
+
+}; // namespace android
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_DISPLAY_COMPOSITION_THREAD_H
+#define ANDROID_SF_DISPLAY_COMPOSITION_THREAD_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <utils/threads.h>
+
+namespace android {
+
+class DisplayDevice;
+class RenderEngine;
+class SurfaceFlinger;
+
+// DisplayCompositionThread composes one non-primary display with its own
+// RenderEngine, whose context shares textures with SurfaceFlinger's. The
+// main thread hands it a frame with compose() once the textures of every
+// layer drawn this frame are bound and set up, composes the other displays
+// meanwhile, and waits for it with waitForCompletion() before committing to
+// h/w composer. Layer, texture and display state is not modified in
+// between, so all threads read it unlocked; only the GL drawing runs
+// concurrently, the buffer swap and every other call into h/w composer
+// are serialized by SurfaceFlinger::mHwcLock. SurfaceFlinger owns the
+// thread and stops it before going away.
+class DisplayCompositionThread : public Thread {
+public:
+    DisplayCompositionThread(SurfaceFlinger* flinger,
+            const sp<DisplayDevice>& hw);
+    virtual ~DisplayCompositionThread();
+
+    // whether the thread has its engine and can be handed frames.
+    bool isReady() const;
+    RenderEngine* getRenderEngine() const;
+    const sp<DisplayDevice>& getDisplayDevice() const;
+
+    // composes the current frame. sync, if valid, is waited upon before
+    // drawing and destroyed afterwards.
+    void compose(bool repaintEverything, EGLSyncKHR sync);
+
+    // blocks until the frame passed to compose() is on screen.
+    void waitForCompletion();
+
+    // stops the thread and destroys its engine; the display is composed
+    // on the main thread again afterwards.
+    void stop();
+
+private:
+    virtual void onFirstRef();
+    virtual status_t readyToRun();
+    virtual bool threadLoop();
+
+    SurfaceFlinger* const mFlinger;
+    const sp<DisplayDevice> mDisplayDevice;
+    EGLDisplay mEGLDisplay;
+    RenderEngine* mRenderEngine;
+
+    mutable Mutex mLock;
+    Condition mCondition;
+    bool mReady;
+    bool mPending;
+    bool mRepaintEverything;
+    EGLSyncKHR mSync;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_DISPLAY_COMPOSITION_THREAD_H
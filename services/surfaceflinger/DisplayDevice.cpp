@@ -71,6 +71,11 @@ DisplayDevice::DisplayDevice(
       mPageFlipCount(),
       mIsSecure(isSecure),
       mSecureLayerVisible(false),
+      mDamageHead(0),
+      mDamageCount(0),
+      mRenderEngine(NULL),
+      mLastCompositionTime(0),
+      mAvgCompositionTime(0),
       mLayerStack(NO_LAYER_STACK),
       mOrientation(),
       mPowerMode(HWC_POWER_MODE_OFF),
@@ -108,6 +113,15 @@ DisplayDevice::DisplayDevice(
     mSurface = surface;
     mFormat  = format;
     mPageFlipCount = 0;
+
+    // redraw only what changed since the back buffer was last displayed
+    // if EGL tells us how old it is.
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.buffer_age", value, "1");
+    if (atoi(value) && RenderEngine::findExtension(
+            eglQueryString(display, EGL_EXTENSIONS), "EGL_EXT_buffer_age")) {
+        mFlags |= BUFFER_AGE;
+    }
     mViewport.makeInvalid();
     mFrame.makeInvalid();
 
@@ -197,13 +211,19 @@ uint32_t DisplayDevice::getPageFlipCount() const {
     return mPageFlipCount;
 }
 
+void DisplayDevice::recordCompositionTime(nsecs_t duration) const {
+    mLastCompositionTime = duration;
+    mAvgCompositionTime = mAvgCompositionTime ?
+            (mAvgCompositionTime * 7 + duration) / 8 : duration;
+}
+
 status_t DisplayDevice::compositionComplete() const {
     return mDisplaySurface->compositionComplete();
 }
 
 void DisplayDevice::flip(const Region& dirty) const
 {
-    mFlinger->getRenderEngine().checkErrors();
+    getRenderEngine().checkErrors();
 
     EGLDisplay dpy = mDisplay;
     EGLSurface surface = mSurface;
@@ -245,6 +265,40 @@ status_t DisplayDevice::prepareFrame(const HWComposer& hwc) const {
     return mDisplaySurface->prepareFrame(compositionType);
 }
 
+void DisplayDevice::addFrameDamage(const Region& damage) const {
+    mPendingDamage.orSelf(damage);
+}
+
+void DisplayDevice::setCompositionLayout(const Vector<int32_t>& layout) const {
+    bool changed = layout.size() != mCompositionLayout.size();
+    for (size_t i=0 ; !changed && i<layout.size() ; i++) {
+        changed = layout[i] != mCompositionLayout[i];
+    }
+    if (changed) {
+        // what's in the framebuffer target depends on which layers HWC
+        // composes, none of the previous buffers can be trusted anymore.
+        mCompositionLayout = layout;
+        mDamageCount = 0;
+        mPendingDamage.set(bounds());
+    }
+}
+
+bool DisplayDevice::getBufferDamage(Region* damage) const {
+    EGLint age = 0;
+    if (!eglQuerySurface(mDisplay, mSurface, EGL_BUFFER_AGE_EXT, &age) ||
+            age <= 0 || size_t(age - 1) > mDamageCount) {
+        return false;
+    }
+    // a buffer of age N missed the frames of the last N-1 swaps
+    Region result(mPendingDamage);
+    for (EGLint i=1 ; i<age ; i++) {
+        size_t index = (mDamageHead + MAX_DAMAGE_HISTORY - i) % MAX_DAMAGE_HISTORY;
+        result.orSelf(mDamageHistory[index]);
+    }
+    *damage = result;
+    return true;
+}
+
 void DisplayDevice::swapBuffers(HWComposer& hwc) const {
     // We need to call eglSwapBuffers() if:
     //  (1) we don't have a hardware composer, or
@@ -256,6 +310,14 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
             (hwc.hasGlesComposition(mHwcDisplayId) &&
              (hwc.supportsFramebufferTarget() || mType >= DISPLAY_VIRTUAL))) {
         EGLBoolean success = eglSwapBuffers(mDisplay, mSurface);
+        if (mFlags & BUFFER_AGE) {
+            mDamageHistory[mDamageHead] = mPendingDamage;
+            mDamageHead = (mDamageHead + 1) % MAX_DAMAGE_HISTORY;
+            if (mDamageCount < MAX_DAMAGE_HISTORY) {
+                mDamageCount++;
+            }
+            mPendingDamage.clear();
+        }
         if (!success) {
             EGLint error = eglGetError();
             if (error == EGL_CONTEXT_LOST ||
@@ -305,10 +367,23 @@ void DisplayDevice::setViewportAndProjection() const {
     size_t w = mDisplayWidth;
     size_t h = mDisplayHeight;
     Rect sourceCrop(0, 0, w, h);
-    mFlinger->getRenderEngine().setViewportAndProjection(w, h, sourceCrop, h,
+    getRenderEngine().setViewportAndProjection(w, h, sourceCrop, h,
         false, Transform::ROT_0);
 }
 
+RenderEngine& DisplayDevice::getRenderEngine() const {
+    return usingOwnRenderEngine() ? *mRenderEngine : mFlinger->getRenderEngine();
+}
+
+bool DisplayDevice::usingOwnRenderEngine() const {
+    return mRenderEngine &&
+            eglGetCurrentContext() == mRenderEngine->getEGLContext();
+}
+
+void DisplayDevice::setRenderEngine(RenderEngine* engine) {
+    mRenderEngine = engine;
+}
+
 // ----------------------------------------------------------------------------
 
 void DisplayDevice::setVisibleLayersSortedByZ(const Vector< sp<Layer> >& layers) {
@@ -327,6 +402,19 @@ const Vector< sp<Layer> >& DisplayDevice::getVisibleLayersSortedByZ() const {
     return mVisibleLayersSortedByZ;
 }
 
+void DisplayDevice::setCoverageBelow(const KeyedVector<Layer const*, Region>& coverage) {
+    mCoverageBelow = coverage;
+}
+
+bool DisplayDevice::getCoverageBelow(Layer const* layer, Region* under) const {
+    ssize_t idx = mCoverageBelow.indexOfKey(layer);
+    if (idx < 0) {
+        return false;
+    }
+    *under = mCoverageBelow.valueAt(idx);
+    return true;
+}
+
 bool DisplayDevice::getSecureLayerVisible() const {
     return mSecureLayerVisible;
 }
@@ -512,27 +600,58 @@ void DisplayDevice::setProjection(int orientation,
     mFrame = frame;
 }
 
-void DisplayDevice::dump(String8& result) const {
-    const Transform& tr(mGlobalTransform);
+void DisplayDevice::getDumpState(DumpState* out) const {
+    out->displayName = mDisplayName;
+    out->type = mType;
+    out->hwcDisplayId = mHwcDisplayId;
+    out->layerStack = mLayerStack;
+    out->width = mDisplayWidth;
+    out->height = mDisplayHeight;
+    out->nativeWindow = mNativeWindow.get();
+    out->orientation = mOrientation;
+    out->globalTransform = mGlobalTransform;
+    out->pageFlipCount = getPageFlipCount();
+    out->isSecure = mIsSecure;
+    out->secureLayerVisible = mSecureLayerVisible;
+    out->powerMode = mPowerMode;
+    out->activeConfig = mActiveConfig;
+    out->numLayers = mVisibleLayersSortedByZ.size();
+    out->ownRenderEngine = mRenderEngine != NULL;
+    out->lastCompositionTime = mLastCompositionTime;
+    out->avgCompositionTime = mAvgCompositionTime;
+    out->viewport = mViewport;
+    out->frame = mFrame;
+    out->scissor = mScissor;
+    out->displaySurface = mDisplaySurface;
+}
+
+/*static*/ void DisplayDevice::dump(String8& result, const DumpState& state) {
+    const Transform& tr(state.globalTransform);
+    const Rect& v(state.viewport);
+    const Rect& f(state.frame);
+    const Rect& s(state.scissor);
     result.appendFormat(
         "+ DisplayDevice: %s\n"
         "   type=%x, hwcId=%d, layerStack=%u, (%4dx%4d), ANativeWindow=%p, orient=%2d (type=%08x), "
         "flips=%u, isSecure=%d, secureVis=%d, powerMode=%d, activeConfig=%d, numLayers=%zu\n"
+        "   composition: %s thread, last=%.3fms, avg=%.3fms\n"
         "   v:[%d,%d,%d,%d], f:[%d,%d,%d,%d], s:[%d,%d,%d,%d],"
         "transform:[[%0.3f,%0.3f,%0.3f][%0.3f,%0.3f,%0.3f][%0.3f,%0.3f,%0.3f]]\n",
-        mDisplayName.string(), mType, mHwcDisplayId,
-        mLayerStack, mDisplayWidth, mDisplayHeight, mNativeWindow.get(),
-        mOrientation, tr.getType(), getPageFlipCount(),
-        mIsSecure, mSecureLayerVisible, mPowerMode, mActiveConfig,
-        mVisibleLayersSortedByZ.size(),
-        mViewport.left, mViewport.top, mViewport.right, mViewport.bottom,
-        mFrame.left, mFrame.top, mFrame.right, mFrame.bottom,
-        mScissor.left, mScissor.top, mScissor.right, mScissor.bottom,
+        state.displayName.string(), state.type, state.hwcDisplayId,
+        state.layerStack, state.width, state.height, state.nativeWindow,
+        state.orientation, tr.getType(), state.pageFlipCount,
+        state.isSecure, state.secureLayerVisible, state.powerMode,
+        state.activeConfig, state.numLayers,
+        state.ownRenderEngine ? "own" : "main",
+        state.lastCompositionTime / 1e6, state.avgCompositionTime / 1e6,
+        v.left, v.top, v.right, v.bottom,
+        f.left, f.top, f.right, f.bottom,
+        s.left, s.top, s.right, s.bottom,
         tr[0][0], tr[1][0], tr[2][0],
         tr[0][1], tr[1][1], tr[2][1],
         tr[0][2], tr[1][2], tr[2][2]);
 
     String8 surfaceDump;
-    mDisplaySurface->dump(surfaceDump);
+    state.displaySurface->dump(surfaceDump);
     result.append(surfaceDump);
 }
@@ -25,6 +25,7 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/String8.h>
 #include <utils/Timers.h>
@@ -39,6 +40,7 @@ namespace android {
 
 struct DisplayInfo;
 class DisplaySurface;
+class RenderEngine;
 class IGraphicBufferProducer;
 class Layer;
 class SurfaceFlinger;
@@ -66,6 +68,7 @@ public:
     enum {
         PARTIAL_UPDATES = 0x00020000, // video driver feature
         SWAP_RECTANGLE  = 0x00080000,
+        BUFFER_AGE      = 0x00100000, // EGL_EXT_buffer_age
     };
 
     enum {
@@ -106,6 +109,8 @@ public:
 
     void                    setVisibleLayersSortedByZ(const Vector< sp<Layer> >& layers);
     const Vector< sp<Layer> >& getVisibleLayersSortedByZ() const;
+    void                    setCoverageBelow(const KeyedVector<Layer const*, Region>& coverage);
+    bool                    getCoverageBelow(Layer const* layer, Region* under) const;
     bool                    getSecureLayerVisible() const;
     Region                  getDirtyRegion(bool repaintEverything) const;
 
@@ -152,6 +157,14 @@ public:
     EGLBoolean makeCurrent(EGLDisplay dpy, EGLContext ctx) const;
     void setViewportAndProjection() const;
 
+    // the engine to draw this display with on the calling thread: its own
+    // one on its DisplayCompositionThread (whose context is current there),
+    // SurfaceFlinger's otherwise, e.g. for screenshots.
+    RenderEngine& getRenderEngine() const;
+    bool usingOwnRenderEngine() const;
+    void setRenderEngine(RenderEngine* engine);
+    bool hasOwnRenderEngine() const { return mRenderEngine != NULL; }
+
     /* ------------------------------------------------------------------------
      * Display power mode management.
      */
@@ -168,11 +181,55 @@ public:
     // release HWC resources (if any) for removable displays
     void disconnect(HWComposer& hwc);
 
+    /* ------------------------------------------------------------------------
+     * Partial composition (BUFFER_AGE displays only).
+     */
+    // accumulates the damage of the frame being composed; it is attributed
+    // to the next buffer actually swapped.
+    void addFrameDamage(const Region& damage) const;
+    // sets the per-layer composition types of this frame; if they differ
+    // from the previous frame, the damage history is discarded.
+    void setCompositionLayout(const Vector<int32_t>& layout) const;
+    // the region of the current back buffer that is out of date, i.e. the
+    // damage accumulated since it was last swapped. returns false if the
+    // whole buffer must be redrawn. the display's surface must be current.
+    bool getBufferDamage(Region* damage) const;
+
     /* ------------------------------------------------------------------------
      * Debugging
      */
     uint32_t getPageFlipCount() const;
-    void dump(String8& result) const;
+    void recordCompositionTime(nsecs_t duration) const;
+
+    // what dump() prints, captured by getDumpState() with SurfaceFlinger's
+    // state lock held so that it can be formatted after releasing it.
+    struct DumpState {
+        String8 displayName;
+        DisplayType type;
+        int32_t hwcDisplayId;
+        uint32_t layerStack;
+        int width;
+        int height;
+        const ANativeWindow* nativeWindow;
+        int orientation;
+        Transform globalTransform;
+        uint32_t pageFlipCount;
+        bool isSecure;
+        bool secureLayerVisible;
+        int powerMode;
+        int activeConfig;
+        size_t numLayers;
+        bool ownRenderEngine;
+        nsecs_t lastCompositionTime;
+        nsecs_t avgCompositionTime;
+        Rect viewport;
+        Rect frame;
+        Rect scissor;
+        // dumped after the lock is released, it has its own
+        sp<DisplaySurface> displaySurface;
+    };
+    void getDumpState(DumpState* out) const;
+    static void dump(String8& result, const DumpState& state);
 
 #ifdef QCOM_BSP
     /* To set egl atribute, EGL_SWAP_BEHAVIOR value
@@ -212,9 +269,30 @@ private:
     // list of visible layers on that display
     Vector< sp<Layer> > mVisibleLayersSortedByZ;
 
+    // for each visible layer without a buffer, the area (in screen space)
+    // covered by the layers below it. rebuilt with mVisibleLayersSortedByZ.
+    KeyedVector<Layer const*, Region> mCoverageBelow;
+
     // Whether we have a visible secure layer on this display
     bool mSecureLayerVisible;
 
+    // damage of the last MAX_DAMAGE_HISTORY swapped buffers (ring, most
+    // recent at mDamageHead-1) and of the frames composed since the last
+    // swap, in screen space.
+    enum { MAX_DAMAGE_HISTORY = 4 };
+    mutable Region mDamageHistory[MAX_DAMAGE_HISTORY];
+    mutable size_t mDamageHead;
+    mutable size_t mDamageCount;
+    mutable Region mPendingDamage;
+    mutable Vector<int32_t> mCompositionLayout;
+
+    // set when the display is composed on its own thread; owned by it.
+    RenderEngine* mRenderEngine;
+
+    // duration of the last composition and its moving average
+    mutable nsecs_t mLastCompositionTime;
+    mutable nsecs_t mAvgCompositionTime;
+
 
     /*
      * Transaction state
@@ -1239,101 +1239,161 @@ static String8 getFormatStr(PixelFormat format) {
     }
 }
 
-void HWComposer::dump(String8& result) const {
+void HWComposer::getDumpState(DumpState* out) const {
     Mutex::Autolock _l(mDrawLock);
-    if (mHwc) {
-        result.appendFormat("Hardware Composer state (version %08x):\n", hwcApiVersion(mHwc));
-        result.appendFormat("  mDebugForceFakeVSync=%d\n", mDebugForceFakeVSync);
-        for (size_t i=0 ; i<mNumDisplays ; i++) {
-            const DisplayData& disp(mDisplayData[i]);
-            if (!disp.connected)
-                continue;
-
-            const Vector< sp<Layer> >& visibleLayersSortedByZ =
-                    mFlinger->getLayerSortedByZForHwcDisplay(i);
-
-
-            result.appendFormat("  Display[%zd] configurations (* current):\n", i);
-            for (size_t c = 0; c < disp.configs.size(); ++c) {
-                const DisplayConfig& config(disp.configs[c]);
-                result.appendFormat("    %s%zd: %ux%u, xdpi=%f, ydpi=%f, secure=%d refresh=%" PRId64 "\n",
-                        c == disp.currentConfig ? "* " : "", c, config.width, config.height,
-                        config.xdpi, config.ydpi, config.secure, config.refresh);
-            }
-
-            if (disp.list) {
-                result.appendFormat(
-                        "  numHwLayers=%zu, flags=%08x\n",
-                        disp.list->numHwLayers, disp.list->flags);
-                result.append(
-
-                        "    type   |  handle  | hint | flag | tr | blnd |  format     |     source crop(l,t,r,b)       |           frame        |      dirtyRect         |  name \n"
-                        "------------+----------+----------+----------+----+-------+----------+-----------------------------------+---------------------------+-------------------\n");
-                //      " __________ | ________ | ________ | ________ | __ | _____ | ________ | [_____._,_____._,_____._,_____._] | [_____,_____,_____,_____] | [_____,_____,_____,_____] |
-                for (size_t i=0 ; i<disp.list->numHwLayers ; i++) {
-                    const hwc_layer_1_t&l = disp.list->hwLayers[i];
-                    int32_t format = -1;
-                    String8 name("unknown");
-
-                    if (i < visibleLayersSortedByZ.size()) {
-                        const sp<Layer>& layer(visibleLayersSortedByZ[i]);
-                        const sp<GraphicBuffer>& buffer(
-                                layer->getActiveBuffer());
-                        if (buffer != NULL) {
-                            format = buffer->getPixelFormat();
-                        }
-                        name = layer->getName();
-                    }
-
-                    int type = l.compositionType;
-                    if (type == HWC_FRAMEBUFFER_TARGET) {
-                        name = "HWC_FRAMEBUFFER_TARGET";
-                        format = disp.format;
-                    }
-
-                    static char const* compositionTypeName[] = {
-                            "GLES",
-                            "HWC",
-                            "BKGND",
-                            "FB TARGET",
-                            "SIDEBAND",
-                            "HWC_CURSOR",
-                            "FB_BLIT",
-                            "UNKNOWN"};
-                    if (type >= NELEM(compositionTypeName))
-                        type = NELEM(compositionTypeName) - 1;
-
-                    String8 formatStr = getFormatStr(format);
-                    if (hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_3)) {
-                        result.appendFormat(
-                                " %9s | %08" PRIxPTR " | %04x | %04x | %02x | %04x | %-11s |%7.1f,%7.1f,%7.1f,%7.1f |%5d,%5d,%5d,%5d | [%5d,%5d,%5d,%5d] | %s\n",
-                                        compositionTypeName[type],
-                                        intptr_t(l.handle), l.hints, l.flags, l.transform, l.blending, formatStr.string(),
-                                        l.sourceCropf.left, l.sourceCropf.top, l.sourceCropf.right, l.sourceCropf.bottom,
-                                        l.displayFrame.left, l.displayFrame.top, l.displayFrame.right, l.displayFrame.bottom,
-                                        l.dirtyRect.left, l.dirtyRect.top, l.dirtyRect.right, l.dirtyRect.bottom,
-                                        name.string());
-                    } else {
-                        result.appendFormat(
-                                " %9s | %08" PRIxPTR " | %04x | %04x | %02x | %04x | %-11s |%7d,%7d,%7d,%7d |%5d,%5d,%5d,%5d | [%5d,%5d,%5d,%5d] | %s\n",
-                                        compositionTypeName[type],
-                                        intptr_t(l.handle), l.hints, l.flags, l.transform, l.blending, formatStr.string(),
-                                        l.sourceCrop.left, l.sourceCrop.top, l.sourceCrop.right, l.sourceCrop.bottom,
-                                        l.displayFrame.left, l.displayFrame.top, l.displayFrame.right, l.displayFrame.bottom,
-                                        l.dirtyRect.left, l.dirtyRect.top, l.dirtyRect.right, l.dirtyRect.bottom,
-                                        name.string());
+    out->present = mHwc != NULL;
+    out->displays.clear();
+    out->hwcDump.setTo("");
+    if (!mHwc) {
+        return;
+    }
+    out->version = hwcApiVersion(mHwc);
+    out->floatSourceCrop = hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_3);
+    out->debugForceFakeVSync = mDebugForceFakeVSync;
+    for (size_t i=0 ; i<mNumDisplays ; i++) {
+        const DisplayData& disp(mDisplayData[i]);
+        if (!disp.connected)
+            continue;
+
+        const Vector< sp<Layer> >& visibleLayersSortedByZ =
+                mFlinger->getLayerSortedByZForHwcDisplay(i);
+
+        DumpState::DisplayState display;
+        display.id = i;
+        display.configs = disp.configs;
+        display.currentConfig = disp.currentConfig;
+        display.hasList = disp.list != NULL;
+        display.numHwLayers = 0;
+        display.listFlags = 0;
+        if (disp.list) {
+            display.numHwLayers = disp.list->numHwLayers;
+            display.listFlags = disp.list->flags;
+            for (size_t j=0 ; j<disp.list->numHwLayers ; j++) {
+                const hwc_layer_1_t&l = disp.list->hwLayers[j];
+                DumpState::LayerState layer;
+                layer.format = -1;
+                layer.name = "unknown";
+                if (j < visibleLayersSortedByZ.size()) {
+                    const sp<Layer>& source(visibleLayersSortedByZ[j]);
+                    const sp<GraphicBuffer>& buffer(source->getActiveBuffer());
+                    if (buffer != NULL) {
+                        layer.format = buffer->getPixelFormat();
                     }
+                    layer.name = source->getName();
                 }
+                layer.compositionType = l.compositionType;
+                if (l.compositionType == HWC_FRAMEBUFFER_TARGET) {
+                    layer.name = "HWC_FRAMEBUFFER_TARGET";
+                    layer.format = disp.format;
+                }
+                layer.handle = intptr_t(l.handle);
+                layer.hints = l.hints;
+                layer.flags = l.flags;
+                layer.transform = l.transform;
+                layer.blending = l.blending;
+                if (out->floatSourceCrop) {
+                    layer.sourceCrop[0] = l.sourceCropf.left;
+                    layer.sourceCrop[1] = l.sourceCropf.top;
+                    layer.sourceCrop[2] = l.sourceCropf.right;
+                    layer.sourceCrop[3] = l.sourceCropf.bottom;
+                } else {
+                    layer.sourceCrop[0] = l.sourceCrop.left;
+                    layer.sourceCrop[1] = l.sourceCrop.top;
+                    layer.sourceCrop[2] = l.sourceCrop.right;
+                    layer.sourceCrop[3] = l.sourceCrop.bottom;
+                }
+                layer.displayFrame[0] = l.displayFrame.left;
+                layer.displayFrame[1] = l.displayFrame.top;
+                layer.displayFrame[2] = l.displayFrame.right;
+                layer.displayFrame[3] = l.displayFrame.bottom;
+                layer.dirtyRect[0] = l.dirtyRect.left;
+                layer.dirtyRect[1] = l.dirtyRect.top;
+                layer.dirtyRect[2] = l.dirtyRect.right;
+                layer.dirtyRect[3] = l.dirtyRect.bottom;
+                display.layers.add(layer);
             }
         }
+        out->displays.add(display);
     }
 
-    if (mHwc && mHwc->dump) {
+    if (mHwc->dump) {
         const size_t SIZE = 4096;
         char buffer[SIZE];
         mHwc->dump(mHwc, buffer, SIZE);
-        result.append(buffer);
+        out->hwcDump.setTo(buffer);
+    }
+}
+
+/*static*/ void HWComposer::dump(String8& result, const DumpState& state) {
+    if (!state.present) {
+        return;
     }
+    result.appendFormat("Hardware Composer state (version %08x):\n", state.version);
+    result.appendFormat("  mDebugForceFakeVSync=%d\n", state.debugForceFakeVSync);
+    for (size_t d=0 ; d<state.displays.size() ; d++) {
+        const DumpState::DisplayState& disp(state.displays[d]);
+
+        result.appendFormat("  Display[%zd] configurations (* current):\n", disp.id);
+        for (size_t c = 0; c < disp.configs.size(); ++c) {
+            const DisplayConfig& config(disp.configs[c]);
+            result.appendFormat("    %s%zd: %ux%u, xdpi=%f, ydpi=%f, secure=%d refresh=%" PRId64 "\n",
+                    c == disp.currentConfig ? "* " : "", c, config.width, config.height,
+                    config.xdpi, config.ydpi, config.secure, config.refresh);
+        }
+
+        if (disp.hasList) {
+            result.appendFormat(
+                    "  numHwLayers=%zu, flags=%08x\n",
+                    disp.numHwLayers, disp.listFlags);
+            result.append(
+
+                    "    type   |  handle  | hint | flag | tr | blnd |  format     |     source crop(l,t,r,b)       |           frame        |      dirtyRect         |  name \n"
+                    "------------+----------+----------+----------+----+-------+----------+-----------------------------------+---------------------------+-------------------\n");
+            //      " __________ | ________ | ________ | ________ | __ | _____ | ________ | [_____._,_____._,_____._,_____._] | [_____,_____,_____,_____] | [_____,_____,_____,_____] |
+            for (size_t i=0 ; i<disp.layers.size() ; i++) {
+                const DumpState::LayerState& l(disp.layers[i]);
+
+                static char const* compositionTypeName[] = {
+                        "GLES",
+                        "HWC",
+                        "BKGND",
+                        "FB TARGET",
+                        "SIDEBAND",
+                        "HWC_CURSOR",
+                        "FB_BLIT",
+                        "UNKNOWN"};
+                int type = l.compositionType;
+                if (type >= NELEM(compositionTypeName))
+                    type = NELEM(compositionTypeName) - 1;
+
+                String8 formatStr = getFormatStr(l.format);
+                const float* crop = l.sourceCrop;
+                const int32_t* frame = l.displayFrame;
+                const int32_t* dirty = l.dirtyRect;
+                if (state.floatSourceCrop) {
+                    result.appendFormat(
+                            " %9s | %08" PRIxPTR " | %04x | %04x | %02x | %04x | %-11s |%7.1f,%7.1f,%7.1f,%7.1f |%5d,%5d,%5d,%5d | [%5d,%5d,%5d,%5d] | %s\n",
+                                    compositionTypeName[type],
+                                    l.handle, l.hints, l.flags, l.transform, l.blending, formatStr.string(),
+                                    crop[0], crop[1], crop[2], crop[3],
+                                    frame[0], frame[1], frame[2], frame[3],
+                                    dirty[0], dirty[1], dirty[2], dirty[3],
+                                    l.name.string());
+                } else {
+                    result.appendFormat(
+                            " %9s | %08" PRIxPTR " | %04x | %04x | %02x | %04x | %-11s |%7d,%7d,%7d,%7d |%5d,%5d,%5d,%5d | [%5d,%5d,%5d,%5d] | %s\n",
+                                    compositionTypeName[type],
+                                    l.handle, l.hints, l.flags, l.transform, l.blending, formatStr.string(),
+                                    int(crop[0]), int(crop[1]), int(crop[2]), int(crop[3]),
+                                    frame[0], frame[1], frame[2], frame[3],
+                                    dirty[0], dirty[1], dirty[2], dirty[3],
+                                    l.name.string());
+                }
+            }
+        }
+    }
+
+    result.append(state.hwcDump);
 }
 
 // ---------------------------------------------------------------------------
@@ -27,6 +27,7 @@
 #include <utils/BitSet.h>
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
+#include <utils/String8.h>
 #include <utils/StrongPointer.h>
 #include <utils/Thread.h>
 #include <utils/Timers.h>
@@ -52,7 +53,6 @@ class FloatRect;
 class GraphicBuffer;
 class NativeHandle;
 class Region;
-class String8;
 class SurfaceFlinger;
 
 class HWComposer
@@ -319,7 +319,43 @@ public:
     friend class VSyncThread;
 
     // for debugging ----------------------------------------------------------
-    void dump(String8& out) const;
+
+    // what dump() prints, captured by getDumpState(). the layer names come
+    // from SurfaceFlinger's layer lists, so its state lock must be held;
+    // the state can then be formatted after releasing it.
+    struct DumpState {
+        struct LayerState {
+            String8 name;
+            int32_t format;
+            int32_t compositionType;
+            intptr_t handle;
+            uint32_t hints;
+            uint32_t flags;
+            uint32_t transform;
+            int32_t blending;
+            float sourceCrop[4];
+            int32_t displayFrame[4];
+            int32_t dirtyRect[4];
+        };
+        struct DisplayState {
+            size_t id;
+            Vector<DisplayConfig> configs;
+            size_t currentConfig;
+            bool hasList;
+            size_t numHwLayers;
+            uint32_t listFlags;
+            Vector<LayerState> layers;
+        };
+        bool present;
+        uint32_t version;
+        bool floatSourceCrop;
+        bool debugForceFakeVSync;
+        Vector<DisplayState> displays;
+        // the h/w composer's own dump
+        String8 hwcDump;
+    };
+    void getDumpState(DumpState* out) const;
+    static void dump(String8& out, const DumpState& state);
 
 private:
     void loadHwcModule();
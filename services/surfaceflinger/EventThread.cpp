@@ -95,15 +95,45 @@ sp<EventThread::Connection> EventThread::createEventConnection() const {
 status_t EventThread::registerDisplayEventConnection(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
+    // connections are only held weakly here, forget the dead ones
+    for (size_t i=mDisplayEventConnections.size() ; i-- > 0 ; ) {
+        if (mDisplayEventConnections[i].promote() == NULL) {
+            mDisplayEventConnections.removeAt(i);
+        }
+    }
     mDisplayEventConnections.add(connection);
     mCondition.broadcast();
     return NO_ERROR;
 }
 
-void EventThread::removeDisplayEventConnection(
-        const wp<EventThread::Connection>& connection) {
-    Mutex::Autolock _l(mLock);
-    mDisplayEventConnections.remove(connection);
+void EventThread::setConnectionCountLocked(
+        const sp<EventThread::Connection>& connection, int32_t count) {
+    const int32_t oldCount = connection->count;
+    if (oldCount == count) {
+        return;
+    }
+    if (oldCount == 0) {
+        mOneShotConnections.remove(connection);
+    } else if (oldCount > 0) {
+        ssize_t index = mContinuousConnections.indexOfKey(oldCount);
+        if (index >= 0) {
+            mContinuousConnections.editValueAt(index).remove(connection);
+            if (mContinuousConnections.valueAt(index).isEmpty()) {
+                mContinuousConnections.removeItemsAt(index);
+            }
+        }
+    }
+    connection->count = count;
+    if (count == 0) {
+        mOneShotConnections.add(connection);
+    } else if (count > 0) {
+        ssize_t index = mContinuousConnections.indexOfKey(count);
+        if (index < 0) {
+            index = mContinuousConnections.add(count,
+                    SortedVector< sp<Connection> >());
+        }
+        mContinuousConnections.editValueAt(index).add(connection);
+    }
 }
 
 void EventThread::setVsyncRate(uint32_t count,
@@ -112,7 +142,7 @@ void EventThread::setVsyncRate(uint32_t count,
         Mutex::Autolock _l(mLock);
         const int32_t new_count = (count == 0) ? -1 : count;
         if (connection->count != new_count) {
-            connection->count = new_count;
+            setConnectionCountLocked(connection, new_count);
             mCondition.broadcast();
         }
     }
@@ -122,7 +152,7 @@ void EventThread::requestNextVsync(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
     if (connection->count < 0) {
-        connection->count = 0;
+        setConnectionCountLocked(connection, 0);
         mCondition.broadcast();
     }
 }
@@ -177,6 +207,10 @@ bool EventThread::threadLoop() {
 
     // dispatch events to listeners...
     const size_t count = signalConnections.size();
+    Vector<status_t> results;
+    Vector<nsecs_t> deliveryTimes;
+    results.setCapacity(count);
+    deliveryTimes.setCapacity(count);
     for (size_t i=0 ; i<count ; i++) {
         const sp<Connection>& conn(signalConnections[i]);
         // now see if we still need to report this event
@@ -189,16 +223,44 @@ bool EventThread::threadLoop() {
             // Right-now we don't have the ability to do this.
             ALOGW("EventThread: dropping event (%08x) for connection %p",
                     event.header.type, conn.get());
-        } else if (err < 0) {
+        }
+        results.add(err);
+        deliveryTimes.add(systemTime());
+    }
+
+    Mutex::Autolock _l(mLock);
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Connection>& conn(signalConnections[i]);
+        const status_t err = results[i];
+        recordDeliveryLocked(conn, event, err, deliveryTimes[i]);
+        if (err < 0 && err != -EAGAIN && err != -EWOULDBLOCK) {
             // handle any other error on the pipe as fatal. the only
             // reasonable thing to do is to clean-up this connection.
             // The most common error we'll get here is -EPIPE.
-            removeDisplayEventConnection(signalConnections[i]);
+            setConnectionCountLocked(conn, -1);
+            mDisplayEventConnections.remove(conn);
         }
     }
     return true;
 }
 
+void EventThread::recordDeliveryLocked(const sp<EventThread::Connection>& connection,
+        const DisplayEventReceiver::Event& event, status_t err, nsecs_t now) {
+    if (err == -EAGAIN || err == -EWOULDBLOCK) {
+        connection->dropped++;
+    } else if (err >= 0) {
+        connection->delivered++;
+        if (event.header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+            const nsecs_t latency = now - event.header.timestamp;
+            connection->lastLatency = latency;
+            connection->totalLatency += latency;
+            if (latency > connection->maxLatency) {
+                connection->maxLatency = latency;
+            }
+        }
+    }
+}
+
 // This will return when (1) a vsync event has been received, and (2) there was
 // at least one connection interested in receiving it when we started waiting.
 Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
@@ -209,7 +271,6 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
 
     do {
         bool eventPending = false;
-        bool waitForVSync = false;
 
         size_t vsyncCount = 0;
         nsecs_t timestamp = 0;
@@ -235,43 +296,47 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
         }
 
         // find out connections waiting for events
-        size_t count = mDisplayEventConnections.size();
-        for (size_t i=0 ; i<count ; i++) {
-            sp<Connection> connection(mDisplayEventConnections[i].promote());
-            if (connection != NULL) {
-                bool added = false;
-                if (connection->count >= 0) {
-                    // we need vsync events because at least
-                    // one connection is waiting for it
-                    waitForVSync = true;
-                    if (timestamp) {
-                        // we consume the event only if it's time
-                        // (ie: we received a vsync event)
-                        if (connection->count == 0) {
-                            // fired this time around
-                            connection->count = -1;
-                            signalConnections.add(connection);
-                            added = true;
-                        } else if (connection->count == 1 ||
-                                (vsyncCount % connection->count) == 0) {
-                            // continuous event, and time to report it
-                            signalConnections.add(connection);
-                            added = true;
-                        }
+        const bool waitForVSync = !mOneShotConnections.isEmpty() ||
+                !mContinuousConnections.isEmpty();
+        if (timestamp) {
+            // we consume the event only if it's time
+            // (ie: we received a vsync event)
+            const size_t oneShotCount = mOneShotConnections.size();
+            for (size_t i=0 ; i<oneShotCount ; i++) {
+                // fired this time around
+                const sp<Connection>& connection(mOneShotConnections[i]);
+                connection->count = -1;
+                signalConnections.add(connection);
+            }
+            mOneShotConnections.clear();
+
+            // continuous events, when it's time to report them
+            const size_t rateCount = mContinuousConnections.size();
+            for (size_t i=0 ; i<rateCount ; i++) {
+                const int32_t rate = mContinuousConnections.keyAt(i);
+                if (rate == 1 || (vsyncCount % rate) == 0) {
+                    const SortedVector< sp<Connection> >& connections(
+                            mContinuousConnections.valueAt(i));
+                    for (size_t j=0 ; j<connections.size() ; j++) {
+                        signalConnections.add(connections[j]);
                     }
                 }
-
-                if (eventPending && !timestamp && !added) {
-                    // we don't have a vsync event to process
-                    // (timestamp==0), but we have some pending
-                    // messages.
+            }
+        } else if (eventPending) {
+            // we don't have a vsync event to process
+            // (timestamp==0), but we have some pending
+            // messages, which go to everyone.
+            size_t count = mDisplayEventConnections.size();
+            for (size_t i=0 ; i<count ; i++) {
+                sp<Connection> connection(mDisplayEventConnections[i].promote());
+                if (connection != NULL) {
                     signalConnections.add(connection);
+                } else {
+                    // we couldn't promote this reference, the connection has
+                    // died, so clean-up!
+                    mDisplayEventConnections.removeAt(i);
+                    --i; --count;
                 }
-            } else {
-                // we couldn't promote this reference, the connection has
-                // died, so clean-up!
-                mDisplayEventConnections.removeAt(i);
-                --i; --count;
             }
         }
 
@@ -361,14 +426,27 @@ void EventThread::dump(String8& result) const {
             mDebugVsyncEnabled?"enabled":"disabled");
     result.appendFormat("  soft-vsync: %s\n",
             mUseSoftwareVSync?"enabled":"disabled");
-    result.appendFormat("  numListeners=%zu,\n  events-delivered: %u\n",
-            mDisplayEventConnections.size(),
+    result.appendFormat("  numListeners=%zu (waiting: one-shot=%zu, continuous rates=%zu),\n"
+            "  events-delivered: %u\n",
+            mDisplayEventConnections.size(), mOneShotConnections.size(),
+            mContinuousConnections.size(),
             mVSyncEvent[DisplayDevice::DISPLAY_PRIMARY].vsync.count);
     for (size_t i=0 ; i<mDisplayEventConnections.size() ; i++) {
         sp<Connection> connection =
                 mDisplayEventConnections.itemAt(i).promote();
-        result.appendFormat("    %p: count=%d\n",
-                connection.get(), connection!=NULL ? connection->count : 0);
+        if (connection == NULL) {
+            result.appendFormat("    %p: dead\n",
+                    mDisplayEventConnections.itemAt(i).unsafe_get());
+            continue;
+        }
+        const uint32_t delivered = connection->delivered;
+        result.appendFormat("    %p: count=%d, delivered=%u, dropped=%u, "
+                "latency (ms): last=%.3f, avg=%.3f, max=%.3f\n",
+                connection.get(), connection->count,
+                delivered, connection->dropped,
+                connection->lastLatency / 1e6,
+                delivered ? connection->totalLatency / 1e6 / delivered : 0.0,
+                connection->maxLatency / 1e6);
     }
 }
 
@@ -376,13 +454,15 @@ void EventThread::dump(String8& result) const {
 
 EventThread::Connection::Connection(
         const sp<EventThread>& eventThread)
-    : count(-1), mEventThread(eventThread), mChannel(new BitTube())
+    : count(-1), delivered(0), dropped(0),
+      lastLatency(0), maxLatency(0), totalLatency(0),
+      mEventThread(eventThread), mChannel(new BitTube())
 {
 }
 
 EventThread::Connection::~Connection() {
-    // do nothing here -- clean-up will happen automatically
-    // when the main thread wakes up
+    // do nothing here -- EventThread only holds strong references while
+    // we wait for vsync, the weak one is cleaned-up lazily
 }
 
 void EventThread::Connection::onFirstRef() {
@@ -24,6 +24,7 @@
 #include <gui/IDisplayEventConnection.h>
 
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/threads.h>
 #include <utils/SortedVector.h>
 
@@ -64,6 +65,13 @@ class EventThread : public Thread, private VSyncSource::Callback {
         // count ==-1 : one-shot event that fired this round / disabled
         int32_t count;
 
+        // delivery statistics, protected by EventThread::mLock
+        uint32_t delivered;
+        uint32_t dropped;
+        nsecs_t lastLatency;
+        nsecs_t maxLatency;
+        nsecs_t totalLatency;
+
     private:
         virtual ~Connection();
         virtual void onFirstRef();
@@ -105,7 +113,10 @@ private:
 
     virtual void onVSyncEvent(nsecs_t timestamp);
 
-    void removeDisplayEventConnection(const wp<Connection>& connection);
+    // moves connection to the active list matching count
+    void setConnectionCountLocked(const sp<Connection>& connection, int32_t count);
+    void recordDeliveryLocked(const sp<Connection>& connection,
+            const DisplayEventReceiver::Event& event, status_t err, nsecs_t now);
     void enableVSyncLocked();
     void disableVSyncLocked();
     void sendVsyncHintOnLocked();
@@ -118,7 +129,13 @@ private:
     mutable Condition mCondition;
 
     // protected by mLock
+    // every connection, for the events all of them get (hotplug) and dump.
     SortedVector< wp<Connection> > mDisplayEventConnections;
+    // connections waiting for vsync are also held strongly here, so that
+    // dispatching a vsync only visits the ones it's for: pending one-shot
+    // requests, and continuous connections grouped by vsync rate.
+    SortedVector< sp<Connection> > mOneShotConnections;
+    KeyedVector< int32_t, SortedVector< sp<Connection> > > mContinuousConnections;
     Vector< DisplayEventReceiver::Event > mPendingEvents;
     DisplayEventReceiver::Event mVSyncEvent[DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES];
     bool mUseSoftwareVSync;
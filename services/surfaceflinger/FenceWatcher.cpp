@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// the makefile tags everything "SurfaceFlinger"; the watcher logs as itself
+#undef LOG_TAG
+#define LOG_TAG "FenceWatcher"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <ui/Fence.h>
+
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include "FenceWatcher.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// events handled per epoll_wait
+static const int EPOLL_MAX_EVENTS = 16;
+
+Mutex FenceWatcher::sInstanceLock;
+sp<FenceWatcher> FenceWatcher::sInstance;
+
+sp<FenceWatcher> FenceWatcher::getInstance() {
+    Mutex::Autolock _l(sInstanceLock);
+    if (sInstance == NULL) {
+        int epollFd = epoll_create(EPOLL_MAX_EVENTS);
+        if (epollFd < 0) {
+            ALOGE("can't create the fence watcher (%s), fences will be polled",
+                    strerror(errno));
+            return NULL;
+        }
+        sp<FenceWatcher> watcher = new FenceWatcher(epollFd);
+        if (watcher->run("FenceWatcher", PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+            return NULL;
+        }
+        sInstance = watcher;
+    }
+    return sInstance;
+}
+
+FenceWatcher::FenceWatcher(int epollFd)
+    : mEpollFd(epollFd),
+      mCallbackCount(0),
+      mSignalTimeQueries(0) {
+}
+
+FenceWatcher::~FenceWatcher() {
+    for (size_t i=0 ; i<mWatches.size() ; i++) {
+        close(mWatches.valueAt(i).fd);
+    }
+    close(mEpollFd);
+}
+
+status_t FenceWatcher::watch(const sp<Fence>& fence,
+        const sp<Callback>& callback) {
+    if (fence == NULL || !fence->isValid()) {
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mWatches.indexOfKey(fence.get());
+    if (index < 0) {
+        Watch watch;
+        watch.fence = fence;
+        watch.fd = fence->dup();
+        if (watch.fd < 0) {
+            return -errno;
+        }
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = const_cast<Fence*>(fence.get());
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, watch.fd, &event) < 0) {
+            status_t err = -errno;
+            ALOGE("can't watch fence fd %d (%s)", watch.fd, strerror(-err));
+            close(watch.fd);
+            return err;
+        }
+        index = mWatches.add(fence.get(), watch);
+    }
+    mWatches.editValueAt(index).callbacks.add(callback);
+    return NO_ERROR;
+}
+
+bool FenceWatcher::threadLoop() {
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int count = epoll_wait(mEpollFd, events, EPOLL_MAX_EVENTS, -1);
+    if (count < 0) {
+        if (errno != EINTR) {
+            ALOGE("epoll_wait failed (%s)", strerror(errno));
+            usleep(100000);
+        }
+        return true;
+    }
+
+    for (int i=0 ; i<count ; i++) {
+        Watch watch;
+        {
+            Mutex::Autolock _l(mLock);
+            ssize_t index = mWatches.indexOfKey(
+                    static_cast<const Fence*>(events[i].data.ptr));
+            if (index < 0) {
+                continue;
+            }
+            watch = mWatches.valueAt(index);
+            mWatches.removeItemsAt(index);
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, watch.fd, NULL);
+            close(watch.fd);
+            mCallbackCount += watch.callbacks.size();
+            mSignalTimeQueries++;
+        }
+
+        // the callbacks take their own locks, call them without ours so
+        // that they can watch other fences
+        ATRACE_NAME("onFenceSignaled");
+        const nsecs_t signalTime = watch.fence->getSignalTime();
+        for (size_t j=0 ; j<watch.callbacks.size() ; j++) {
+            watch.callbacks[j]->onFenceSignaled(watch.fence, signalTime);
+        }
+    }
+    return true;
+}
+
+void FenceWatcher::dump(String8& result) const {
+    Mutex::Autolock _l(mLock);
+    size_t pending = 0;
+    for (size_t i=0 ; i<mWatches.size() ; i++) {
+        pending += mWatches.valueAt(i).callbacks.size();
+    }
+    result.appendFormat("FenceWatcher: %zu fences pending (%zu callbacks), "
+            "%" PRIu64 " callbacks from %" PRIu64 " signal time queries\n",
+            mWatches.size(), pending, mCallbackCount, mSignalTimeQueries);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_FENCE_WATCHER_H
+#define ANDROID_SF_FENCE_WATCHER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+class Fence;
+class String8;
+
+// FenceWatcher waits for fences on a thread of its own and tells the
+// callbacks watching them when they signal, so that FrameTracker and
+// DispSync don't have to ask every pending fence for its signal time each
+// frame. It epolls the fences, and reads the signal time of each one once
+// however many callbacks watch it; the present fence, for instance, is
+// watched by DispSync and by the frame tracker of every updating layer.
+class FenceWatcher : public Thread {
+public:
+    class Callback : public virtual RefBase {
+    public:
+        // called on the watcher thread once fence has signaled, with the
+        // time it signaled at as returned by Fence::getSignalTime.
+        virtual void onFenceSignaled(const sp<Fence>& fence,
+                nsecs_t signalTime) = 0;
+    protected:
+        virtual ~Callback() { }
+    };
+
+    // the watcher shared by SurfaceFlinger, started on first use. NULL if
+    // it can't be started, in which case fences have to be polled.
+    static sp<FenceWatcher> getInstance();
+
+    // calls callback once fence has signaled. Returns an error if the fence
+    // isn't valid or can't be watched.
+    status_t watch(const sp<Fence>& fence, const sp<Callback>& callback);
+
+    void dump(String8& result) const;
+
+private:
+    FenceWatcher(int epollFd);
+    virtual ~FenceWatcher();
+
+    virtual bool threadLoop();
+
+    struct Watch {
+        sp<Fence> fence;
+        int fd;     // our dup of the fence's fd, registered with epoll
+        Vector< sp<Callback> > callbacks;
+    };
+
+    static Mutex sInstanceLock;
+    static sp<FenceWatcher> sInstance;
+
+    const int mEpollFd;
+
+    mutable Mutex mLock;
+    // pending fences, the key is the epoll data of their fd
+    KeyedVector<const Fence*, Watch> mWatches;
+    // for dumpsys: callbacks called, and the getSignalTime() calls made
+    // for them (one per signaled fence)
+    uint64_t mCallbackCount;
+    uint64_t mSignalTimeQueries;
+};
+
+// A FenceWatcher::Callback forwarding to onFenceSignaled() of an object that
+// may be destroyed before the fences it watched signal. The object calls
+// detach() from its destructor, after which the callback does nothing.
+template <typename T>
+class FenceWatcherCallback : public FenceWatcher::Callback {
+public:
+    explicit FenceWatcherCallback(T* target) : mTarget(target) { }
+
+    void detach() {
+        Mutex::Autolock _l(mLock);
+        mTarget = NULL;
+    }
+
+    virtual void onFenceSignaled(const sp<Fence>& fence, nsecs_t signalTime) {
+        Mutex::Autolock _l(mLock);
+        if (mTarget != NULL) {
+            mTarget->onFenceSignaled(fence, signalTime);
+        }
+    }
+
+private:
+    Mutex mLock;
+    T* mTarget;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_FENCE_WATCHER_H
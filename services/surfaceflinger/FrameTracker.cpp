@@ -26,16 +26,34 @@
 
 #include <utils/String8.h>
 
+#include "FenceWatcher.h"
 #include "FrameTracker.h"
 #include "EventLog/EventLog.h"
 
 namespace android {
 
+// Fence::getSignalTime() returns INT64_MAX for a pending fence and -1 for a
+// fence in an error state; like DispSync, only other times are recorded.
+static inline bool isSignalTimeValid(nsecs_t signalTime) {
+    return signalTime >= 0 && signalTime < INT64_MAX;
+}
+
 FrameTracker::FrameTracker() :
         mOffset(0),
         mNumFences(0),
-        mDisplayPeriod(0) {
+        mDisplayPeriod(0),
+        mFenceWatcher(FenceWatcher::getInstance()) {
     resetFrameCountersLocked();
+    if (mFenceWatcher != NULL) {
+        mFenceCallback = new FenceWatcherCallback<FrameTracker>(this);
+    }
+}
+
+FrameTracker::~FrameTracker() {
+    if (mFenceCallback != NULL) {
+        // waits for a callback in progress
+        mFenceCallback->detach();
+    }
 }
 
 void FrameTracker::setDesiredPresentTime(nsecs_t presentTime) {
@@ -50,6 +68,9 @@ void FrameTracker::setFrameReadyTime(nsecs_t readyTime) {
 
 void FrameTracker::setFrameReadyFence(const sp<Fence>& readyFence) {
     Mutex::Autolock lock(mMutex);
+    // Ready fences are a layer's acquire fences, one per latched buffer, and
+    // usually signaled by the time they are processed, so they are polled
+    // rather than handed to the FenceWatcher.
     mFrameRecords[mOffset].frameReadyFence = readyFence;
     mNumFences++;
 }
@@ -62,6 +83,8 @@ void FrameTracker::setActualPresentTime(nsecs_t presentTime) {
 void FrameTracker::setActualPresentFence(const sp<Fence>& readyFence) {
     Mutex::Autolock lock(mMutex);
     mFrameRecords[mOffset].actualPresentFence = readyFence;
+    mFrameRecords[mOffset].actualPresentFenceWatched =
+            watchFenceLocked(readyFence);
     mNumFences++;
 }
 
@@ -93,6 +116,7 @@ void FrameTracker::advanceFrame() {
         // We're clobbering an unsignaled fence, so we need to decrement the
         // fence count.
         mFrameRecords[mOffset].actualPresentFence = NULL;
+        mFrameRecords[mOffset].actualPresentFenceWatched = false;
         mNumFences--;
     }
 
@@ -109,6 +133,7 @@ void FrameTracker::clearStats() {
         mFrameRecords[i].actualPresentTime = 0;
         mFrameRecords[i].frameReadyFence.clear();
         mFrameRecords[i].actualPresentFence.clear();
+        mFrameRecords[i].actualPresentFenceWatched = false;
     }
     mNumFences = 0;
     mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
@@ -159,7 +184,7 @@ void FrameTracker::processFencesLocked() const {
         const sp<Fence>& rfence = records[idx].frameReadyFence;
         if (rfence != NULL) {
             records[idx].frameReadyTime = rfence->getSignalTime();
-            if (records[idx].frameReadyTime < INT64_MAX) {
+            if (isSignalTimeValid(records[idx].frameReadyTime)) {
                 records[idx].frameReadyFence = NULL;
                 numFences--;
                 updated = true;
@@ -167,9 +192,9 @@ void FrameTracker::processFencesLocked() const {
         }
 
         const sp<Fence>& pfence = records[idx].actualPresentFence;
-        if (pfence != NULL) {
+        if (pfence != NULL && !records[idx].actualPresentFenceWatched) {
             records[idx].actualPresentTime = pfence->getSignalTime();
-            if (records[idx].actualPresentTime < INT64_MAX) {
+            if (isSignalTimeValid(records[idx].actualPresentTime)) {
                 records[idx].actualPresentFence = NULL;
                 numFences--;
                 updated = true;
@@ -182,6 +207,35 @@ void FrameTracker::processFencesLocked() const {
     }
 }
 
+bool FrameTracker::watchFenceLocked(const sp<Fence>& fence) {
+    return mFenceWatcher != NULL &&
+            mFenceWatcher->watch(fence, mFenceCallback) == NO_ERROR;
+}
+
+void FrameTracker::onFenceSignaled(const sp<Fence>& fence, nsecs_t signalTime) {
+    Mutex::Autolock lock(mMutex);
+    // a fence in an error state is left pending, for processFences to poll
+    const bool valid = isSignalTimeValid(signalTime);
+    for (size_t idx = 0; idx < NUM_FRAME_RECORDS && mNumFences > 0; idx++) {
+        FrameRecord& record(mFrameRecords[idx]);
+        if (record.actualPresentFence != fence) {
+            continue;
+        }
+        record.actualPresentFenceWatched = false;
+        if (!valid) {
+            continue;
+        }
+        record.actualPresentTime = signalTime;
+        record.actualPresentFence = NULL;
+        mNumFences--;
+
+        // like processFences, leave the current frame to advanceFrame
+        if (idx != mOffset) {
+            updateStatsLocked(idx);
+        }
+    }
+}
+
 void FrameTracker::updateStatsLocked(size_t newFrameIdx) const {
     int* numFrames = const_cast<int*>(mNumFrames);
 
@@ -27,6 +27,8 @@ namespace android {
 
 class String8;
 class Fence;
+class FenceWatcher;
+template <typename T> class FenceWatcherCallback;
 
 // FrameTracker tracks information about the most recently rendered frames. It
 // uses a circular buffer of frame records, and is *NOT* thread-safe -
@@ -35,7 +37,10 @@ class Fence;
 //
 // Some of the time values tracked may be set either as a specific timestamp
 // or a fence.  When a non-NULL fence is set for a given time value, the
-// signal time of that fence is used instead of the timestamp.
+// signal time of that fence is used instead of the timestamp.  Present
+// fences are handed to the FenceWatcher, which reports their signal time
+// once they signal; ready fences, and present fences that can't be watched,
+// are polled.
 class FrameTracker {
 
 public:
@@ -46,6 +51,7 @@ public:
     enum { NUM_FRAME_BUCKETS = 7 };
 
     FrameTracker();
+    ~FrameTracker();
 
     // setDesiredPresentTime sets the time at which the current frame
     // should be presented to the user under ideal (i.e. zero latency)
@@ -92,21 +98,36 @@ public:
     void dumpStats(String8& result) const;
 
 private:
+    friend class FenceWatcherCallback<FrameTracker>;
+
     struct FrameRecord {
         FrameRecord() :
             desiredPresentTime(0),
             frameReadyTime(0),
-            actualPresentTime(0) {}
+            actualPresentTime(0),
+            actualPresentFenceWatched(false) {}
         nsecs_t desiredPresentTime;
         nsecs_t frameReadyTime;
         nsecs_t actualPresentTime;
         sp<Fence> frameReadyFence;
         sp<Fence> actualPresentFence;
+        // whether the present fence is left to the FenceWatcher
+        bool actualPresentFenceWatched;
     };
 
+    // watchFenceLocked asks the FenceWatcher to report the signal time of
+    // fence, and returns whether it will.
+    bool watchFenceLocked(const sp<Fence>& fence);
+
+    // onFenceSignaled is called by the FenceWatcher, it replaces fence with
+    // its signal time in the frame records that have it as their present
+    // fence.  A fence in an error state is left for processFences.
+    void onFenceSignaled(const sp<Fence>& fence, nsecs_t signalTime);
+
     // processFences iterates over all the frame records that have a fence set
-    // and replaces that fence with a timestamp if the fence has signaled.  If
-    // the fence is not signaled the record's displayTime is set to INT64_MAX.
+    // that isn't watched and replaces that fence with a timestamp if the
+    // fence has signaled.  If the fence is not signaled the record's
+    // displayTime is set to INT64_MAX; a fence in an error state is kept.
     //
     // This method is const because although it modifies the frame records it
     // does so in such a way that the information represented should not
@@ -155,6 +176,10 @@ private:
     // this FrameTracker is gathering information.
     nsecs_t mDisplayPeriod;
 
+    // mFenceWatcher is NULL if fences can't be watched and must be polled.
+    sp<FenceWatcher> mFenceWatcher;
+    sp<FenceWatcherCallback<FrameTracker> > mFenceCallback;
+
     // mMutex is used to protect access to all member variables.
     mutable Mutex mMutex;
 };
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+#include <utils/Vector.h>
+
+#include "GLDeletionQueue.h"
+#include "RenderEngine/RenderEngine.h"
+
+namespace android {
+
+GLDeletionQueue::GLDeletionQueue(DrainHandler& handler)
+    : mHandler(handler), mHead(NULL) {
+}
+
+GLDeletionQueue::~GLDeletionQueue() {
+    Entry* entry = __sync_lock_test_and_set(&mHead, (Entry*)NULL);
+    ALOGW_IF(entry, "GLDeletionQueue destroyed with pending GL objects");
+    while (entry) {
+        Entry* next = entry->next;
+        delete entry;
+        entry = next;
+    }
+}
+
+void GLDeletionQueue::push(Entry* entry) {
+    Entry* head;
+    do {
+        head = mHead;
+        entry->next = head;
+    } while (!__sync_bool_compare_and_swap(&mHead, head, entry));
+    // only the first entry of a batch asks for a drain, whatever it holds
+    if (head == NULL) {
+        mHandler.onDrainNeeded();
+    }
+}
+
+void GLDeletionQueue::deleteTexture(uint32_t texture) {
+    Entry* entry = new Entry;
+    entry->texture = texture;
+    entry->dpy = EGL_NO_DISPLAY;
+    entry->image = EGL_NO_IMAGE_KHR;
+    push(entry);
+}
+
+void GLDeletionQueue::deleteImage(EGLDisplay dpy, EGLImageKHR image) {
+    Entry* entry = new Entry;
+    entry->texture = 0;
+    entry->dpy = dpy;
+    entry->image = image;
+    push(entry);
+}
+
+void GLDeletionQueue::drain(RenderEngine& engine) {
+    // detach the whole list at once, producers start a new one. since we
+    // never pop individual entries, this is immune to ABA.
+    Entry* entry = __sync_lock_test_and_set(&mHead, (Entry*)NULL);
+    if (!entry) {
+        return;
+    }
+
+    ATRACE_CALL();
+    Vector<uint32_t> textures;
+    Vector<Entry*> images;
+    while (entry) {
+        Entry* next = entry->next;
+        if (entry->image != EGL_NO_IMAGE_KHR) {
+            images.add(entry);
+        } else {
+            textures.add(entry->texture);
+            delete entry;
+        }
+        entry = next;
+    }
+
+    // textures first, they may still be referencing the images
+    if (!textures.isEmpty()) {
+        engine.deleteTextures(textures.size(), textures.array());
+    }
+    for (size_t i=0 ; i<images.size() ; i++) {
+        Entry* e = images[i];
+        if (!eglDestroyImageKHR(e->dpy, e->image)) {
+            ALOGE("GLDeletionQueue: eglDestroyImageKHR failed");
+        }
+        eglTerminate(e->dpy);
+        delete e;
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_GL_DELETION_QUEUE_H
+#define ANDROID_SF_GL_DELETION_QUEUE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <gui/GLConsumer.h>
+
+namespace android {
+
+class RenderEngine;
+
+// GLDeletionQueue collects GL texture names and EGLImages that must be
+// destroyed on the thread owning the GL context. Any thread may queue
+// objects; the queue is a lock-free list that the owning thread drains
+// in one go (one glDeleteTextures call for all pending textures).
+class GLDeletionQueue : public GLConsumer::EglImageDeleter {
+public:
+    // DrainHandler is told when an object is queued into an empty queue,
+    // so it can schedule a drain() in case no frame comes to do it.
+    class DrainHandler {
+        friend class GLDeletionQueue;
+        virtual void onDrainNeeded() = 0;
+    protected:
+        virtual ~DrainHandler() {}
+    };
+
+    GLDeletionQueue(DrainHandler& handler);
+
+    // queue a texture name for deletion.
+    void deleteTexture(uint32_t texture);
+
+    // GLConsumer::EglImageDeleter interface. the image is destroyed (and
+    // dpy terminated) by the next drain().
+    virtual void deleteImage(EGLDisplay dpy, EGLImageKHR image);
+
+    // destroys everything queued so far. must be called on the thread
+    // owning the GL context, with that context current.
+    void drain(RenderEngine& engine);
+
+protected:
+    virtual ~GLDeletionQueue();
+
+private:
+    struct Entry {
+        Entry* next;
+        uint32_t texture;
+        EGLDisplay dpy;
+        EGLImageKHR image;
+    };
+
+    void push(Entry* entry);
+
+    DrainHandler& mHandler;
+    Entry* volatile mHead;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_GL_DELETION_QUEUE_H
@@ -104,7 +104,8 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         mFrameLatencyNeeded(false),
         mFiltering(false),
         mNeedsFiltering(false),
-        mMesh(Mesh::TRIANGLE_FAN, 4, 2, 2),
+        mTexturePrepared(false),
+        mPreparedFiltering(false),
         mSecure(false),
         mProtectedByApp(false),
         mHasSurface(false),
@@ -114,7 +115,6 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
 {
     mCurrentCrop.makeInvalid();
     mFlinger->getRenderEngine().genTextures(1, &mTextureName);
-    mTexture.init(Texture::TEXTURE_EXTERNAL, mTextureName);
 
     uint32_t layerFlags = 0;
     if (flags & ISurfaceComposerClient::eHidden)
@@ -156,6 +156,7 @@ void Layer::onFirstRef() {
     mSurfaceFlingerConsumer->setConsumerUsageBits(getEffectiveUsage(0));
     mSurfaceFlingerConsumer->setContentsChangedListener(this);
     mSurfaceFlingerConsumer->setName(mName);
+    mSurfaceFlingerConsumer->setEglImageDeleter(mFlinger->getGLDeletionQueue());
 
 #ifdef TARGET_DISABLE_TRIPLE_BUFFERING
 #warning "disabling triple buffering"
@@ -732,16 +733,19 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip,
         // If there is nothing under us, we paint the screen in black, otherwise
         // we just skip this update.
 
-        // figure out if there is something below us
+        // figure out if there is something below us; this is normally
+        // precomputed by rebuildLayerStacks().
         Region under;
-        const SurfaceFlinger::LayerVector& drawingLayers(
-                mFlinger->mDrawingState.layersSortedByZ);
-        const size_t count = drawingLayers.size();
-        for (size_t i=0 ; i<count ; ++i) {
-            const sp<Layer>& layer(drawingLayers[i]);
-            if (layer.get() == static_cast<Layer const*>(this))
-                break;
-            under.orSelf( hw->getTransform().transform(layer->visibleRegion) );
+        if (!hw->getCoverageBelow(this, &under)) {
+            const SurfaceFlinger::LayerVector& drawingLayers(
+                    mFlinger->mDrawingState.layersSortedByZ);
+            const size_t count = drawingLayers.size();
+            for (size_t i=0 ; i<count ; ++i) {
+                const sp<Layer>& layer(drawingLayers[i]);
+                if (layer.get() == static_cast<Layer const*>(this))
+                    break;
+                under.orSelf( hw->getTransform().transform(layer->visibleRegion) );
+            }
         }
         // if not everything below us is covered, we plug the holes!
         Region holes(clip.subtract(under));
@@ -752,12 +756,10 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip,
     }
 
     // Bind the current buffer to the GL texture, and wait for it to be
-    // ready for us to draw into.
-    status_t err = mSurfaceFlingerConsumer->bindTextureImage();
-    if (err != NO_ERROR) {
-        ALOGW("onDraw: bindTextureImage failed (err=%d)", err);
-        // Go ahead and draw the buffer anyway; no matter what we do the screen
-        // is probably going to have something visibly wrong.
+    // ready for us to draw into. When displays are composed on their own
+    // threads, SurfaceFlinger did it before handing them the frame.
+    if (!mTexturePrepared) {
+        bindTextureImage();
     }
 
     bool canAllowGPU = false;
@@ -774,16 +776,20 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip,
 
     bool blackOutLayer = isProtected() || (isSecure() && !hw->isSecure());
 
-    RenderEngine& engine(mFlinger->getRenderEngine());
+    RenderEngine& engine(hw->getRenderEngine());
 
     if (!blackOutLayer || (canAllowGPU)) {
-        // TODO: we could be more subtle with isFixedSize()
-        const bool useFiltering = getFiltering() || needsFiltering(hw) || isFixedSize();
+        // a prepared texture is filtered the same way on every display
+        const bool useFiltering = mTexturePrepared ? mPreparedFiltering :
+                needsTextureFiltering(hw);
 
         // Query the texture matrix given our current filtering mode.
         float textureMatrix[16];
-        mSurfaceFlingerConsumer->setFilteringEnabled(useFiltering);
-        mSurfaceFlingerConsumer->getTransformMatrix(textureMatrix);
+        {
+            Mutex::Autolock _l(mTextureMatrixLock);
+            mSurfaceFlingerConsumer->setFilteringEnabled(useFiltering);
+            mSurfaceFlingerConsumer->getTransformMatrix(textureMatrix);
+        }
 
         if (mSurfaceFlingerConsumer->getTransformToDisplayInverse()) {
 
@@ -814,11 +820,16 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip,
         }
 
         // Set things up for texturing.
-        mTexture.setDimensions(mActiveBuffer->getWidth(), mActiveBuffer->getHeight());
-        mTexture.setFiltering(useFiltering);
-        mTexture.setMatrix(textureMatrix);
+        Texture texture(Texture::TEXTURE_EXTERNAL, mTextureName);
+        texture.setDimensions(mActiveBuffer->getWidth(), mActiveBuffer->getHeight());
+        texture.setFiltering(useFiltering);
+        texture.setMatrix(textureMatrix);
 
-        engine.setupLayerTexturing(mTexture);
+        if (mTexturePrepared) {
+            engine.setupPreparedLayerTexturing(texture);
+        } else {
+            engine.setupLayerTexturing(texture);
+        }
     } else {
         engine.setupLayerBlackedOut();
     }
@@ -826,15 +837,49 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip,
     engine.disableTexturing();
 }
 
+bool Layer::needsTextureFiltering(const sp<const DisplayDevice>& hw) const {
+    // TODO: we could be more subtle with isFixedSize()
+    return getFiltering() || needsFiltering(hw) || isFixedSize();
+}
+
+void Layer::prepareTexture(RenderEngine& engine, bool useFiltering) {
+    if (mActiveBuffer == 0) {
+        return;
+    }
+    bindTextureImage();
+    Texture texture(Texture::TEXTURE_EXTERNAL, mTextureName);
+    texture.setFiltering(useFiltering);
+    engine.prepareLayerTexture(texture);
+    mPreparedFiltering = useFiltering;
+    mTexturePrepared = true;
+}
+
+void Layer::releasePreparedTexture() {
+    mTexturePrepared = false;
+}
+
+void Layer::bindTextureImage() const {
+    if (mActiveBuffer == 0) {
+        return;
+    }
+    status_t err = mSurfaceFlingerConsumer->bindTextureImage();
+    if (err != NO_ERROR) {
+        ALOGW("onDraw: bindTextureImage failed (err=%d)", err);
+        // Go ahead and draw the buffer anyway; no matter what we do the screen
+        // is probably going to have something visibly wrong.
+    }
+}
+
 
 void Layer::clearWithOpenGL(const sp<const DisplayDevice>& hw,
-        const Region& /* clip */, float red, float green, float blue,
+        const Region& clip, float red, float green, float blue,
         float alpha) const
 {
-    RenderEngine& engine(mFlinger->getRenderEngine());
-    computeGeometry(hw, mMesh, false);
+    RenderEngine& engine(hw->getRenderEngine());
+    Mesh mesh(Mesh::TRIANGLE_FAN, 4, 2, 2);
+    computeGeometry(hw, mesh, false);
     engine.setupFillWithColor(red, green, blue, alpha);
-    engine.drawMesh(mMesh);
+    engine.drawMeshClipped(mesh, clip, hw->getHeight());
 }
 
 void Layer::clearWithOpenGL(
@@ -843,11 +888,12 @@ void Layer::clearWithOpenGL(
 }
 
 void Layer::drawWithOpenGL(const sp<const DisplayDevice>& hw,
-        const Region& /* clip */, bool useIdentityTransform) const {
+        const Region& clip, bool useIdentityTransform) const {
     const uint32_t fbHeight = hw->getHeight();
     const State& s(getDrawingState());
 
-    computeGeometry(hw, mMesh, useIdentityTransform);
+    Mesh mesh(Mesh::TRIANGLE_FAN, 4, 2, 2);
+    computeGeometry(hw, mesh, useIdentityTransform);
 
     // Compute the crops exactly in the way we are doing
     // for HWC & program texture coordinates for the clipped
@@ -872,15 +918,22 @@ void Layer::drawWithOpenGL(const sp<const DisplayDevice>& hw,
 
     // TODO: we probably want to generate the texture coords with the mesh
     // here we assume that we only have 4 vertices
-    Mesh::VertexArray<vec2> texCoords(mMesh.getTexCoordArray<vec2>());
+    Mesh::VertexArray<vec2> texCoords(mesh.getTexCoordArray<vec2>());
     texCoords[0] = vec2(left, 1.0f - top);
     texCoords[1] = vec2(left, 1.0f - bottom);
     texCoords[2] = vec2(right, 1.0f - bottom);
     texCoords[3] = vec2(right, 1.0f - top);
 
-    RenderEngine& engine(mFlinger->getRenderEngine());
+    RenderEngine& engine(hw->getRenderEngine());
     engine.setupLayerBlending(mPremultipliedAlpha, isOpaque(s), s.alpha);
-    engine.drawMesh(mMesh);
+    if (useIdentityTransform) {
+        // screenshots: the clip is in display space, not in the
+        // coordinate space the mesh was generated in.
+        engine.drawMesh(mesh);
+    } else {
+        // only touch the visible, dirty parts of the layer
+        engine.drawMeshClipped(mesh, clip, fbHeight);
+    }
     engine.disableBlending();
 }
 
@@ -998,6 +1051,10 @@ bool Layer::isFixedSize() const {
     return mCurrentScalingMode != NATIVE_WINDOW_SCALING_MODE_FREEZE;
 }
 
+bool Layer::isUnfilled() const {
+    return mActiveBuffer == 0;
+}
+
 bool Layer::isCropped() const {
     return !mCurrentCrop.isEmpty();
 }
@@ -1515,19 +1572,36 @@ void Layer::updateTransformHint(const sp<const DisplayDevice>& hw) {
 // debugging
 // ----------------------------------------------------------------------------
 
-void Layer::dump(String8& result, Colorizer& colorizer) const
+void Layer::getDumpState(DumpState* out) const
 {
-    const Layer::State& s(getDrawingState());
+    out->layer = this;
+    out->typeId = getTypeId();
+    out->name = getName();
+    out->state = getDrawingState();
+    out->visibleRegion = visibleRegion;
+    out->opaque = isOpaque(out->state);
+    out->contentDirty = contentDirty;
+    sp<Client> client(mClientRef.promote());
+    out->client = client.get();
+    out->activeBuffer = mActiveBuffer;
+    out->format = mFormat;
+    out->queuedFrames = mQueuedFrames;
+    out->refreshPending = mRefreshPending;
+}
+
+/*static*/ void Layer::dump(String8& result, Colorizer& colorizer,
+        const DumpState& state)
+{
+    const Layer::State& s(state.state);
 
     colorizer.colorize(result, Colorizer::GREEN);
     result.appendFormat(
             "+ %s %p (%s)\n",
-            getTypeId(), this, getName().string());
+            state.typeId, state.layer.get(), state.name.string());
     colorizer.reset(result);
 
     s.activeTransparentRegion.dump(result, "transparentRegion");
-    visibleRegion.dump(result, "visibleRegion");
-    sp<Client> client(mClientRef.promote());
+    state.visibleRegion.dump(result, "visibleRegion");
 
     result.appendFormat(            "      "
             "layerStack=%4d, z=%9d, pos=(%g,%g), size=(%4d,%4d), crop=(%4d,%4d,%4d,%4d), "
@@ -1537,13 +1611,13 @@ void Layer::dump(String8& result, Colorizer& colorizer) const
             s.layerStack, s.z, s.transform.tx(), s.transform.ty(), s.active.w, s.active.h,
             s.active.crop.left, s.active.crop.top,
             s.active.crop.right, s.active.crop.bottom,
-            isOpaque(s), contentDirty,
+            state.opaque, state.contentDirty,
             s.alpha, s.flags,
             s.transform[0][0], s.transform[0][1],
             s.transform[1][0], s.transform[1][1],
-            client.get());
+            state.client);
 
-    sp<const GraphicBuffer> buf0(mActiveBuffer);
+    const sp<GraphicBuffer>& buf0(state.activeBuffer);
     uint32_t w0=0, h0=0, s0=0, f0=0;
     if (buf0 != 0) {
         w0 = buf0->getWidth();
@@ -1555,11 +1629,14 @@ void Layer::dump(String8& result, Colorizer& colorizer) const
             "      "
             "format=%2d, activeBuffer=[%4ux%4u:%4u,%3X],"
             " queued-frames=%d, mRefreshPending=%d\n",
-            mFormat, w0, h0, s0,f0,
-            mQueuedFrames, mRefreshPending);
-
-    if (mSurfaceFlingerConsumer != 0) {
-        mSurfaceFlingerConsumer->dump(result, "            ");
+            state.format, w0, h0, s0,f0,
+            state.queuedFrames, state.refreshPending);
+
+    // the consumer has its own lock
+    const sp<SurfaceFlingerConsumer>& consumer(
+            state.layer->mSurfaceFlingerConsumer);
+    if (consumer != 0) {
+        consumer->dump(result, "            ");
     }
 }
 
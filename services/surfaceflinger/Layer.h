@@ -56,6 +56,7 @@ class Client;
 class Colorizer;
 class DisplayDevice;
 class GraphicBuffer;
+class RenderEngine;
 class SurfaceFlinger;
 
 // ---------------------------------------------------------------------------
@@ -185,6 +186,12 @@ public:
      */
     virtual bool isFixedSize() const;
 
+    /*
+     * isUnfilled - true if the client never drew into this layer; such
+     * layers paint the parts of the screen not covered below them black.
+     */
+    virtual bool isUnfilled() const;
+
 protected:
     /*
      * onDraw - draws the surface.
@@ -231,6 +238,28 @@ public:
     void draw(const sp<const DisplayDevice>& hw, bool useIdentityTransform) const;
     void draw(const sp<const DisplayDevice>& hw) const;
 
+    /*
+     * bindTextureImage - binds the current buffer to the layer's texture in
+     * the main thread's context.
+     */
+    void bindTextureImage() const;
+
+    /*
+     * prepareTexture - binds the current buffer and sets the texture's
+     * parameters once, in the main thread's context, before displays are
+     * composed on their own threads. until releasePreparedTexture(), every
+     * draw of the layer uses the texture as is, since other contexts may
+     * be sampling it.
+     */
+    void prepareTexture(RenderEngine& engine, bool useFiltering);
+    void releasePreparedTexture();
+
+    /*
+     * needsTextureFiltering - whether drawing on hw samples the texture
+     * with linear filtering.
+     */
+    bool needsTextureFiltering(const sp<const DisplayDevice>& hw) const;
+
     /*
      * doTransaction - process the transaction. This is a good place to figure
      * out which attributes of the surface have changed.
@@ -309,8 +338,25 @@ public:
     inline  State&          getCurrentState()       { return mCurrentState; }
 
 
-    /* always call base class first */
-    void dump(String8& result, Colorizer& colorizer) const;
+    // what dump() prints, captured by getDumpState() with SurfaceFlinger's
+    // state lock held so that it can be formatted after releasing it.
+    struct DumpState {
+        sp<const Layer> layer;
+        const char* typeId;
+        String8 name;
+        State state;
+        Region visibleRegion;
+        bool opaque;
+        bool contentDirty;
+        const Client* client;
+        sp<GraphicBuffer> activeBuffer;
+        PixelFormat format;
+        int32_t queuedFrames;
+        bool refreshPending;
+    };
+    void getDumpState(DumpState* out) const;
+    static void dump(String8& result, Colorizer& colorizer,
+            const DumpState& state);
     void dumpFrameStats(String8& result) const;
     void clearFrameStats();
     void logFrameStats();
@@ -402,10 +448,13 @@ private:
     bool mFiltering;
     // Whether filtering is needed b/c of the drawingstate
     bool mNeedsFiltering;
-    // The mesh used to draw the layer in GLES composition mode
-    mutable Mesh mMesh;
-    // The texture used to draw the layer in GLES composition mode
-    mutable Texture mTexture;
+    // serializes the consumer's filtering mode and texture matrix, which
+    // displays composed on their own thread query concurrently
+    mutable Mutex mTextureMatrixLock;
+    // set by prepareTexture(); only changed by the main thread while no
+    // display is being composed on another thread
+    bool mTexturePrepared;
+    bool mPreparedFiltering;
 
     // page-flip thread (currently main thread)
     bool mSecure; // no screenshots
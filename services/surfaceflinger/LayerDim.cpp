@@ -40,15 +40,19 @@ LayerDim::~LayerDim() {
 }
 
 void LayerDim::onDraw(const sp<const DisplayDevice>& hw,
-        const Region& /* clip */, bool useIdentityTransform) const
+        const Region& clip, bool useIdentityTransform) const
 {
     const State& s(getDrawingState());
     if (s.alpha>0) {
         Mesh mesh(Mesh::TRIANGLE_FAN, 4, 2);
         computeGeometry(hw, mesh, useIdentityTransform);
-        RenderEngine& engine(mFlinger->getRenderEngine());
+        RenderEngine& engine(hw->getRenderEngine());
         engine.setupDimLayerBlending(s.alpha);
-        engine.drawMesh(mesh);
+        if (useIdentityTransform) {
+            engine.drawMesh(mesh);
+        } else {
+            engine.drawMeshClipped(mesh, clip, hw->getHeight());
+        }
         engine.disableBlending();
     }
 }
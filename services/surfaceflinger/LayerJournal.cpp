@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include "LayerJournal.h"
+#include "Layer.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+LayerJournal* LayerJournal::open(const char* path) {
+    FILE* file = fopen(path, "we");
+    if (file == NULL) {
+        ALOGE("can't create layer journal '%s' (%s)", path, strerror(errno));
+        return NULL;
+    }
+    return create(path, file);
+}
+
+LayerJournal* LayerJournal::open(int fd) {
+    int dupFd = dup(fd);
+    FILE* file = dupFd >= 0 ? fdopen(dupFd, "w") : NULL;
+    if (file == NULL) {
+        ALOGE("can't write layer journal to fd %d (%s)", fd, strerror(errno));
+        if (dupFd >= 0) {
+            close(dupFd);
+        }
+        return NULL;
+    }
+    return create("<fd>", file);
+}
+
+LayerJournal* LayerJournal::create(const char* path, FILE* file) {
+    LayerJournalFormat::Header header;
+    header.magic = LayerJournalFormat::MAGIC;
+    header.version = LayerJournalFormat::VERSION;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        ALOGE("can't write layer journal '%s' (%s)", path, strerror(errno));
+        fclose(file);
+        return NULL;
+    }
+    return new LayerJournal(path, file);
+}
+
+LayerJournal::LayerJournal(const char* path, FILE* file)
+    : mPath(path), mFile(file), mNextId(1), mPendingStates(0),
+      mRecordCount(0), mByteCount(sizeof(LayerJournalFormat::Header)),
+      mError(false) {
+}
+
+LayerJournal::~LayerJournal() {
+    fclose(mFile);
+}
+
+void LayerJournal::writeLocked(uint32_t type, const void* payload, size_t size,
+        const void* extra, size_t extraSize) {
+    if (mError) {
+        return;
+    }
+    LayerJournalFormat::Record record;
+    record.type = type;
+    record.size = size + extraSize;
+    record.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    bool ok = fwrite(&record, sizeof(record), 1, mFile) == 1 &&
+            fwrite(payload, size, 1, mFile) == 1;
+    if (ok && extraSize) {
+        ok = fwrite(extra, extraSize, 1, mFile) == 1;
+    }
+    if (!ok) {
+        // stop recording rather than leave a truncated record in the middle
+        // of the journal.
+        ALOGE("layer journal '%s' write failed (%s), recording stopped",
+                mPath.string(), strerror(errno));
+        mError = true;
+        return;
+    }
+    mRecordCount++;
+    mByteCount += sizeof(record) + record.size;
+}
+
+uint32_t LayerJournal::idForLocked(const Layer* layer) const {
+    ssize_t index = mIds.indexOfKey(layer);
+    return index >= 0 ? mIds.valueAt(index) : 0;
+}
+
+void LayerJournal::recordLayerCreated(const Layer* layer,
+        uint32_t w, uint32_t h, int32_t format, uint32_t flags) {
+    Mutex::Autolock _l(mLock);
+    const String8& name(layer->getName());
+    LayerJournalFormat::LayerCreate create;
+    create.id = mNextId++;
+    create.w = w;
+    create.h = h;
+    create.format = format;
+    create.flags = flags;
+    create.nameLength = name.length();
+    mIds.add(layer, create.id);
+    writeLocked(LayerJournalFormat::LAYER_CREATE, &create, sizeof(create),
+            name.string(), create.nameLength);
+}
+
+void LayerJournal::recordLayerRemoved(const Layer* layer) {
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mIds.indexOfKey(layer);
+    if (index < 0) {
+        return;
+    }
+    LayerJournalFormat::LayerRemove remove;
+    remove.id = mIds.valueAt(index);
+    // the Layer may be destroyed (and its address reused) once removed
+    mIds.removeItemsAt(index);
+    writeLocked(LayerJournalFormat::LAYER_REMOVE, &remove, sizeof(remove));
+}
+
+static void fillLayerState(const Layer::State& s,
+        LayerJournalFormat::LayerState* out) {
+    LayerJournalFormat::LayerState& state(*out);
+    memset(&state, 0, sizeof(state));
+    state.layerStack = s.layerStack;
+    state.z = s.z;
+    state.w = s.requested.w;
+    state.h = s.requested.h;
+    state.x = s.transform.tx();
+    state.y = s.transform.ty();
+    // inverse of Transform::set(dsdx, dsdy, dtdx, dtdy)
+    state.matrix[0] = s.transform[0][0];
+    state.matrix[1] = s.transform[0][1];
+    state.matrix[2] = s.transform[1][0];
+    state.matrix[3] = s.transform[1][1];
+    state.crop[0] = s.requested.crop.left;
+    state.crop[1] = s.requested.crop.top;
+    state.crop[2] = s.requested.crop.right;
+    state.crop[3] = s.requested.crop.bottom;
+    state.alpha = s.alpha;
+    state.flags = s.flags;
+}
+
+void LayerJournal::recordLayerState(const Layer* layer) {
+    LayerJournalFormat::LayerState state;
+    fillLayerState(layer->getCurrentState(), &state);
+
+    Mutex::Autolock _l(mLock);
+    state.id = idForLocked(layer);
+    if (state.id) {
+        mPendingStates++;
+        writeLocked(LayerJournalFormat::LAYER_STATE, &state, sizeof(state));
+    }
+}
+
+void LayerJournal::recordTransaction(uint32_t flags) {
+    Mutex::Autolock _l(mLock);
+    LayerJournalFormat::Transaction transaction;
+    transaction.flags = flags;
+    transaction.stateCount = mPendingStates;
+    mPendingStates = 0;
+    writeLocked(LayerJournalFormat::TRANSACTION,
+            &transaction, sizeof(transaction));
+}
+
+void LayerJournal::recordBufferLatched(const Layer* layer) {
+    recordBuffer(layer, layer->getActiveBuffer());
+}
+
+void LayerJournal::recordBuffer(const Layer* layer,
+        const sp<GraphicBuffer>& buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    LayerJournalFormat::BufferLatch latch;
+    latch.w = buffer->getWidth();
+    latch.h = buffer->getHeight();
+    latch.format = buffer->getPixelFormat();
+    latch.usage = buffer->getUsage();
+
+    Mutex::Autolock _l(mLock);
+    latch.id = idForLocked(layer);
+    if (latch.id) {
+        writeLocked(LayerJournalFormat::BUFFER_LATCH, &latch, sizeof(latch));
+    }
+}
+
+/*static*/ void LayerJournal::snapshotLayer(const Layer* layer,
+        LayerSnapshot* out) {
+    const Layer::State& s(layer->getDrawingState());
+    fillLayerState(s, &out->state);
+    out->activeW = s.active.w;
+    out->activeH = s.active.h;
+    out->buffer = layer->getActiveBuffer();
+}
+
+void LayerJournal::recordLayerSnapshot(const Layer* layer,
+        const LayerSnapshot& snapshot) {
+    const sp<GraphicBuffer>& buffer(snapshot.buffer);
+    recordLayerCreated(layer, snapshot.activeW, snapshot.activeH,
+            buffer != NULL ? buffer->getPixelFormat() : PIXEL_FORMAT_RGBA_8888,
+            0);
+
+    LayerJournalFormat::LayerState state(snapshot.state);
+    {
+        Mutex::Autolock _l(mLock);
+        state.id = idForLocked(layer);
+        mPendingStates++;
+        writeLocked(LayerJournalFormat::LAYER_STATE, &state, sizeof(state));
+    }
+    recordBuffer(layer, buffer);
+}
+
+void LayerJournal::flush() {
+    Mutex::Autolock _l(mLock);
+    if (!mError) {
+        fflush(mFile);
+    }
+}
+
+void LayerJournal::dump(String8& result) const {
+    Mutex::Autolock _l(mLock);
+    result.appendFormat("Layer journal: %s, %" PRIu64 " records, "
+            "%" PRIu64 " bytes, %zu live layers%s\n",
+            mPath.string(), mRecordCount, mByteCount, mIds.size(),
+            mError ? " (stopped on error)" : "");
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_LAYER_JOURNAL_H
+#define ANDROID_SF_LAYER_JOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+class GraphicBuffer;
+class Layer;
+
+// On-disk format of the layer journal. A journal is a JournalHeader followed
+// by records, each a JournalRecord immediately followed by 'size' bytes of
+// payload. All fields are in host byte order; the journal is meant to be
+// replayed on the device (or a device of the same ABI) that recorded it.
+//
+// These definitions are shared with the replay tool in tests/replay.
+struct LayerJournalFormat {
+    enum {
+        MAGIC   = 0x314a4653,   // 'SFJ1'
+        VERSION = 1
+    };
+
+    enum {
+        LAYER_CREATE    = 1,    // payload: LayerCreate + name bytes
+        LAYER_STATE     = 2,    // payload: LayerState
+        LAYER_REMOVE    = 3,    // payload: LayerRemove
+        BUFFER_LATCH    = 4,    // payload: BufferLatch
+        TRANSACTION     = 5     // payload: Transaction
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+    };
+
+    struct Record {
+        uint32_t type;
+        uint32_t size;
+        int64_t timestamp;      // systemTime(SYSTEM_TIME_MONOTONIC)
+    };
+
+    struct LayerCreate {
+        uint32_t id;
+        uint32_t w;
+        uint32_t h;
+        int32_t format;
+        uint32_t flags;         // ISurfaceComposerClient creation flags
+        uint32_t nameLength;    // not NUL-terminated
+    };
+
+    struct LayerState {
+        uint32_t id;
+        uint32_t layerStack;
+        uint32_t z;
+        uint32_t w;
+        uint32_t h;
+        float x;
+        float y;
+        float matrix[4];        // dsdx, dtdx, dsdy, dtdy
+        int32_t crop[4];        // left, top, right, bottom
+        uint8_t alpha;
+        uint8_t flags;          // layer_state_t flags (eLayerHidden, ...)
+        uint8_t reserved[2];
+    };
+
+    struct LayerRemove {
+        uint32_t id;
+    };
+
+    struct BufferLatch {
+        uint32_t id;
+        uint32_t w;
+        uint32_t h;
+        int32_t format;
+        uint32_t usage;
+    };
+
+    struct Transaction {
+        uint32_t flags;         // ISurfaceComposer transaction flags
+        uint32_t stateCount;    // LAYER_STATE records that preceded this one
+    };
+};
+
+// LayerJournal records layer creation, state changes, buffer latches and
+// removal into a compact binary file so that a composition workload can be
+// reproduced offline. It is enabled by pointing debug.sf.journal at a
+// writable path; when disabled SurfaceFlinger holds no journal at all.
+//
+// Record methods may be called from any thread. Records are buffered and
+// written out by flush(), which SurfaceFlinger calls once per frame.
+class LayerJournal {
+public:
+    // returns NULL if the file can't be created
+    static LayerJournal* open(const char* path);
+    // journal written to (a dup of) fd, used by dumpsys --binary
+    static LayerJournal* open(int fd);
+    ~LayerJournal();
+
+    void recordLayerCreated(const Layer* layer, uint32_t w, uint32_t h,
+            int32_t format, uint32_t flags);
+    void recordLayerRemoved(const Layer* layer);
+    void recordLayerState(const Layer* layer);
+    void recordTransaction(uint32_t flags);
+    void recordBufferLatched(const Layer* layer);
+
+    // a layer as it is displayed: its drawing state and active buffer
+    struct LayerSnapshot {
+        LayerJournalFormat::LayerState state;
+        uint32_t activeW;
+        uint32_t activeH;
+        sp<GraphicBuffer> buffer;
+    };
+    // must be called with SurfaceFlinger's state lock held
+    static void snapshotLayer(const Layer* layer, LayerSnapshot* out);
+    // records a snapshot as a creation record, a state record and a buffer
+    // record.
+    void recordLayerSnapshot(const Layer* layer, const LayerSnapshot& snapshot);
+
+    void flush();
+
+    void dump(String8& result) const;
+
+private:
+    LayerJournal(const char* path, FILE* file);
+
+    static LayerJournal* create(const char* path, FILE* file);
+
+    void recordBuffer(const Layer* layer, const sp<GraphicBuffer>& buffer);
+
+    void writeLocked(uint32_t type, const void* payload, size_t size,
+            const void* extra = NULL, size_t extraSize = 0);
+    uint32_t idForLocked(const Layer* layer) const;
+
+    mutable Mutex mLock;
+    const String8 mPath;
+    FILE* mFile;
+    KeyedVector<const Layer*, uint32_t> mIds;
+    uint32_t mNextId;
+    uint32_t mPendingStates;
+    uint64_t mRecordCount;
+    uint64_t mByteCount;
+    bool mError;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_LAYER_JOURNAL_H
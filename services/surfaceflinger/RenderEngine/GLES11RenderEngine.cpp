@@ -180,6 +180,11 @@ void GLES11RenderEngine::setupDimLayerBlending(int alpha) {
 }
 
 void GLES11RenderEngine::setupLayerTexturing(const Texture& texture) {
+    prepareLayerTexture(texture);
+    setupPreparedLayerTexturing(texture);
+}
+
+void GLES11RenderEngine::prepareLayerTexture(const Texture& texture) {
     GLuint target = texture.getTextureTarget();
     glBindTexture(target, texture.getTextureName());
     GLenum filter = GL_NEAREST;
@@ -190,6 +195,10 @@ void GLES11RenderEngine::setupLayerTexturing(const Texture& texture) {
     glTexParameterx(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameterx(target, GL_TEXTURE_MAG_FILTER, filter);
     glTexParameterx(target, GL_TEXTURE_MIN_FILTER, filter);
+}
+
+void GLES11RenderEngine::setupPreparedLayerTexturing(const Texture& texture) {
+    glBindTexture(texture.getTextureTarget(), texture.getTextureName());
     glMatrixMode(GL_TEXTURE);
     glLoadMatrixf(texture.getMatrix().asArray());
     glMatrixMode(GL_MODELVIEW);
@@ -55,6 +55,8 @@ protected:
     virtual void setupLayerBlending(bool premultipliedAlpha, bool opaque, int alpha);
     virtual void setupDimLayerBlending(int alpha);
     virtual void setupLayerTexturing(const Texture& texture);
+    virtual void prepareLayerTexture(const Texture& texture);
+    virtual void setupPreparedLayerTexturing(const Texture& texture);
     virtual void setupLayerBlackedOut();
     virtual void setupFillWithColor(float r, float g, float b, float a) ;
     virtual void disableTexturing();
@@ -39,8 +39,9 @@
 namespace android {
 // ---------------------------------------------------------------------------
 
-GLES20RenderEngine::GLES20RenderEngine() :
-        mVpWidth(0), mVpHeight(0) {
+GLES20RenderEngine::GLES20RenderEngine(bool privateProgramCache) :
+        mVpWidth(0), mVpHeight(0),
+        mProgramCache(NULL), mOwnsProgramCache(privateProgramCache) {
 
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
     glGetIntegerv(GL_MAX_VIEWPORT_DIMS, mMaxViewportDims);
@@ -65,9 +66,17 @@ GLES20RenderEngine::GLES20RenderEngine() :
             GL_RGB, GL_UNSIGNED_SHORT_5_6_5, protTexData);
 
     //mColorBlindnessCorrection = M;
+
+    mProgramCache = mOwnsProgramCache ?
+            new ProgramCache() : &ProgramCache::getInstance();
 }
 
 GLES20RenderEngine::~GLES20RenderEngine() {
+    // our context is current, see RenderEngine::destroy()
+    releaseGroupTargets();
+    if (mOwnsProgramCache) {
+        delete mProgramCache;
+    }
 }
 
 
@@ -154,6 +163,11 @@ void GLES20RenderEngine::setupDimLayerBlending(int alpha) {
 }
 
 void GLES20RenderEngine::setupLayerTexturing(const Texture& texture) {
+    prepareLayerTexture(texture);
+    mState.setTexture(texture);
+}
+
+void GLES20RenderEngine::prepareLayerTexture(const Texture& texture) {
     GLuint target = texture.getTextureTarget();
     glBindTexture(target, texture.getTextureName());
     GLenum filter = GL_NEAREST;
@@ -164,7 +178,10 @@ void GLES20RenderEngine::setupLayerTexturing(const Texture& texture) {
     glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
     glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+}
 
+void GLES20RenderEngine::setupPreparedLayerTexturing(const Texture& texture) {
+    glBindTexture(texture.getTextureTarget(), texture.getTextureName());
     mState.setTexture(texture);
 }
 
@@ -231,7 +248,7 @@ void GLES20RenderEngine::setupFillWithColor(float r, float g, float b, float a)
 
 void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
 
-    ProgramCache::getInstance().useProgram(mState);
+    mProgramCache->useProgram(mState);
 
     if (mesh.getTexCoordsSize()) {
         glEnableVertexAttribArray(Program::texCoords);
@@ -257,28 +274,57 @@ void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
 
 void GLES20RenderEngine::beginGroup(const mat4& colorTransform) {
 
-    GLuint tname, name;
-    // create the texture
-    glGenTextures(1, &tname);
-    glBindTexture(GL_TEXTURE_2D, tname);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, mVpWidth, mVpHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-
-    // create a Framebuffer Object to render into
-    glGenFramebuffers(1, &name);
-    glBindFramebuffer(GL_FRAMEBUFFER, name);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tname, 0);
-
     Group group;
-    group.texture = tname;
-    group.fbo = name;
+    group.texture = 0;
+    group.fbo = 0;
     group.width = mVpWidth;
     group.height = mVpHeight;
     group.colorTransform = colorTransform;
 
+    // the outermost group reuses the target of the previous frame
+    const bool outermost = mGroupStack.isEmpty();
+    if (outermost) {
+        for (size_t i=0 ; i<mGroupTargets.size() ; i++) {
+            const Group& target(mGroupTargets[i]);
+            if (target.width == mVpWidth && target.height == mVpHeight) {
+                group.texture = target.texture;
+                group.fbo = target.fbo;
+                glBindFramebuffer(GL_FRAMEBUFFER, group.fbo);
+                break;
+            }
+        }
+    }
+
+    if (!group.fbo) {
+        GLuint tname, name;
+        // create the texture
+        glGenTextures(1, &tname);
+        glBindTexture(GL_TEXTURE_2D, tname);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, mVpWidth, mVpHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+        // create a Framebuffer Object to render into
+        glGenFramebuffers(1, &name);
+        glBindFramebuffer(GL_FRAMEBUFFER, name);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tname, 0);
+
+        group.texture = tname;
+        group.fbo = name;
+
+        if (outermost) {
+            if (mGroupTargets.size() == MAX_GROUP_TARGETS) {
+                const Group& oldest(mGroupTargets[0]);
+                glDeleteFramebuffers(1, &oldest.fbo);
+                glDeleteTextures(1, &oldest.texture);
+                mGroupTargets.removeAt(0);
+            }
+            mGroupTargets.add(group);
+        }
+    }
+
     mGroupStack.push(group);
 }
 
@@ -322,9 +368,20 @@ void GLES20RenderEngine::endGroup() {
     // reset color matrix
     mState.setColorMatrix(mat4());
 
-    // free our fbo and texture
-    glDeleteFramebuffers(1, &group.fbo);
-    glDeleteTextures(1, &group.texture);
+    // free our fbo and texture, unless they're kept for the next frame
+    if (!mGroupStack.isEmpty()) {
+        glDeleteFramebuffers(1, &group.fbo);
+        glDeleteTextures(1, &group.texture);
+    }
+}
+
+void GLES20RenderEngine::releaseGroupTargets() {
+    for (size_t i=0 ; i<mGroupTargets.size() ; i++) {
+        const Group& target(mGroupTargets[i]);
+        glDeleteFramebuffers(1, &target.fbo);
+        glDeleteTextures(1, &target.texture);
+    }
+    mGroupTargets.clear();
 }
 
 void GLES20RenderEngine::dump(String8& result) {
@@ -54,12 +54,24 @@ class GLES20RenderEngine : public RenderEngine {
     Description mState;
     Vector<Group> mGroupStack;
 
+    // render targets of outermost groups, kept from one frame to the next
+    // (one per viewport size) so color transforms don't reallocate a
+    // screen-sized texture every frame. see releaseGroupTargets().
+    enum { MAX_GROUP_TARGETS = 4 };
+    Vector<Group> mGroupTargets;
+
+    // program objects are shared between contexts of a share group along
+    // with their uniform values, so an engine that draws concurrently with
+    // the main one (see RenderEngine::createShared) keeps its own cache.
+    ProgramCache* mProgramCache;
+    bool mOwnsProgramCache;
+
     virtual void bindImageAsFramebuffer(EGLImageKHR image,
             uint32_t* texName, uint32_t* fbName, uint32_t* status);
     virtual void unbindFramebuffer(uint32_t texName, uint32_t fbName);
 
 public:
-    GLES20RenderEngine();
+    explicit GLES20RenderEngine(bool privateProgramCache = false);
 
 protected:
     virtual ~GLES20RenderEngine();
@@ -70,6 +82,8 @@ protected:
     virtual void setupLayerBlending(bool premultipliedAlpha, bool opaque, int alpha);
     virtual void setupDimLayerBlending(int alpha);
     virtual void setupLayerTexturing(const Texture& texture);
+    virtual void prepareLayerTexture(const Texture& texture);
+    virtual void setupPreparedLayerTexturing(const Texture& texture);
     virtual void setupLayerBlackedOut();
     virtual void setupFillWithColor(float r, float g, float b, float a);
     virtual void disableTexturing();
@@ -84,6 +98,7 @@ protected:
 
     virtual void beginGroup(const mat4& colorTransform);
     virtual void endGroup();
+    virtual void releaseGroupTargets();
 
     virtual size_t getMaxTextureSize() const;
     virtual size_t getMaxViewportDims() const;
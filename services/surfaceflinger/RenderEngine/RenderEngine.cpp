@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <math.h>
+
 #include <cutils/log.h>
 #include <ui/Rect.h>
 #include <ui/Region.h>
@@ -31,14 +33,15 @@ EGLAPI const char* eglQueryStringImplementationANDROID(EGLDisplay dpy, EGLint na
 namespace android {
 // ---------------------------------------------------------------------------
 
-static bool findExtension(const char* exts, const char* name) {
+bool RenderEngine::findExtension(const char* exts, const char* name) {
     if (!exts)
         return false;
     size_t len = strlen(name);
 
     const char* pos = exts;
     while ((pos = strstr(pos, name)) != NULL) {
-        if (pos[len] == '\0' || pos[len] == ' ')
+        if ((pos == exts || pos[-1] == ' ') &&
+                (pos[len] == '\0' || pos[len] == ' '))
             return true;
         pos += len;
     }
@@ -148,6 +151,85 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
     return engine;
 }
 
+RenderEngine* RenderEngine::createShared(EGLDisplay display, int hwcFormat,
+        const RenderEngine& engine) {
+    EGLConfig config = engine.getEGLConfig();
+    EGLint contextAttributes[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 2,      // MUST be first
+            EGL_NONE, EGL_NONE
+    };
+    EGLContext ctxt = eglCreateContext(display, config,
+            engine.getEGLContext(), contextAttributes);
+    if (ctxt == EGL_NO_CONTEXT) {
+        ALOGE("can't create an EGLContext sharing with the main one");
+        return NULL;
+    }
+
+    EGLConfig dummyConfig = config;
+    if (dummyConfig == EGL_NO_CONFIG) {
+        dummyConfig = chooseEglConfig(display, hwcFormat);
+    }
+    EGLint attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE, EGL_NONE };
+    EGLSurface dummy = eglCreatePbufferSurface(display, dummyConfig, attribs);
+    if (dummy == EGL_NO_SURFACE || !eglMakeCurrent(display, dummy, dummy, ctxt)) {
+        ALOGE("can't make the shared EGLContext current");
+        if (dummy != EGL_NO_SURFACE) {
+            eglDestroySurface(display, dummy);
+        }
+        eglDestroyContext(display, ctxt);
+        return NULL;
+    }
+
+    // GLExtensions was initialized by create() and is the same for every
+    // context of the share group.
+    RenderEngine* shared = NULL;
+    GlesVersion version = parseGlesVersion(
+            reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    if (version >= GLES_VERSION_2_0) {
+        shared = new GLES20RenderEngine(true);
+        shared->setEGLHandles(config, ctxt);
+    }
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(display, dummy);
+    if (shared == NULL) {
+        eglDestroyContext(display, ctxt);
+    }
+    return shared;
+}
+
+void RenderEngine::destroy(EGLDisplay display, RenderEngine* engine) {
+    // the engine deletes its GL objects (programs, render targets...) when
+    // destroyed, which needs its context current. the caller's surface may
+    // be gone already, so use a pbuffer.
+    EGLContext ctxt = engine->getEGLContext();
+    EGLConfig config = engine->getEGLConfig();
+    if (config == EGL_NO_CONFIG) {
+        // any pbuffer config will do for a config-less context
+        EGLint configAttribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                EGL_NONE
+        };
+        EGLint numConfigs = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+    }
+    EGLint attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE, EGL_NONE };
+    EGLSurface dummy = eglCreatePbufferSurface(display, config, attribs);
+    if (dummy == EGL_NO_SURFACE || !eglMakeCurrent(display, dummy, dummy, ctxt)) {
+        ALOGE("can't make the EGLContext current to destroy its RenderEngine; "
+                "its GL objects are left to the context's destruction");
+    }
+
+    delete engine;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (dummy != EGL_NO_SURFACE) {
+        eglDestroySurface(display, dummy);
+    }
+    eglDestroyContext(display, ctxt);
+}
+
 RenderEngine::RenderEngine() : mEGLContext(EGL_NO_CONTEXT) {
 }
 
@@ -219,10 +301,103 @@ void RenderEngine::fillRegionWithColor(const Region& region, uint32_t height,
     drawMesh(mesh);
 }
 
+static inline float clampf(float v, float lo, float hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void RenderEngine::drawMeshClipped(const Mesh& mesh, const Region& clip,
+        uint32_t height) {
+    const size_t stride = mesh.getStride();
+    const size_t tcSize = mesh.getTexCoordsSize();
+    if (mesh.getPrimitive() != Mesh::TRIANGLE_FAN ||
+            mesh.getVertexCount() != 4 || mesh.getVertexSize() != 2 ||
+            (tcSize != 0 && tcSize != 2)) {
+        drawMesh(mesh);
+        return;
+    }
+
+    // the quad is p0, p1, p2, p3; it is axis-aligned iff its edges
+    // p0->p3 and p0->p1 are each parallel to one of the axes.
+    float const* p = mesh.getPositions();
+    float const* t = mesh.getTexCoords();
+    const float x0 = p[0],        y0 = p[1];
+    const float x1 = p[stride],   y1 = p[stride+1];
+    const float x2 = p[2*stride], y2 = p[2*stride+1];
+    const float x3 = p[3*stride], y3 = p[3*stride+1];
+    const float ux = x3 - x0, uy = y3 - y0;
+    const float vx = x1 - x0, vy = y1 - y0;
+    const bool aligned =
+            (uy == 0 && vx == 0 && x2 == x3 && y2 == y1) ||
+            (ux == 0 && vy == 0 && x2 == x1 && y2 == y3);
+    const float uu = ux*ux + uy*uy;
+    const float vv = vx*vx + vy*vy;
+    if (!aligned || uu == 0 || vv == 0) {
+        drawMesh(mesh);
+        return;
+    }
+
+    const float l   = fminf(x0, x2);
+    const float r   = fmaxf(x0, x2);
+    const float b   = fminf(y0, y2);
+    const float top = fmaxf(y0, y2);
+
+    size_t c;
+    Rect const* rects = clip.getArray(&c);
+    size_t n = 0;
+    for (size_t i=0 ; i<c ; i++) {
+        const Rect& rc(rects[i]);
+        if (clampf(rc.left, l, r) < clampf(rc.right, l, r) &&
+                clampf(height - rc.bottom, b, top) < clampf(height - rc.top, b, top)) {
+            n++;
+        }
+    }
+    if (!n) {
+        return;
+    }
+
+    Mesh clipped(Mesh::TRIANGLES, n*6, 2, tcSize);
+    Mesh::VertexArray<vec2> position(clipped.getPositionArray<vec2>());
+    Mesh::VertexArray<vec2> texCoord(clipped.getTexCoordArray<vec2>());
+    size_t k = 0;
+    for (size_t i=0 ; i<c ; i++) {
+        const Rect& rc(rects[i]);
+        const float cl = clampf(rc.left, l, r);
+        const float cr = clampf(rc.right, l, r);
+        const float cb = clampf(height - rc.bottom, b, top);
+        const float ct = clampf(height - rc.top, b, top);
+        if (cl >= cr || cb >= ct) {
+            continue;
+        }
+        position[k + 0] = vec2(cl, ct);
+        position[k + 1] = vec2(cl, cb);
+        position[k + 2] = vec2(cr, cb);
+        position[k + 3] = vec2(cl, ct);
+        position[k + 4] = vec2(cr, cb);
+        position[k + 5] = vec2(cr, ct);
+        if (tcSize) {
+            for (size_t j=0 ; j<6 ; j++) {
+                const float dx = position[k + j].x - x0;
+                const float dy = position[k + j].y - y0;
+                const float s = (dx*ux + dy*uy) / uu;   // along p0->p3
+                const float q = (dx*vx + dy*vy) / vv;   // along p0->p1
+                texCoord[k + j] = vec2(
+                        t[0] + s*(t[3*stride]   - t[0]) + q*(t[stride]   - t[0]),
+                        t[1] + s*(t[3*stride+1] - t[1]) + q*(t[stride+1] - t[1]));
+            }
+        }
+        k += 6;
+    }
+    drawMesh(clipped);
+}
+
 void RenderEngine::flush() {
     glFlush();
 }
 
+void RenderEngine::finish() {
+    glFinish();
+}
+
 void RenderEngine::clearWithColor(float red, float green, float blue, float alpha) {
     glClearColor(red, green, blue, alpha);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -61,17 +61,36 @@ protected:
 public:
     static RenderEngine* create(EGLDisplay display, int hwcFormat);
 
+    // creates an engine whose context shares textures with engine's, for
+    // drawing on another thread. must be called on that thread; returns
+    // NULL when the share context can't be created or isn't GLES 2.0+.
+    static RenderEngine* createShared(EGLDisplay display, int hwcFormat,
+            const RenderEngine& engine);
+    // destroys an engine and its context. the context is made current on
+    // the calling thread while its GL objects are deleted, and no context is
+    // current afterwards.
+    static void destroy(EGLDisplay display, RenderEngine* engine);
+
     static EGLConfig chooseEglConfig(EGLDisplay display, int format);
 
+    // true if name is one of the space separated extensions in exts
+    static bool findExtension(const char* exts, const char* name);
+
     // dump the extension strings. always call the base class.
     virtual void dump(String8& result);
 
     // helpers
     void flush();
+    void finish();
     void clearWithColor(float red, float green, float blue, float alpha);
     void fillRegionWithColor(const Region& region, uint32_t height,
             float red, float green, float blue, float alpha);
 
+    // draws an axis-aligned 4-vertex TRIANGLE_FAN restricted to the
+    // rectangles of clip (in screen coordinates), with texture coordinates
+    // interpolated, in a single draw call. other meshes are drawn as-is.
+    void drawMeshClipped(const Mesh& mesh, const Region& clip, uint32_t height);
+
     // common to all GL versions
     void setScissor(uint32_t left, uint32_t bottom, uint32_t right, uint32_t top);
     void disableScissor();
@@ -96,6 +115,11 @@ public:
     virtual void setupLayerBlending(bool premultipliedAlpha, bool opaque, int alpha) = 0;
     virtual void setupDimLayerBlending(int alpha) = 0;
     virtual void setupLayerTexturing(const Texture& texture) = 0;
+    // setupLayerTexturing() in two steps, for textures other contexts may
+    // be sampling: prepareLayerTexture() sets the texture's parameters once
+    // up front, setupPreparedLayerTexturing() then only binds it.
+    virtual void prepareLayerTexture(const Texture& texture) = 0;
+    virtual void setupPreparedLayerTexturing(const Texture& texture) = 0;
     virtual void setupLayerBlackedOut() = 0;
     virtual void setupFillWithColor(float r, float g, float b, float a) = 0;
 
@@ -116,6 +140,9 @@ public:
     // transformed by the given color transform when endGroup() is called.
     virtual void beginGroup(const mat4& colorTransform) = 0;
     virtual void endGroup() = 0;
+    // frees the render targets groups keep around between frames; called
+    // once groups are no longer in use.
+    virtual void releaseGroupTargets() { }
 
     // queries
     virtual size_t getMaxTextureSize() const = 0;
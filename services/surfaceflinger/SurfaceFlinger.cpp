@@ -61,12 +61,15 @@
 #include "clz.h"
 #include "Colorizer.h"
 #include "DdmConnection.h"
+#include "DisplayCompositionThread.h"
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "EventControlThread.h"
 #include "EventThread.h"
+#include "FenceWatcher.h"
 #include "Layer.h"
 #include "LayerDim.h"
+#include "LayerJournal.h"
 #include "SurfaceFlinger.h"
 
 #include "DisplayHardware/FramebufferSurface.h"
@@ -143,6 +146,7 @@ SurfaceFlinger::SurfaceFlinger()
         mLayersRemoved(false),
         mRepaintEverything(0),
         mRenderEngine(NULL),
+        mGLDeletionQueue(new GLDeletionQueue(*this)),
         mBootTime(systemTime()),
         mVisibleRegionsDirty(false),
         mHwWorkListDirty(false),
@@ -156,6 +160,8 @@ SurfaceFlinger::SurfaceFlinger()
         mDebugInTransaction(0),
         mLastTransactionTime(0),
         mBootFinished(false),
+        mDisplayThreadsEnabled(false),
+        mJournal(NULL),
         mGpuTileRenderEnable(false),
         mPrimaryHWVsyncEnabled(false),
         mHWVsyncAvailable(false),
@@ -173,6 +179,14 @@ SurfaceFlinger::SurfaceFlinger()
     property_get("debug.sf.showupdates", value, "0");
     mDebugRegion = atoi(value);
 
+    property_get("debug.sf.display_threads", value, "0");
+    mDisplayThreadsEnabled = atoi(value);
+
+    property_get("debug.sf.journal", value, "");
+    if (value[0]) {
+        mJournal = LayerJournal::open(value);
+    }
+
     property_get("debug.sf.ddms", value, "0");
     mDebugDDMS = atoi(value);
     if (mDebugDDMS) {
@@ -194,6 +208,8 @@ SurfaceFlinger::SurfaceFlinger()
 #endif
 
     ALOGI_IF(mDebugRegion, "showupdates enabled");
+    ALOGI_IF(mDisplayThreadsEnabled, "per-display composition threads enabled");
+    ALOGI_IF(mJournal, "layer journal enabled");
     ALOGI_IF(mDebugDDMS, "DDMS debugging enabled");
 }
 
@@ -204,9 +220,16 @@ void SurfaceFlinger::onFirstRef()
 
 SurfaceFlinger::~SurfaceFlinger()
 {
+    // the threads hold on to their displays and use our engine's context
+    for (size_t i=0 ; i<mCompositionThreads.size() ; i++) {
+        mCompositionThreads[i]->stop();
+    }
+    mCompositionThreads.clear();
+
     EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglTerminate(display);
+    delete mJournal;
 }
 
 void SurfaceFlinger::binderDied(const wp<IBinder>& /* who */)
@@ -323,19 +346,28 @@ void SurfaceFlinger::bootFinished()
 }
 
 void SurfaceFlinger::deleteTextureAsync(uint32_t texture) {
-    class MessageDestroyGLTexture : public MessageBase {
+    mGLDeletionQueue->deleteTexture(texture);
+}
+
+void SurfaceFlinger::onDrainNeeded() {
+    class MessageDestroyGLObjects : public MessageBase {
         RenderEngine& engine;
-        uint32_t texture;
+        sp<GLDeletionQueue> queue;
     public:
-        MessageDestroyGLTexture(RenderEngine& engine, uint32_t texture)
-            : engine(engine), texture(texture) {
+        MessageDestroyGLObjects(RenderEngine& engine,
+                const sp<GLDeletionQueue>& queue)
+            : engine(engine), queue(queue) {
         }
         virtual bool handler() {
-            engine.deleteTextures(1, &texture);
+            queue->drain(engine);
             return true;
         }
     };
-    postMessageAsync(new MessageDestroyGLTexture(getRenderEngine(), texture));
+    // the queue is drained by postComposition() every frame; this is only
+    // called for the first texture or EGLImage of a batch, so it doesn't
+    // linger if no frame comes.
+    postMessageAsync(new MessageDestroyGLObjects(getRenderEngine(),
+            mGLDeletionQueue));
 }
 
 class DispSyncSource : public VSyncSource, private DispSync::Callback {
@@ -1019,6 +1051,13 @@ void SurfaceFlinger::postComposition()
         layers[i]->onPostComposition();
     }
 
+    // destroy the textures and EGLImages released since the last frame
+    mGLDeletionQueue->drain(getRenderEngine());
+
+    if (CC_UNLIKELY(mJournal)) {
+        mJournal->flush();
+    }
+
     const HWComposer& hwc = getHwComposer();
     sp<Fence> presentFence = hwc.getDisplayFence(HWC_DISPLAY_PRIMARY);
 
@@ -1069,6 +1108,7 @@ void SurfaceFlinger::rebuildLayerStacks() {
             Region opaqueRegion;
             Region dirtyRegion;
             Vector< sp<Layer> > layersSortedByZ;
+            KeyedVector<Layer const*, Region> coverageBelow;
             const sp<DisplayDevice>& hw(mDisplays[dpy]);
             const Transform& tr(hw->getTransform());
             const Rect bounds(hw->getBounds());
@@ -1088,8 +1128,10 @@ void SurfaceFlinger::rebuildLayerStacks() {
                         layersSortedByZ.add(layer);
                     }
                 }
+                computeCoverageBelow(hw, layersSortedByZ, coverageBelow);
             }
             hw->setVisibleLayersSortedByZ(layersSortedByZ);
+            hw->setCoverageBelow(coverageBelow);
             hw->undefinedRegion.set(bounds);
             hw->undefinedRegion.subtractSelf(tr.transform(opaqueRegion));
             hw->dirtyRegion.orSelf(dirtyRegion);
@@ -1097,6 +1139,37 @@ void SurfaceFlinger::rebuildLayerStacks() {
     }
 }
 
+void SurfaceFlinger::computeCoverageBelow(const sp<const DisplayDevice>& hw,
+        const Vector< sp<Layer> >& layers,
+        KeyedVector<Layer const*, Region>& outCoverage)
+{
+    // layers without a buffer plug the holes of what's below them
+    // (see Layer::onDraw()), record what's below each of them once here
+    // rather than walking the layer list for each of them at draw time.
+    const size_t count = layers.size();
+    size_t last = count;
+    for (size_t i=0 ; i<count ; i++) {
+        if (layers[i]->isUnfilled()) {
+            last = i;
+        }
+    }
+    if (last == count) {
+        return;
+    }
+
+    const Transform& tr(hw->getTransform());
+    Region under;
+    for (size_t i=0 ; i<=last ; i++) {
+        const sp<Layer>& layer(layers[i]);
+        if (layer->isUnfilled()) {
+            outCoverage.add(layer.get(), under);
+        }
+        if (i < last) {
+            under.orSelf(tr.transform(layer->visibleRegion));
+        }
+    }
+}
+
 void SurfaceFlinger::setUpHWComposer() {
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         bool dirty = !mDisplays[dpy]->getDirtyRegion(false).isEmpty();
@@ -1251,23 +1324,160 @@ void SurfaceFlinger::setUpHWComposer() {
 void SurfaceFlinger::doComposition() {
     ATRACE_CALL();
     const bool repaintEverything = android_atomic_and(0, &mRepaintEverything);
+    Vector< sp<DisplayCompositionThread> > dispatched;
+    Vector< sp<Layer> > prepared;
+    dispatchDisplayCompositions(repaintEverything, &dispatched, &prepared);
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         const sp<DisplayDevice>& hw(mDisplays[dpy]);
-        if (hw->isDisplayOn()) {
-            // transform the dirty region into this screen's coordinate space
-            const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+        if (hw->hasOwnRenderEngine() && hw->isDisplayOn()) {
+            // being composed by its thread
+            continue;
+        }
+        composeDisplay(hw, repaintEverything);
+    }
+    for (size_t i=0 ; i<dispatched.size() ; i++) {
+        dispatched[i]->waitForCompletion();
+    }
+    for (size_t i=0 ; i<prepared.size() ; i++) {
+        prepared[i]->releasePreparedTexture();
+    }
+    postFramebuffer();
+}
+
+void SurfaceFlinger::composeDisplay(const sp<DisplayDevice>& hw,
+        bool repaintEverything) {
+    if (hw->isDisplayOn()) {
+        const nsecs_t start = systemTime();
+
+        // transform the dirty region into this screen's coordinate space
+        const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+
+        // repaint the framebuffer (if needed)
+        doDisplayComposition(hw, dirtyRegion);
+
+        hw->dirtyRegion.clear();
+        hw->flip(hw->swapRegion);
+        hw->swapRegion.clear();
+
+        hw->recordCompositionTime(systemTime() - start);
+    }
+    // inform the h/w that we're done compositing
+    Mutex::Autolock _l(mHwcLock);
+    hw->compositionComplete();
+}
 
-            // repaint the framebuffer (if needed)
-            doDisplayComposition(hw, dirtyRegion);
+void SurfaceFlinger::dispatchDisplayCompositions(bool repaintEverything,
+        Vector< sp<DisplayCompositionThread> >* dispatched,
+        Vector< sp<Layer> >* prepared) {
+    if (!mDisplayThreadsEnabled) {
+        return;
+    }
 
-            hw->dirtyRegion.clear();
-            hw->flip(hw->swapRegion);
-            hw->swapRegion.clear();
+    // debug flashes and tiled rendering draw every display from the main
+    // thread outside of the normal composition
+    const bool allowed = !mDebugRegion && !mGpuTileRenderEnable;
+
+    // retire the threads of displays that went away or were re-created
+    for (size_t i = mCompositionThreads.size() ; i-- > 0 ; ) {
+        const sp<DisplayCompositionThread>& thread(mCompositionThreads[i]);
+        ssize_t index = mDisplays.indexOfKey(mCompositionThreads.keyAt(i));
+        if (!allowed || index < 0 ||
+                mDisplays[index] != thread->getDisplayDevice()) {
+            thread->stop();
+            mCompositionThreads.removeItemsAt(i);
         }
-        // inform the h/w that we're done compositing
-        hw->compositionComplete();
     }
-    postFramebuffer();
+    if (!allowed) {
+        return;
+    }
+
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        if (hw->getDisplayType() == DisplayDevice::DISPLAY_PRIMARY ||
+                !hw->isDisplayOn()) {
+            continue;
+        }
+        ssize_t index = mCompositionThreads.indexOfKey(mDisplays.keyAt(dpy));
+        if (index < 0) {
+            // the thread creates its context asynchronously; the display
+            // is composed here until it's ready.
+            mCompositionThreads.add(mDisplays.keyAt(dpy),
+                    new DisplayCompositionThread(this, hw));
+            continue;
+        }
+        const sp<DisplayCompositionThread>& thread(mCompositionThreads[index]);
+        if (!thread->isReady()) {
+            continue;
+        }
+        if (!hw->hasOwnRenderEngine()) {
+            hw->setRenderEngine(thread->getRenderEngine());
+        }
+        dispatched->add(thread);
+    }
+
+    if (dispatched->isEmpty()) {
+        return;
+    }
+
+    // mirrored displays share layers, so the threads and the main thread
+    // may all sample the same textures. bind the buffers and set the
+    // parameters of every texture drawn this frame now; nothing changes
+    // them until the threads are done.
+    KeyedVector<Layer*, bool> filtering;
+    HWComposer& hwc(getHwComposer());
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        if (!hw->isDisplayOn()) {
+            continue;
+        }
+        const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
+        const int32_t id = hw->getHwcDisplayId();
+        const bool useHwc = id >= 0 && hwc.initCheck() == NO_ERROR;
+        HWComposer::LayerListIterator cur = hwc.begin(id);
+        const HWComposer::LayerListIterator end = hwc.end(id);
+        for (size_t i=0 ; i<layers.size() ; ++i) {
+            if (useHwc) {
+                if (cur == end) {
+                    break;
+                }
+                const bool gles = cur->getCompositionType() == HWC_FRAMEBUFFER;
+                ++cur;
+                if (!gles) {
+                    continue;
+                }
+            }
+            // a texture shared by several displays is filtered if any of
+            // them needs it
+            const sp<Layer>& layer(layers[i]);
+            const bool useFiltering = layer->needsTextureFiltering(hw);
+            ssize_t index = filtering.indexOfKey(layer.get());
+            if (index < 0) {
+                filtering.add(layer.get(), useFiltering);
+                prepared->add(layer);
+            } else if (useFiltering) {
+                filtering.editValueAt(index) = true;
+            }
+        }
+    }
+    RenderEngine& engine(getRenderEngine());
+    for (size_t i=0 ; i<prepared->size() ; i++) {
+        const sp<Layer>& layer(prepared->itemAt(i));
+        layer->prepareTexture(engine, filtering.valueFor(layer.get()));
+    }
+    const bool useFenceSync = SyncFeatures::getInstance().useFenceSync();
+    if (!useFenceSync) {
+        getRenderEngine().finish();
+    }
+    for (size_t i=0 ; i<dispatched->size() ; i++) {
+        EGLSyncKHR sync = EGL_NO_SYNC_KHR;
+        if (useFenceSync) {
+            sync = eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_FENCE_KHR, NULL);
+        }
+        dispatched->itemAt(i)->compose(repaintEverything, sync);
+    }
+    if (useFenceSync) {
+        getRenderEngine().flush();
+    }
 }
 
 void SurfaceFlinger::postFramebuffer()
@@ -1804,6 +2014,45 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
     Region aboveCoveredLayers;
     Region dirty;
 
+    /*
+     * The per-layer regions below live out of the loop, and the Region
+     * operations store their results into them, so that their storage is
+     * reused from one layer to the next.
+     */
+
+    /*
+     * opaqueRegion: area of a surface that is fully opaque.
+     */
+    Region opaqueRegion;
+
+    /*
+     * visibleRegion: area of a surface that is visible on screen
+     * and not fully transparent. This is essentially the layer's
+     * footprint minus the opaque regions above it.
+     * Areas covered by a translucent surface are considered visible.
+     */
+    Region visibleRegion;
+
+    /*
+     * coveredRegion: area of a surface that is covered by all
+     * visible regions above it (which includes the translucent areas).
+     */
+    Region coveredRegion;
+
+    /*
+     * transparentRegion: area of a surface that is hinted to be completely
+     * transparent. This is only used to tell when the layer has no visible
+     * non-transparent regions and can be removed from the layer list. It
+     * does not affect the visibleRegion of this layer or any layers
+     * beneath it. The hint may not be correct if apps don't respect the
+     * SurfaceView restrictions (which, sadly, some don't).
+     */
+    Region transparentRegion;
+
+    Region newExposed;
+    Region oldExposed;
+    Region visibleNonTransparentRegion;
+
     outDirtyRegion.clear();
     bool bIgnoreLayers = false;
     int indexLOI = -1;
@@ -1867,34 +2116,10 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
             layer->setVisibleNonTransparentRegion(visibleNonTransRegion);
             continue;
         }
-        /*
-         * opaqueRegion: area of a surface that is fully opaque.
-         */
-        Region opaqueRegion;
-
-        /*
-         * visibleRegion: area of a surface that is visible on screen
-         * and not fully transparent. This is essentially the layer's
-         * footprint minus the opaque regions above it.
-         * Areas covered by a translucent surface are considered visible.
-         */
-        Region visibleRegion;
-
-        /*
-         * coveredRegion: area of a surface that is covered by all
-         * visible regions above it (which includes the translucent areas).
-         */
-        Region coveredRegion;
-
-        /*
-         * transparentRegion: area of a surface that is hinted to be completely
-         * transparent. This is only used to tell when the layer has no visible
-         * non-transparent regions and can be removed from the layer list. It
-         * does not affect the visibleRegion of this layer or any layers
-         * beneath it. The hint may not be correct if apps don't respect the
-         * SurfaceView restrictions (which, sadly, some don't).
-         */
-        Region transparentRegion;
+        // coveredRegion is always recomputed, the others start empty
+        opaqueRegion.clear();
+        visibleRegion.clear();
+        transparentRegion.clear();
 
 
         // handle hidden surfaces by setting the visible region to empty
@@ -1931,7 +2156,7 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
         }
 
         // Clip the covered region to the visible region
-        coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        aboveCoveredLayers.intersect(visibleRegion, &coveredRegion);
 
         // Update aboveCoveredLayers for next (lower) layer
         aboveCoveredLayers.orSelf(visibleRegion);
@@ -1959,11 +2184,11 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
              * (2) handles areas that were not covered by anything but got
              * exposed because of a resize.
              */
-            const Region newExposed = visibleRegion - coveredRegion;
-            const Region oldVisibleRegion = layer->visibleRegion;
-            const Region oldCoveredRegion = layer->coveredRegion;
-            const Region oldExposed = oldVisibleRegion - oldCoveredRegion;
-            dirty = (visibleRegion&oldCoveredRegion) | (newExposed-oldExposed);
+            visibleRegion.subtract(coveredRegion, &newExposed);
+            layer->visibleRegion.subtract(layer->coveredRegion, &oldExposed);
+            newExposed.subtractSelf(oldExposed);
+            visibleRegion.intersect(layer->coveredRegion, &dirty);
+            dirty.orSelf(newExposed);
         }
         dirty.subtractSelf(aboveOpaqueLayers);
 
@@ -1976,8 +2201,8 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
         // Store the visible region in screen space
         layer->setVisibleRegion(visibleRegion);
         layer->setCoveredRegion(coveredRegion);
-        layer->setVisibleNonTransparentRegion(
-                visibleRegion.subtract(transparentRegion));
+        visibleRegion.subtract(transparentRegion, &visibleNonTransparentRegion);
+        layer->setVisibleNonTransparentRegion(visibleNonTransparentRegion);
     }
 
     outOpaqueRegion = aboveOpaqueLayers;
@@ -2023,6 +2248,9 @@ bool SurfaceFlinger::handlePageFlip()
     for (size_t i = 0, count = layersWithQueuedFrames.size() ; i<count ; i++) {
         Layer* layer = layersWithQueuedFrames[i];
         const Region dirty(layer->latchBuffer(visibleRegions));
+        if (CC_UNLIKELY(mJournal)) {
+            mJournal->recordBufferLatched(layer);
+        }
         const Layer::State& s(layer->getDrawingState());
         invalidateLayerStack(s.layerStack, dirty);
     }
@@ -2064,6 +2292,21 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     hw->swapRegion.orSelf(dirtyRegion);
 
     uint32_t flags = hw->getFlags();
+    if (flags & DisplayDevice::BUFFER_AGE) {
+        Vector<int32_t> layout;
+        const int32_t id = hw->getHwcDisplayId();
+        HWComposer& hwc(getHwComposer());
+        if (id >= 0 && hwc.initCheck() == NO_ERROR) {
+            HWComposer::LayerListIterator cur = hwc.begin(id);
+            const HWComposer::LayerListIterator end = hwc.end(id);
+            for ( ; cur != end ; ++cur) {
+                layout.add(cur->getCompositionType() | (cur->getHints() << 16));
+            }
+        }
+        hw->setCompositionLayout(layout);
+        hw->addFrameDamage(dirtyRegion);
+    }
+
     if (flags & DisplayDevice::SWAP_RECTANGLE) {
         // we can redraw only what's dirty, but since SWAP_RECTANGLE only
         // takes a rectangle, we must make sure to update that whole
@@ -2076,6 +2319,15 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
             // This is needed because PARTIAL_UPDATES only takes one
             // rectangle instead of a region (see DisplayDevice::flip())
             dirtyRegion.set(hw->swapRegion.bounds());
+        } else if (canComposePartially(hw) &&
+                hw->makeCurrent(mEGLDisplay,
+                        hw->getRenderEngine().getEGLContext()) &&
+                hw->getBufferDamage(&dirtyRegion)) {
+            // the back buffer still holds a previous frame, we only need
+            // to redraw what changed since then. doComposeSurfaces()
+            // scissors to the bounds, so draw that whole rectangle.
+            dirtyRegion.set(dirtyRegion.bounds());
+            hw->swapRegion = dirtyRegion;
         } else {
             // we need to redraw everything (the whole screen)
             dirtyRegion.set(hw->bounds());
@@ -2084,9 +2336,11 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     }
 
     if (CC_LIKELY(!mDaltonize && !mHasColorMatrix)) {
+        // no-op unless a color transform was just turned off
+        hw->getRenderEngine().releaseGroupTargets();
         if (!doComposeSurfaces(hw, dirtyRegion)) return;
     } else {
-        RenderEngine& engine(getRenderEngine());
+        RenderEngine& engine(hw->getRenderEngine());
         mat4 colorMatrix = mColorMatrix;
         if (mDaltonize) {
             colorMatrix = colorMatrix * mDaltonizer();
@@ -2099,10 +2353,31 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     // update the swap region and clear the dirty region
     hw->swapRegion.orSelf(dirtyRegion);
 
-    // swap buffers (presentation)
+    // swap buffers (presentation). this posts to the framebuffer HAL and
+    // the display's surface, so only the drawing above runs concurrently
+    // with the other displays.
+    Mutex::Autolock _l(mHwcLock);
     hw->swapBuffers(getHwComposer());
 }
 
+bool SurfaceFlinger::canComposePartially(const sp<const DisplayDevice>& hw) const {
+    if (!(hw->getFlags() & DisplayDevice::BUFFER_AGE)) {
+        return false;
+    }
+    // color transforms are applied by drawing the whole group at once
+    if (mDaltonize || mHasColorMatrix) {
+        return false;
+    }
+    // the tiled dirty-rect path manages buffer preservation itself, and
+    // debug flashes swap buffers outside of the normal composition
+    if (mGpuTileRenderEnable || mDebugRegion) {
+        return false;
+    }
+    HWComposer& hwc(getHwComposer());
+    const int32_t id = hw->getHwcDisplayId();
+    return hwc.initCheck() != NO_ERROR || id < 0 || hwc.hasGlesComposition(id);
+}
+
 #ifdef QCOM_BSP
 bool SurfaceFlinger::computeTiledDr(const sp<const DisplayDevice>& hw) {
     int fbWidth= hw->getWidth();
@@ -2123,7 +2398,7 @@ bool SurfaceFlinger::computeTiledDr(const sp<const DisplayDevice>& hw) {
 
 bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty)
 {
-    RenderEngine& engine(getRenderEngine());
+    RenderEngine& engine(hw->getRenderEngine());
     const int32_t id = hw->getHwcDisplayId();
     HWComposer& hwc(getHwComposer());
     HWComposer::LayerListIterator cur = hwc.begin(id);
@@ -2133,16 +2408,30 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
     bool hasGlesComposition = hwc.hasGlesComposition(id);
     const bool hasHwcComposition = hwc.hasHwcComposition(id);
     if (hasGlesComposition) {
-        if (!hw->makeCurrent(mEGLDisplay, mEGLContext)) {
+        if (!hw->makeCurrent(mEGLDisplay, engine.getEGLContext())) {
             ALOGW("DisplayDevice::makeCurrent failed. Aborting surface composition for display %s",
                   hw->getDisplayName().string());
             eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (&engine != &getRenderEngine()) {
+                // the main thread owns the default display
+                return false;
+            }
             if(!getDefaultDisplayDevice()->makeCurrent(mEGLDisplay, mEGLContext)) {
               ALOGE("DisplayDevice::makeCurrent on default display failed. Aborting.");
             }
             return false;
         }
 
+        // when only part of the back buffer is redrawn, make sure nothing
+        // outside of it gets touched (this includes the clear below).
+        const Rect damage(dirty.getBounds());
+        const bool partial = (hw->getFlags() & DisplayDevice::BUFFER_AGE) &&
+                damage != hw->getBounds();
+        if (partial) {
+            engine.setScissor(damage.left, hw->getHeight() - damage.bottom,
+                    damage.getWidth(), damage.getHeight());
+        }
+
         // Never touch the framebuffer if we don't have any framebuffer layers
         if (hasHwcComposition) {
             // when using overlays, we assume a fully transparent framebuffer
@@ -2200,11 +2489,14 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             // scissor on the main display. It should never be needed
             // anyways (though in theory it could since the API allows it).
             const Rect& bounds(hw->getBounds());
-            const Rect& scissor(hw->getScissor());
+            Rect scissor(hw->getScissor());
             if (scissor != bounds) {
                 // scissor doesn't match the screen's dimensions, so we
                 // need to clear everything outside of it and enable
                 // the GL scissor so we don't draw anything where we shouldn't
+                if (partial) {
+                    scissor.intersect(damage, &scissor);
+                }
 
                 // enable scissor for this frame
                 const uint32_t height = hw->getHeight();
@@ -2264,6 +2556,10 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
         }
 #endif
 
+        // consecutive HWC_HINT_CLEAR_FB layers all clear to the same color
+        // without blending, so their clips are accumulated and filled with
+        // a single draw before the next GLES layer (or at the end).
+        Region pendingClear;
         for (size_t i=0 ; i<count && cur!=end ; ++i, ++cur) {
             const sp<Layer>& layer(layers[i]);
             const Region clip(dirty.intersect(tr.transform(layer->visibleRegion)));
@@ -2278,11 +2574,19 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
                                 && hasGlesComposition) {
                             // never clear the very first layer since we're
                             // guaranteed the FB is already cleared
-                            layer->clearWithOpenGL(hw, clip);
+                            if (state.transform.preserveRects()) {
+                                pendingClear.orSelf(clip);
+                            } else {
+                                layer->clearWithOpenGL(hw, clip);
+                            }
                         }
                         break;
                     }
                     case HWC_FRAMEBUFFER: {
+                        if (!pendingClear.isEmpty()) {
+                            drawWormhole(hw, pendingClear);
+                            pendingClear.clear();
+                        }
                         layer->draw(hw, clip);
                         break;
                     }
@@ -2299,6 +2603,9 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             }
             layer->setAcquireFence(hw, *cur);
         }
+        if (!pendingClear.isEmpty()) {
+            drawWormhole(hw, pendingClear);
+        }
 
 #ifdef QCOM_BSP
         // call EndTile, if starTile has been called in this cycle.
@@ -2327,7 +2634,7 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
 
 void SurfaceFlinger::drawWormhole(const sp<const DisplayDevice>& hw, const Region& region) const {
     const int32_t height = hw->getHeight();
-    RenderEngine& engine(getRenderEngine());
+    RenderEngine& engine(hw->getRenderEngine());
     engine.fillRegionWithColor(region, height, 0, 0, 0, 0);
 }
 
@@ -2349,6 +2656,9 @@ status_t SurfaceFlinger::removeLayer(const sp<Layer>& layer) {
     Mutex::Autolock _l(mStateLock);
     ssize_t index = mCurrentState.layersSortedByZ.remove(layer);
     if (index >= 0) {
+        if (CC_UNLIKELY(mJournal)) {
+            mJournal->recordLayerRemoved(layer.get());
+        }
         mLayersPendingRemoval.push(layer);
         mLayersRemoved = true;
         setTransactionFlags(eTransactionNeeded);
@@ -2449,6 +2759,10 @@ void SurfaceFlinger::setTransactionState(
     }
 
     if (transactionFlags) {
+        if (CC_UNLIKELY(mJournal)) {
+            mJournal->recordTransaction(flags);
+        }
+
         // this triggers the transaction
         setTransactionFlags(transactionFlags);
 
@@ -2585,6 +2899,9 @@ uint32_t SurfaceFlinger::setClientStateLocked(
                 flags |= eTransactionNeeded|eTraversalNeeded;
             }
         }
+        if (CC_UNLIKELY(mJournal) && flags) {
+            mJournal->recordLayerState(layer.get());
+        }
     }
     return flags;
 }
@@ -2624,6 +2941,9 @@ status_t SurfaceFlinger::createLayer(
 
     if (result == NO_ERROR) {
         addClientLayer(client, *handle, *gbp, layer);
+        if (CC_UNLIKELY(mJournal)) {
+            mJournal->recordLayerCreated(layer.get(), w, h, format, flags);
+        }
         setTransactionFlags(eTransactionNeeded);
     }
     return result;
@@ -2831,6 +3151,7 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
         }
 
         bool dumpAll = true;
+        bool binary = false;
         size_t index = 0;
         size_t numArgs = args.size();
         if (numArgs) {
@@ -2863,18 +3184,145 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
             }
         }
 
+        // only take a snapshot of the state under the lock; the rest of
+        // the dump (which can take a while) is formatted and written after
+        // releasing the lock so that a dump doesn't stall transactions.
+        DumpSnapshot snapshot;
+        bool colorize = false;
+        if (dumpAll) {
+            if ((index < numArgs) &&
+                    (args[index] == String16("--binary"))) {
+                index++;
+                binary = true;
+            } else if ((index < numArgs) &&
+                    (args[index] == String16("--color"))) {
+                index++;
+                colorize = true;
+            }
+        }
+        Colorizer colorizer(colorize);
         if (dumpAll) {
-            dumpAllLocked(args, index, result);
+            snapshotForDumpLocked(binary, snapshot);
         }
 
         if (locked) {
             mStateLock.unlock();
         }
+
+        if (dumpAll) {
+            if (binary) {
+                // nothing but the journal may be written to fd
+                ALOGW_IF(!locked, "SurfaceFlinger appears to be unresponsive, "
+                        "dumping anyways (no locks held)");
+                result.setTo("");
+                dumpBinary(fd, snapshot);
+            } else {
+                flushDump(fd, result);
+                dumpSnapshot(fd, colorizer, snapshot, result);
+            }
+        }
     }
-    write(fd, result.string(), result.size());
+    flushDump(fd, result);
     return NO_ERROR;
 }
 
+/*static*/ void SurfaceFlinger::flushDump(int fd, String8& result)
+{
+    if (!result.isEmpty()) {
+        write(fd, result.string(), result.size());
+        result.setTo("");
+    }
+}
+
+struct SurfaceFlinger::DumpSnapshot {
+    // --binary: the layers as the journal records them
+    LayerVector layers;
+    Vector<LayerJournal::LayerSnapshot> layerSnapshots;
+
+    // otherwise what the layer, display, global and h/w composer sections
+    // print, read from state the main thread changes with mStateLock held.
+    Vector<Layer::DumpState> layerStates;
+    Vector<DisplayDevice::DumpState> displayStates;
+    HWComposer::DumpState hwcState;
+    Region undefinedRegion;
+    int orientation;
+    bool isDisplayOn;
+    nsecs_t lastSwapBufferTime;
+    nsecs_t lastTransactionTime;
+    uint32_t transactionFlags;
+    nsecs_t refreshPeriod;
+    float dpiX;
+    float dpiY;
+    bool hwcDisabled;
+    // these only dump formatted text
+    String8 renderEngineDump;
+    String8 vsyncDump;
+};
+
+void SurfaceFlinger::snapshotForDumpLocked(bool binary,
+        DumpSnapshot& snapshot) const
+{
+    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const size_t count = currentLayers.size();
+    if (binary) {
+        snapshot.layers = currentLayers;
+        snapshot.layerSnapshots.resize(count);
+        for (size_t i=0 ; i<count ; i++) {
+            LayerJournal::snapshotLayer(currentLayers[i].get(),
+                    &snapshot.layerSnapshots.editItemAt(i));
+        }
+        return;
+    }
+
+    snapshot.layerStates.resize(count);
+    for (size_t i=0 ; i<count ; i++) {
+        currentLayers[i]->getDumpState(&snapshot.layerStates.editItemAt(i));
+    }
+
+    snapshot.displayStates.resize(mDisplays.size());
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        mDisplays[dpy]->getDumpState(&snapshot.displayStates.editItemAt(dpy));
+    }
+
+    HWComposer& hwc(getHwComposer());
+    hwc.getDumpState(&snapshot.hwcState);
+
+    sp<const DisplayDevice> hw(getDefaultDisplayDevice());
+    snapshot.undefinedRegion = hw->undefinedRegion;
+    snapshot.orientation = hw->getOrientation();
+    snapshot.isDisplayOn = hw->isDisplayOn();
+
+    snapshot.lastSwapBufferTime = mLastSwapBufferTime;
+    snapshot.lastTransactionTime = mLastTransactionTime;
+    snapshot.transactionFlags = mTransactionFlags;
+    snapshot.refreshPeriod = hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY);
+    snapshot.dpiX = hwc.getDpiX(HWC_DISPLAY_PRIMARY);
+    snapshot.dpiY = hwc.getDpiY(HWC_DISPLAY_PRIMARY);
+    snapshot.hwcDisabled = mDebugDisableHWC || mDebugRegion || mDaltonize
+            || mHasColorMatrix;
+
+    mRenderEngine->dump(snapshot.renderEngineDump);
+    mEventThread->dump(snapshot.vsyncDump);
+}
+
+void SurfaceFlinger::dumpBinary(int fd, const DumpSnapshot& snapshot) const
+{
+    // the displayed layers as a layer journal (see LayerJournal.h): one
+    // creation, state and buffer record per layer followed by a single
+    // transaction, which test-replay can read back.
+    LayerJournal* journal = LayerJournal::open(fd);
+    if (journal == NULL) {
+        return;
+    }
+    const size_t count = snapshot.layers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        journal->recordLayerSnapshot(snapshot.layers[i].get(),
+                snapshot.layerSnapshots[i]);
+    }
+    journal->recordTransaction(0);
+    delete journal;
+}
+
 void SurfaceFlinger::listLayersLocked(const Vector<String16>& /* args */,
         size_t& /* index */, String8& result) const
 {
@@ -2964,18 +3412,9 @@ void SurfaceFlinger::logFrameStats() {
     result.append(config);
 }
 
-void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
-        String8& result) const
+void SurfaceFlinger::dumpSnapshot(int fd, Colorizer& colorizer,
+        const DumpSnapshot& snapshot, String8& result) const
 {
-    bool colorize = false;
-    if (index < args.size()
-            && (args[index] == String16("--color"))) {
-        colorize = true;
-        index++;
-    }
-
-    Colorizer colorizer(colorize);
-
     // figure out if we're stuck somewhere
     const nsecs_t now = systemTime();
     const nsecs_t inSwapBuffers(mDebugInSwapBuffers);
@@ -3007,20 +3446,29 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.appendFormat("app phase %" PRId64 " ns, sf phase %" PRId64 " ns, "
             "present offset %d ns (refresh %" PRId64 " ns)",
         vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs, PRESENT_TIME_OFFSET_FROM_VSYNC_NS,
-        mHwc->getRefreshPeriod(HWC_DISPLAY_PRIMARY));
+        snapshot.refreshPeriod);
     result.append("\n");
 
+    sp<FenceWatcher> fenceWatcher(FenceWatcher::getInstance());
+    if (fenceWatcher != NULL) {
+        fenceWatcher->dump(result);
+    }
+
+    if (mJournal) {
+        mJournal->dump(result);
+        result.append("\n");
+    }
+
     /*
      * Dump the visible layer list
      */
-    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
-    const size_t count = currentLayers.size();
+    const size_t count = snapshot.layerStates.size();
     colorizer.bold(result);
     result.appendFormat("Visible layers (count = %zu)\n", count);
     colorizer.reset(result);
     for (size_t i=0 ; i<count ; i++) {
-        const sp<Layer>& layer(currentLayers[i]);
-        layer->dump(result, colorizer);
+        Layer::dump(result, colorizer, snapshot.layerStates[i]);
+        flushDump(fd, result);
     }
 
     /*
@@ -3028,12 +3476,12 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
      */
 
     colorizer.bold(result);
-    result.appendFormat("Displays (%zu entries)\n", mDisplays.size());
+    result.appendFormat("Displays (%zu entries)\n", snapshot.displayStates.size());
     colorizer.reset(result);
-    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
-        const sp<const DisplayDevice>& hw(mDisplays[dpy]);
-        hw->dump(result);
+    for (size_t dpy=0 ; dpy<snapshot.displayStates.size() ; dpy++) {
+        DisplayDevice::dump(result, snapshot.displayStates[dpy]);
     }
+    flushDump(fd, result);
 
     /*
      * Dump SurfaceFlinger global state
@@ -3043,9 +3491,6 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.append("SurfaceFlinger global state:\n");
     colorizer.reset(result);
 
-    HWComposer& hwc(getHwComposer());
-    sp<const DisplayDevice> hw(getDefaultDisplayDevice());
-
     colorizer.bold(result);
     result.appendFormat("EGL implementation : %s\n",
             eglQueryStringImplementationANDROID(mEGLDisplay, EGL_VERSION));
@@ -3053,11 +3498,11 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.appendFormat("%s\n",
             eglQueryStringImplementationANDROID(mEGLDisplay, EGL_EXTENSIONS));
 
-    mRenderEngine->dump(result);
+    result.append(snapshot.renderEngineDump);
 
-    hw->undefinedRegion.dump(result, "undefinedRegion");
+    snapshot.undefinedRegion.dump(result, "undefinedRegion");
     result.appendFormat("  orientation=%d, isDisplayOn=%d\n",
-            hw->getOrientation(), hw->isDisplayOn());
+            snapshot.orientation, snapshot.isDisplayOn);
     result.appendFormat(
             "  last eglSwapBuffers() time: %f us\n"
             "  last transaction time     : %f us\n"
@@ -3067,12 +3512,12 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
             "  y-dpi                     : %f\n"
             "  gpu_to_cpu_unsupported    : %d\n"
             ,
-            mLastSwapBufferTime/1000.0,
-            mLastTransactionTime/1000.0,
-            mTransactionFlags,
-            1e9 / hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY),
-            hwc.getDpiX(HWC_DISPLAY_PRIMARY),
-            hwc.getDpiY(HWC_DISPLAY_PRIMARY),
+            snapshot.lastSwapBufferTime/1000.0,
+            snapshot.lastTransactionTime/1000.0,
+            snapshot.transactionFlags,
+            1e9 / snapshot.refreshPeriod,
+            snapshot.dpiX,
+            snapshot.dpiY,
             !mGpuToCpuSupported);
 
     result.appendFormat("  eglSwapBuffers time: %f us\n",
@@ -3084,7 +3529,8 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     /*
      * VSYNC state
      */
-    mEventThread->dump(result);
+    result.append(snapshot.vsyncDump);
+    flushDump(fd, result);
 
     /*
      * Dump HWComposer state
@@ -3093,10 +3539,10 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.append("h/w composer state:\n");
     colorizer.reset(result);
     result.appendFormat("  h/w composer %s and %s\n",
-            hwc.initCheck()==NO_ERROR ? "present" : "not present",
-                    (mDebugDisableHWC || mDebugRegion || mDaltonize
-                            || mHasColorMatrix) ? "disabled" : "enabled");
-    hwc.dump(result);
+            snapshot.hwcState.present ? "present" : "not present",
+            snapshot.hwcDisabled ? "disabled" : "enabled");
+    HWComposer::dump(result, snapshot.hwcState);
+    flushDump(fd, result);
 
     /*
      * Dump gralloc state
@@ -3264,7 +3710,6 @@ status_t SurfaceFlinger::onTransact(
             case 1015: {
                 // apply a color matrix
                 n = data.readInt32();
-                mHasColorMatrix = n ? 1 : 0;
                 if (n) {
                     // color matrix is sent as mat3 matrix followed by vec3
                     // offset, then packed into a mat4 where the last row is
@@ -3277,6 +3722,15 @@ status_t SurfaceFlinger::onTransact(
                 } else {
                     mColorMatrix = mat4();
                 }
+                // an identity matrix is no transform at all; don't give up
+                // h/w composition for it
+                const mat4 identity;
+                mHasColorMatrix = false;
+                for (size_t i = 0 ; i < 4; i++) {
+                    if (mColorMatrix[i] != identity[i]) {
+                        mHasColorMatrix = true;
+                    }
+                }
                 invalidateHwcGeometry();
                 repaintEverything();
                 return NO_ERROR;
@@ -52,6 +52,7 @@
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "FrameTracker.h"
+#include "GLDeletionQueue.h"
 #include "MessageQueue.h"
 
 #include "DisplayHardware/HWComposer.h"
@@ -62,11 +63,14 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 class Client;
+class Colorizer;
+class DisplayCompositionThread;
 class DisplayEventConnection;
 class EventThread;
 class IGraphicBufferAlloc;
 class Layer;
 class LayerDim;
+class LayerJournal;
 class Surface;
 class RenderEngine;
 class EventControlThread;
@@ -82,7 +86,8 @@ enum {
 
 class SurfaceFlinger : public BnSurfaceComposer,
                        private IBinder::DeathRecipient,
-                       private HWComposer::EventHandler
+                       private HWComposer::EventHandler,
+                       private GLDeletionQueue::DrainHandler
 {
 public:
     static char const* getServiceName() ANDROID_API {
@@ -119,6 +124,12 @@ public:
     // utility function to delete a texture on the main thread
     void deleteTextureAsync(uint32_t texture);
 
+    // textures and EGLImages queued here are destroyed on the main thread
+    // once per frame
+    const sp<GLDeletionQueue>& getGLDeletionQueue() const {
+        return mGLDeletionQueue;
+    }
+
     // enable/disable h/w composer event
     // TODO: this should be made accessible only to EventThread
     void eventControl(int disp, int event, int enabled);
@@ -143,6 +154,7 @@ public:
 #endif
 private:
     friend class Client;
+    friend class DisplayCompositionThread;
     friend class DisplayEventConnection;
     friend class Layer;
     friend class MonitoredProducer;
@@ -239,6 +251,11 @@ private:
     virtual void onVSyncReceived(int type, nsecs_t timestamp);
     virtual void onHotplugReceived(int disp, bool connected);
 
+    /* ------------------------------------------------------------------------
+     * GLDeletionQueue::DrainHandler interface
+     */
+    virtual void onDrainNeeded();
+
     /* ------------------------------------------------------------------------
      * Message handling
      */
@@ -399,11 +416,26 @@ private:
     void preComposition();
     void postComposition();
     void rebuildLayerStacks();
+    static void computeCoverageBelow(const sp<const DisplayDevice>& hw,
+            const Vector< sp<Layer> >& layers,
+            KeyedVector<Layer const*, Region>& outCoverage);
     void setUpHWComposer();
     void doComposition();
+    // composes hw and informs the h/w it's done. called on the main thread
+    // or on the display's DisplayCompositionThread.
+    void composeDisplay(const sp<DisplayDevice>& hw, bool repaintEverything);
+    // hands the displays that have a composition thread their frame, after
+    // preparing the textures of every layer drawn this frame; returns the
+    // threads to wait for and the layers to release once they're done.
+    void dispatchDisplayCompositions(bool repaintEverything,
+            Vector< sp<DisplayCompositionThread> >* dispatched,
+            Vector< sp<Layer> >* prepared);
     void doDebugFlashRegions();
     void doDisplayComposition(const sp<const DisplayDevice>& hw, const Region& dirtyRegion);
 
+    // whether hw can redraw only the damaged part of its back buffer
+    bool canComposePartially(const sp<const DisplayDevice>& hw) const;
+
     // compose surfaces for display hw. this fails if using GL and the surface
     // has been destroyed and is no longer valid.
     bool doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty);
@@ -428,7 +460,16 @@ private:
     void listLayersLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     void dumpStatsLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     void clearStatsLocked(const Vector<String16>& args, size_t& index, String8& result);
-    void dumpAllLocked(const Vector<String16>& args, size_t& index, String8& result) const;
+
+    // what dumpSnapshot() and dumpBinary() need from the state guarded by
+    // mStateLock, captured with it held so that it isn't held while the rest
+    // of the dump is formatted and written.
+    struct DumpSnapshot;
+    void snapshotForDumpLocked(bool binary, DumpSnapshot& snapshot) const;
+    void dumpSnapshot(int fd, Colorizer& colorizer,
+            const DumpSnapshot& snapshot, String8& result) const;
+    void dumpBinary(int fd, const DumpSnapshot& snapshot) const;
+    static void flushDump(int fd, String8& result);
     bool startDdmConnection();
     static void appendSfConfigString(String8& result);
     void checkScreenshot(size_t w, size_t s, size_t h, void const* vaddr,
@@ -460,6 +501,7 @@ private:
     // constant members (no synchronization needed for access)
     HWComposer* mHwc;
     RenderEngine* mRenderEngine;
+    sp<GLDeletionQueue> mGLDeletionQueue;
     nsecs_t mBootTime;
     bool mGpuToCpuSupported;
     sp<EventThread> mEventThread;
@@ -491,6 +533,18 @@ private:
     nsecs_t mLastTransactionTime;
     bool mBootFinished;
 
+    // non-primary displays composed on their own thread, by display token
+    bool mDisplayThreadsEnabled;
+    KeyedVector< wp<IBinder>, sp<DisplayCompositionThread> > mCompositionThreads;
+    // serializes the calls composeDisplay() makes into h/w composer and the
+    // display surfaces (swapBuffers, compositionComplete), which may come
+    // from the composition threads and the main thread at once.
+    Mutex mHwcLock;
+
+    // layer-state journal for offline replay, NULL unless debug.sf.journal
+    // names a file to record into
+    LayerJournal* mJournal;
+
     // Set if the Gpu Tile render DR optimization enabled
     bool mGpuTileRenderEnable;
     bool mCanUseGpuTileRender;
@@ -18,6 +18,7 @@
 
 #include <cutils/compiler.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 #include <ui/Region.h>
 
 #include "clz.h"
@@ -226,11 +227,17 @@ Region Transform::transform(const Region& reg) const
     Region out;
     if (CC_UNLIKELY(transformed())) {
         if (CC_LIKELY(preserveRects())) {
-            Region::const_iterator it = reg.begin();
-            Region::const_iterator const end = reg.end();
-            while (it != end) {
-                out.orSelf(transform(*it++));
+            // the rects of a region don't overlap, and neither do their
+            // transforms, which are banded again without boolean ops
+            size_t count;
+            Rect const* rects = reg.getArray(&count);
+            Vector<Rect> transformed;
+            transformed.resize(count);
+            Rect* dst = transformed.editArray();
+            for (size_t i=0 ; i<count ; i++) {
+                dst[i] = transform(rects[i]);
             }
+            out.setDisjointRects(dst, count);
         } else {
             out.set(transform(reg.bounds()));
         }
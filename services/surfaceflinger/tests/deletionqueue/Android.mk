@@ -0,0 +1,36 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	DeletionQueueTest.cpp \
+	../../GLDeletionQueue.cpp \
+	../../RenderEngine/Description.cpp \
+	../../RenderEngine/Mesh.cpp \
+	../../RenderEngine/Program.cpp \
+	../../RenderEngine/ProgramCache.cpp \
+	../../RenderEngine/GLExtensions.cpp \
+	../../RenderEngine/RenderEngine.cpp \
+	../../RenderEngine/Texture.cpp \
+	../../RenderEngine/GLES10RenderEngine.cpp \
+	../../RenderEngine/GLES11RenderEngine.cpp \
+	../../RenderEngine/GLES20RenderEngine.cpp
+
+LOCAL_CFLAGS := -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils \
+	libui \
+	libgui \
+	libEGL \
+	libGLESv1_CM \
+	libGLESv2
+
+LOCAL_MODULE:= test-deletionqueue
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES += ../..
+
+include $(BUILD_EXECUTABLE)
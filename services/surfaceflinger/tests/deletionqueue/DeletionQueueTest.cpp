@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include "../../GLDeletionQueue.h"
+#include "../../RenderEngine/RenderEngine.h"
+
+using namespace android;
+
+// counts the drains the queue asks for, as SurfaceFlinger would post them
+class CountingDrainHandler : public GLDeletionQueue::DrainHandler {
+public:
+    CountingDrainHandler() : drains(0) { }
+    size_t drains;
+private:
+    virtual void onDrainNeeded() {
+        drains++;
+    }
+};
+
+// an EGLImage set up the way GLConsumer hands it over: the display is
+// initialized once more for each image, drain() terminates it again.
+static EGLImageKHR createImage(EGLDisplay dpy, const sp<GraphicBuffer>& buffer) {
+    eglInitialize(dpy, 0, 0);
+    EGLint attrs[] = {
+        EGL_IMAGE_PRESERVED_KHR, EGL_TRUE,
+        EGL_NONE,
+    };
+    return eglCreateImageKHR(dpy, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+            static_cast<EGLClientBuffer>(buffer->getNativeBuffer()), attrs);
+}
+
+static bool check(const char* name, size_t drains, size_t expected) {
+    printf("%-40s %zu drain(s), expected %zu  %s\n", name, drains, expected,
+            drains == expected ? "ok" : "FAIL");
+    return drains == expected;
+}
+
+int main(int argc, char **argv)
+{
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    eglInitialize(dpy, 0, 0);
+    RenderEngine* engine = RenderEngine::create(dpy, HAL_PIXEL_FORMAT_RGBA_8888);
+    if (engine == NULL) {
+        printf("couldn't create a RenderEngine\n");
+        return 1;
+    }
+    // drain() runs with the engine's context current, like in SurfaceFlinger
+    EGLint pbufferAttrs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    EGLSurface pbuffer = eglCreatePbufferSurface(dpy, engine->getEGLConfig(),
+            pbufferAttrs);
+    if (!eglMakeCurrent(dpy, pbuffer, pbuffer, engine->getEGLContext())) {
+        printf("couldn't make the RenderEngine context current\n");
+        return 1;
+    }
+
+    sp<GraphicBuffer> buffer(new GraphicBuffer(64, 64, PIXEL_FORMAT_RGBA_8888,
+            GraphicBuffer::USAGE_HW_TEXTURE));
+    bool ok = true;
+
+    // a batch made only of EGLImages, as when a layer's buffers are
+    // reallocated without any texture going away
+    {
+        CountingDrainHandler handler;
+        sp<GLDeletionQueue> queue(new GLDeletionQueue(handler));
+        for (size_t i=0 ; i<3 ; i++) {
+            queue->deleteImage(dpy, createImage(dpy, buffer));
+        }
+        ok &= check("image-only batch", handler.drains, 1);
+
+        queue->drain(*engine);
+        queue->deleteImage(dpy, createImage(dpy, buffer));
+        ok &= check("image-only batch after a drain", handler.drains, 2);
+        queue->drain(*engine);
+    }
+
+    // textures and images in the same batch still ask for a single drain
+    {
+        CountingDrainHandler handler;
+        sp<GLDeletionQueue> queue(new GLDeletionQueue(handler));
+        queue->deleteImage(dpy, createImage(dpy, buffer));
+        uint32_t textures[2];
+        engine->genTextures(2, textures);
+        queue->deleteTexture(textures[0]);
+        queue->deleteImage(dpy, createImage(dpy, buffer));
+        queue->deleteTexture(textures[1]);
+        ok &= check("mixed batch", handler.drains, 1);
+        queue->drain(*engine);
+    }
+
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(dpy, pbuffer);
+    RenderEngine::destroy(dpy, engine);
+    eglTerminate(dpy);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark for the primary display's frame time while a virtual display
+ * mirrors it: updates the buffers of many layers every frame with hardware
+ * composition turned off, so both displays draw every layer with GLES from
+ * the same textures. Each frame waits for the previous one to be committed,
+ * so the frame interval is the primary display's frame time once
+ * composition takes longer than a vsync period. The primary display's own
+ * composition time, from SurfaceFlinger's dump, is reported alongside.
+ *
+ * Run it once with debug.sf.display_threads set to 0 and once with it set
+ * to 1 (the property is read when SurfaceFlinger starts) to compare
+ * composing the mirror on the main thread with composing it on its own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/memory.h>
+#include <cutils/properties.h>
+
+#include <utils/Timers.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+
+#include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueue.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+
+#include <ui/DisplayInfo.h>
+
+using namespace android;
+
+// same as "service call SurfaceFlinger 1008 i32 <disable>"
+static status_t setHwcDisabled(const sp<IBinder>& sf, bool disable)
+{
+    Parcel data, reply;
+    data.writeInterfaceToken(String16("android.ui.ISurfaceComposer"));
+    data.writeInt32(disable ? 1 : 0);
+    return sf->transact(1008, data, &reply);
+}
+
+// the primary display's average composition time in ms, from the
+// "composition:" line following its DisplayDevice entry; -1 if not found.
+static double getPrimaryCompositionTime(const sp<IBinder>& sf)
+{
+    FILE* f = tmpfile();
+    if (f == NULL) {
+        return -1;
+    }
+    sf->dump(fileno(f), Vector<String16>());
+    rewind(f);
+
+    double avg = -1;
+    bool primary = false;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, "+ DisplayDevice:")) {
+            primary = false;
+        } else if (strstr(line, "type=0,")) {
+            primary = true;
+        } else if (primary) {
+            const char* s = strstr(line, "avg=");
+            if (s) {
+                avg = atof(s + 4);
+                break;
+            }
+        }
+    }
+    fclose(f);
+    return avg;
+}
+
+// keeps the mirror's buffers flowing
+class Drain : public BufferItemConsumer::FrameAvailableListener {
+public:
+    Drain(const sp<BufferItemConsumer>& consumer) : mConsumer(consumer) { }
+private:
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        BufferItemConsumer::BufferItem item;
+        if (mConsumer->acquireBuffer(&item, 0) == NO_ERROR) {
+            mConsumer->releaseBuffer(item);
+        }
+    }
+    const sp<BufferItemConsumer> mConsumer;
+};
+
+static void fill(const sp<Surface>& surface, uint16_t color)
+{
+    ANativeWindow_Buffer outBuffer;
+    if (surface->lock(&outBuffer, NULL) != NO_ERROR) {
+        return;
+    }
+    ssize_t bpr = outBuffer.stride * bytesPerPixel(outBuffer.format);
+    android_memset16((uint16_t*)outBuffer.bits, color, bpr*outBuffer.height);
+    surface->unlockAndPost();
+}
+
+int main(int argc, char** argv)
+{
+    size_t layerCount = 16;
+    size_t frameCount = 300;
+    bool mirror = true;
+    if (argc > 1) layerCount = atoi(argv[1]);
+    if (argc > 2) frameCount = atoi(argv[2]);
+    if (argc > 3) mirror = atoi(argv[3]);
+    if (layerCount == 0 || frameCount == 0) {
+        printf("usage: %s [layers] [frames] [mirror]\n", argv[0]);
+        return 1;
+    }
+
+    sp<ProcessState> proc(ProcessState::self());
+    ProcessState::self()->startThreadPool();
+
+    sp<IBinder> sf(defaultServiceManager()->checkService(String16("SurfaceFlinger")));
+    if (sf == NULL) {
+        printf("SurfaceFlinger isn't running\n");
+        return 1;
+    }
+
+    DisplayInfo info;
+    sp<IBinder> dpy = SurfaceComposerClient::getBuiltInDisplay(
+            ISurfaceComposer::eDisplayIdMain);
+    SurfaceComposerClient::getDisplayInfo(dpy, &info);
+    const uint32_t w = info.w / 2;
+    const uint32_t h = info.h / 2;
+
+    sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+
+    // overlapping, half-screen, translucent layers so every one of them is
+    // sampled on every frame
+    Vector< sp<SurfaceControl> > layers;
+    SurfaceComposerClient::openGlobalTransaction();
+    for (size_t i=0 ; i<layerCount ; i++) {
+        sp<SurfaceControl> sc = client->createSurface(
+                String8("displaythreads-layer"), w, h, PIXEL_FORMAT_RGB_565, 0);
+        sc->setLayer(100000 + i);
+        sc->setPosition((i % 4) * w / 4, ((i / 4) % 4) * h / 4);
+        sc->setAlpha(0.5f);
+        sc->show();
+        layers.add(sc);
+    }
+    SurfaceComposerClient::closeGlobalTransaction(true);
+
+    // a virtual display showing the same layer stack
+    sp<IBinder> mirrorDpy;
+    sp<BufferItemConsumer> consumer;
+    sp<Drain> drain;
+    if (mirror) {
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> bq;
+        BufferQueue::createBufferQueue(&producer, &bq);
+        consumer = new BufferItemConsumer(bq, GRALLOC_USAGE_HW_TEXTURE);
+        consumer->setName(String8("displaythreads-mirror"));
+        consumer->setDefaultBufferSize(info.w, info.h);
+        drain = new Drain(consumer);
+        consumer->setFrameAvailableListener(drain);
+
+        mirrorDpy = SurfaceComposerClient::createDisplay(
+                String8("displaythreads-mirror"), false);
+        SurfaceComposerClient::openGlobalTransaction();
+        SurfaceComposerClient::setDisplaySurface(mirrorDpy, producer);
+        SurfaceComposerClient::setDisplayLayerStack(mirrorDpy, 0);
+        SurfaceComposerClient::setDisplayProjection(mirrorDpy, 0,
+                Rect(info.w, info.h), Rect(info.w, info.h));
+        SurfaceComposerClient::closeGlobalTransaction(true);
+    }
+
+    if (setHwcDisabled(sf, true) != NO_ERROR) {
+        printf("couldn't force GLES composition\n");
+    }
+
+    // post a new buffer to every layer, then wait for a commit; warm up
+    // for a while so the reported moving average only covers the run.
+    const size_t warmup = 30;
+    nsecs_t start = 0;
+    for (size_t f=0 ; f<warmup+frameCount ; f++) {
+        if (f == warmup) {
+            start = systemTime();
+        }
+        for (size_t i=0 ; i<layerCount ; i++) {
+            fill(layers[i]->getSurface(), uint16_t(f * 0x0841 + i));
+        }
+        SurfaceComposerClient::openGlobalTransaction();
+        layers[0]->setPosition(f % 16, 0);
+        SurfaceComposerClient::closeGlobalTransaction(true);
+    }
+    const nsecs_t elapsed = systemTime() - start;
+    const double composition = getPrimaryCompositionTime(sf);
+
+    setHwcDisabled(sf, false);
+    if (mirrorDpy != NULL) {
+        SurfaceComposerClient::destroyDisplay(mirrorDpy);
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.display_threads", value, "0");
+    printf("%zu layers, %zu frames, %s, display_threads=%s\n",
+            layerCount, frameCount, mirror ? "mirrored" : "not mirrored", value);
+    printf("  frame interval:           %.3f ms\n",
+            double(elapsed) / double(frameCount) / 1000000.0);
+    printf("  primary composition time: %.3f ms (avg)\n", composition);
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Regression benchmark for visible layers that never received a buffer:
+ * stacks many sideband-stream layers (which are visible without a buffer,
+ * like a tunneled video SurfaceView) over a filled background and times
+ * synchronous transactions that force the visible regions, and the
+ * coverage below each unfilled layer, to be recomputed every frame.
+ *
+ * Such layers only go through Layer::onDraw()'s hole plugging when they
+ * are composed with GLES, so hardware composition is turned off for the
+ * duration of the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cutils/memory.h>
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <utils/NativeHandle.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+
+using namespace android;
+
+// same as "service call SurfaceFlinger 1008 i32 <disable>"
+static status_t setHwcDisabled(bool disable)
+{
+    sp<IBinder> sf(defaultServiceManager()->checkService(String16("SurfaceFlinger")));
+    if (sf == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    Parcel data, reply;
+    data.writeInterfaceToken(String16("android.ui.ISurfaceComposer"));
+    data.writeInt32(disable ? 1 : 0);
+    return sf->transact(1008, data, &reply);
+}
+
+int main(int argc, char** argv)
+{
+    size_t layerCount = 64;
+    size_t frameCount = 300;
+    if (argc > 1) layerCount = atoi(argv[1]);
+    if (argc > 2) frameCount = atoi(argv[2]);
+    if (layerCount == 0 || frameCount == 0) {
+        printf("usage: %s [layers] [frames]\n", argv[0]);
+        return 1;
+    }
+
+    sp<ProcessState> proc(ProcessState::self());
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+
+    // a filled, opaque background so the unfilled layers have something
+    // under them
+    sp<SurfaceControl> background = client->createSurface(
+            String8("holes-background"), 512, 512, PIXEL_FORMAT_RGB_565, 0);
+    sp<Surface> surface = background->getSurface();
+    ANativeWindow_Buffer outBuffer;
+    surface->lock(&outBuffer, NULL);
+    ssize_t bpr = outBuffer.stride * bytesPerPixel(outBuffer.format);
+    android_memset16((uint16_t*)outBuffer.bits, 0x001F, bpr*outBuffer.height);
+    surface->unlockAndPost();
+
+    // an empty stream is enough: SurfaceFlinger never looks inside it
+    native_handle_t* stream = native_handle_create(0, 0);
+    sp<NativeHandle> sideband = NativeHandle::create(stream, true);
+
+    Vector< sp<SurfaceControl> > holes;
+    SurfaceComposerClient::openGlobalTransaction();
+    background->setLayer(100000);
+    for (size_t i=0 ; i<layerCount ; i++) {
+        sp<SurfaceControl> sc = client->createSurface(String8("holes-unfilled"),
+                64, 64, PIXEL_FORMAT_RGBA_8888, 0);
+        sc->getSurface()->setSidebandStream(sideband);
+        sc->setLayer(100001 + i);
+        sc->setPosition((i % 8) * 64, ((i / 8) % 8) * 64);
+        sc->show();
+        holes.add(sc);
+    }
+    SurfaceComposerClient::closeGlobalTransaction(true);
+
+    if (setHwcDisabled(true) != NO_ERROR) {
+        printf("couldn't force GLES composition, the holes won't be drawn\n");
+    }
+
+    // move the topmost unfilled layer around; each synchronous
+    // transaction waits for the previous frame to be committed.
+    const nsecs_t start = systemTime();
+    for (size_t f=0 ; f<frameCount ; f++) {
+        SurfaceComposerClient::openGlobalTransaction();
+        holes[layerCount-1]->setPosition(f % 448, (f * 3) % 448);
+        SurfaceComposerClient::closeGlobalTransaction(true);
+    }
+    const nsecs_t elapsed = systemTime() - start;
+
+    setHwcDisabled(false);
+
+    printf("%zu sideband layers, %zu frames: %.3f ms/frame\n",
+            layerCount, frameCount,
+            double(elapsed) / double(frameCount) / 1000000.0);
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	replay.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../..
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+	libbinder \
+    libui \
+    libgui
+
+LOCAL_MODULE:= test-replay
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
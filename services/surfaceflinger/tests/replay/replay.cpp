@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a layer journal recorded with debug.sf.journal: recreates the
+ * recorded layers, applies their state changes in the recorded
+ * transactions and queues a buffer of the recorded size and format for
+ * every latch, so the composition workload can be reproduced (and timed)
+ * away from the app that produced it.
+ *
+ * usage: test-replay [-f] journal
+ *   -f  replay as fast as possible instead of honouring recorded timing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/ProcessState.h>
+
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <private/gui/LayerState.h>
+
+#include "LayerJournal.h"
+
+using namespace android;
+
+typedef LayerJournalFormat J;
+
+static bool readJournal(const char* path, Vector<uint8_t>* data)
+{
+    FILE* file = fopen(path, "re");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data->appendArray(chunk, n);
+    }
+    fclose(file);
+
+    const J::Header* header = reinterpret_cast<const J::Header*>(data->array());
+    if (data->size() < sizeof(J::Header) || header->magic != J::MAGIC ||
+            header->version != J::VERSION) {
+        fprintf(stderr, "%s: not a layer journal\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void applyState(const sp<SurfaceControl>& sc, const J::LayerState& s)
+{
+    sc->setLayerStack(s.layerStack);
+    sc->setLayer(s.z);
+    sc->setPosition(s.x, s.y);
+    sc->setSize(s.w, s.h);
+    sc->setAlpha(s.alpha / 255.0f);
+    sc->setMatrix(s.matrix[0], s.matrix[1], s.matrix[2], s.matrix[3]);
+    sc->setCrop(Rect(s.crop[0], s.crop[1], s.crop[2], s.crop[3]));
+    sc->setFlags(s.flags, layer_state_t::eLayerOpaque);
+    if (s.flags & layer_state_t::eLayerHidden) {
+        sc->hide();
+    } else {
+        sc->show();
+    }
+}
+
+static bool postBuffer(const sp<SurfaceControl>& sc, const J::BufferLatch& l)
+{
+    sp<Surface> surface = sc->getSurface();
+    native_window_set_buffers_dimensions(surface.get(), l.w, l.h);
+    native_window_set_buffers_format(surface.get(), l.format);
+
+    ANativeWindow_Buffer outBuffer;
+    if (surface->lock(&outBuffer, NULL) != NO_ERROR) {
+        return false;
+    }
+    // the content doesn't matter, but make it change from frame to frame
+    static uint8_t fill = 0;
+    ssize_t bpr = outBuffer.stride * bytesPerPixel(outBuffer.format);
+    memset(outBuffer.bits, fill += 0x11, bpr * outBuffer.height);
+    surface->unlockAndPost();
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool realtime = true;
+    int c;
+    while ((c = getopt(argc, argv, "f")) != -1) {
+        switch (c) {
+            case 'f':
+                realtime = false;
+                break;
+            default:
+                printf("usage: %s [-f] journal\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("usage: %s [-f] journal\n", argv[0]);
+        return 1;
+    }
+
+    Vector<uint8_t> data;
+    if (!readJournal(argv[optind], &data)) {
+        return 1;
+    }
+
+    sp<ProcessState> proc(ProcessState::self());
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+    KeyedVector<uint32_t, sp<SurfaceControl> > layers;
+
+    size_t transactions = 0;
+    size_t frames = 0;
+    size_t skipped = 0;
+    bool inTransaction = false;
+    nsecs_t firstTimestamp = -1;
+
+    const nsecs_t start = systemTime();
+    size_t offset = sizeof(J::Header);
+    while (offset + sizeof(J::Record) <= data.size()) {
+        const J::Record* record =
+                reinterpret_cast<const J::Record*>(data.array() + offset);
+        const uint8_t* payload = data.array() + offset + sizeof(J::Record);
+        offset += sizeof(J::Record) + record->size;
+        if (offset > data.size()) {
+            fprintf(stderr, "journal truncated\n");
+            break;
+        }
+
+        if (firstTimestamp < 0) {
+            firstTimestamp = record->timestamp;
+        }
+        if (realtime) {
+            nsecs_t due = start + (record->timestamp - firstTimestamp);
+            nsecs_t now = systemTime();
+            if (due > now) {
+                usleep(ns2us(due - now));
+            }
+        }
+
+        switch (record->type) {
+            case J::LAYER_CREATE: {
+                const J::LayerCreate* create =
+                        reinterpret_cast<const J::LayerCreate*>(payload);
+                String8 name(reinterpret_cast<const char*>(create + 1),
+                        create->nameLength);
+                sp<SurfaceControl> sc = client->createSurface(name,
+                        create->w, create->h, create->format, create->flags);
+                if (sc == NULL) {
+                    fprintf(stderr, "can't create '%s'\n", name.string());
+                    break;
+                }
+                layers.add(create->id, sc);
+                break;
+            }
+            case J::LAYER_STATE: {
+                const J::LayerState* state =
+                        reinterpret_cast<const J::LayerState*>(payload);
+                ssize_t index = layers.indexOfKey(state->id);
+                if (index < 0) {
+                    break;
+                }
+                if (!inTransaction) {
+                    SurfaceComposerClient::openGlobalTransaction();
+                    inTransaction = true;
+                }
+                applyState(layers.valueAt(index), *state);
+                break;
+            }
+            case J::TRANSACTION: {
+                const J::Transaction* transaction =
+                        reinterpret_cast<const J::Transaction*>(payload);
+                if (!inTransaction) {
+                    SurfaceComposerClient::openGlobalTransaction();
+                }
+                if (transaction->flags & ISurfaceComposer::eAnimation) {
+                    SurfaceComposerClient::setAnimationTransaction();
+                }
+                SurfaceComposerClient::closeGlobalTransaction(
+                        transaction->flags & ISurfaceComposer::eSynchronous);
+                inTransaction = false;
+                transactions++;
+                break;
+            }
+            case J::BUFFER_LATCH: {
+                const J::BufferLatch* latch =
+                        reinterpret_cast<const J::BufferLatch*>(payload);
+                ssize_t index = layers.indexOfKey(latch->id);
+                if (index >= 0 && postBuffer(layers.valueAt(index), *latch)) {
+                    frames++;
+                } else {
+                    skipped++;
+                }
+                break;
+            }
+            case J::LAYER_REMOVE: {
+                const J::LayerRemove* remove =
+                        reinterpret_cast<const J::LayerRemove*>(payload);
+                ssize_t index = layers.indexOfKey(remove->id);
+                if (index >= 0) {
+                    layers.editValueAt(index)->clear();
+                    layers.removeItemsAt(index);
+                }
+                break;
+            }
+            default:
+                // unknown records are skipped, their size is known
+                break;
+        }
+    }
+    if (inTransaction) {
+        SurfaceComposerClient::closeGlobalTransaction();
+    }
+    const nsecs_t elapsed = systemTime() - start;
+
+    printf("replayed %zu transactions, %zu buffers (%zu skipped) "
+            "in %.3f ms\n", transactions, frames, skipped,
+            double(elapsed) / 1000000.0);
+
+    return 0;
+}
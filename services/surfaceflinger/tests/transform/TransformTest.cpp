@@ -14,11 +14,68 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include <utils/Errors.h>
+#include <utils/Timers.h>
+#include <ui/Region.h>
 #include "../../Transform.h"
 
 using namespace android;
 
+// a region of about 500 rects: staggered rows of rects of random widths,
+// some of them touching, as left by a cluttered dirty region
+static Region makeRegion() {
+    Region r;
+    srand(1);
+    for (int y = 0; y < 25; y++) {
+        const int top = y * 70;
+        const int bottom = top + 40 + (y % 3) * 15;
+        for (int x = 0; x < 20; x++) {
+            const int left = x * 50 + (y & 1) * 25;
+            r.orSelf(Rect(left, top, left + 20 + rand() % 31, bottom));
+        }
+    }
+    return r;
+}
+
+// what Transform::transform(const Region&) did before: or each rect in
+static Region transformByRects(const Transform& tr, const Region& reg) {
+    Region out;
+    for (Region::const_iterator it = reg.begin(); it != reg.end(); it++) {
+        out.orSelf(tr.transform(*it));
+    }
+    return out;
+}
+
+static bool testRegionTransform(const char* name, const Transform& tr,
+        const Region& reg) {
+    enum { ITERATIONS = 100 };
+
+    const Region expected(transformByRects(tr, reg));
+    const Region result(tr.transform(reg));
+    const size_t count = result.end() - result.begin();
+    const bool same = size_t(expected.end() - expected.begin()) == count &&
+            !memcmp(expected.begin(), result.begin(), count * sizeof(Rect));
+
+    nsecs_t start = systemTime();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        transformByRects(tr, reg);
+    }
+    const nsecs_t byRects = systemTime() - start;
+    start = systemTime();
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        tr.transform(reg);
+    }
+    const nsecs_t inBulk = systemTime() - start;
+
+    printf("%-10s %4zu rects  by rect %10.1f ns  in bulk %10.1f ns  %s\n",
+            name, count, double(byRects) / ITERATIONS,
+            double(inBulk) / ITERATIONS, same ? "ok" : "MISMATCH");
+    return same;
+}
+
 int main(int argc, char **argv)
 {
     Transform tr90(Transform::ROT_90);
@@ -41,5 +98,28 @@ int main(int argc, char **argv)
     (tr90*trFH).dump("tr90*trFH");
     (tr90*trFV).dump("tr90*trFV");
 
-    return 0;
+    // regions under each orientation of a 1080x1920 display
+    const Region reg(makeRegion());
+    static const struct { const char* name; uint32_t flags; } kOrientations[] = {
+        { "ROT_0",   Transform::ROT_0 },
+        { "FLIP_H",  Transform::FLIP_H },
+        { "FLIP_V",  Transform::FLIP_V },
+        { "ROT_90",  Transform::ROT_90 },
+        { "ROT_180", Transform::ROT_180 },
+        { "ROT_270", Transform::ROT_270 },
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(kOrientations) / sizeof(kOrientations[0]); i++) {
+        Transform tr;
+        tr.set(kOrientations[i].flags, 1080, 1920);
+        ok &= testRegionTransform(kOrientations[i].name, tr, reg);
+    }
+    Transform translate;
+    translate.set(10.3f, -20.6f);
+    Transform scale;
+    scale.set(1.5f, 0, 0, 0.75f);
+    ok &= testRegionTransform("translate", translate, reg);
+    ok &= testRegionTransform("scale", scale, reg);
+
+    return ok ? 0 : 1;
 }